@@ -35,9 +35,14 @@
 #define KERNEL_SOCKET_PATH "\0flexnic_os"
 #define KERNEL_UXSOCK_MAXQ 8
 
+/** NUMA node of the requesting thread is unknown */
+#define KERNEL_UXSOCK_NONODE 0xffff
+
 struct kernel_uxsock_request {
   uint32_t rxq_len;
   uint32_t txq_len;
+  /** NUMA node the context is used on, for placing its queues */
+  uint16_t numa_node;
 } __attribute__((packed));
 
 struct kernel_uxsock_response {
@@ -69,6 +74,7 @@ enum kernel_appout_type {
   KERNEL_APPOUT_LISTEN_CLOSE,
   KERNEL_APPOUT_ACCEPT_CONN,
   KERNEL_APPOUT_REQ_SCALE,
+  KERNEL_APPOUT_APP_SCHED,
 };
 
 /** Open a new connection */
@@ -127,6 +133,13 @@ struct kernel_appout_req_scale {
   uint32_t num_cores;
 } __attribute__((packed));
 
+/** Set fast path scheduling weight and rate limit [kbps] for application,
+ * the limit is enforced per fast path core */
+struct kernel_appout_app_sched {
+  uint32_t rate;
+  uint16_t weight;
+} __attribute__((packed));
+
 /** Common struct for events on kernel -> app queue */
 struct kernel_appout {
   uint64_t ts;
@@ -140,6 +153,7 @@ struct kernel_appout {
     struct kernel_appout_accept_conn  accept_conn;
 
     struct kernel_appout_req_scale    req_scale;
+    struct kernel_appout_app_sched    app_sched;
 
     uint8_t raw[64 - sizeof(uint64_t) - sizeof(uint8_t)];
   } __attribute__((packed)) data;
@@ -63,6 +63,21 @@ struct flexnic_info {
   uint32_t cores_num;
 } __attribute__((packed));
 
+/** Offset of per-core doorbells in info shared memory region */
+#define FLEXNIC_INFO_DB_OFF 0x400
+
+/** Doorbell for fast path core: bit per app context with new entries in its
+ * TX queue to this core, set by the app, cleared by the fast path */
+struct flexnic_doorbell {
+  volatile uint64_t ctxs;
+  uint8_t pad[56];
+} __attribute__((packed, aligned(64)));
+
+/** Doorbell for core in info region */
+#define FLEXNIC_INFO_DB(info, core) \
+  ((struct flexnic_doorbell *) ((uint8_t *) (info) + FLEXNIC_INFO_DB_OFF) + \
+   (core))
+
 
 
 /******************************************************************************/
@@ -175,9 +190,18 @@ STATIC_ASSERT(sizeof(struct flextcp_pl_atx) == 16, atx_size);
 #define FLEXNIC_PL_APPST_CTX_NUM   31
 #define FLEXNIC_PL_APPST_CTX_MCS   16
 #define FLEXNIC_PL_APPCTX_NUM      16
+STATIC_ASSERT(FLEXNIC_PL_APPCTX_NUM <= 64, appctx_doorbell_bits);
+STATIC_ASSERT(FLEXNIC_INFO_DB_OFF + FLEXNIC_PL_APPST_CTX_MCS * 64 <=
+    FLEXNIC_INFO_BYTES, info_doorbells_size);
+/** Default number of flow states, set at startup with --fp-flows */
 #define FLEXNIC_PL_FLOWST_NUM     (128 * 1024)
-#define FLEXNIC_PL_FLOWHT_ENTRIES (FLEXNIC_PL_FLOWST_NUM * 2)
-#define FLEXNIC_PL_FLOWHT_NBSZ      4
+/** Max. number of flow states (limited by 32-bit flow timer ids, 4 per flow,
+ * the lookup table could address 2^30) */
+#define FLEXNIC_PL_FLOWST_MAX     (1U << 29)
+#define FLEXNIC_PL_FLOWHT_BSZ       8
+/** Lookup table buckets for `n` flows: twice as many slots as flows */
+#define FLEXNIC_PL_FLOWHT_BUCKETS(n) \
+  (((n) * 2 + FLEXNIC_PL_FLOWHT_BSZ - 1) / FLEXNIC_PL_FLOWHT_BSZ)
 
 /** Application state */
 struct flextcp_pl_appst {
@@ -189,6 +213,15 @@ struct flextcp_pl_appst {
 
   /** IDs of contexts */
   uint16_t ctx_ids[FLEXNIC_PL_APPST_CTX_NUM];
+
+  /********************************************************/
+  /* set by kernel, read by fast path queue manager */
+
+  /** Weight relative to other applications (0 treated as 1) */
+  uint16_t qm_weight;
+  /** Rate limit for all flows of the application on a core [kbps], 0 for
+   * none */
+  uint32_t qm_rate;
 } __attribute__((packed));
 
 
@@ -202,6 +235,7 @@ struct flextcp_pl_appctx {
   uint32_t tx_len;
   uint32_t appst_id;
   int	   evfd;
+  uint16_t numa_node;
 
   /********************************************************/
   /* read-write fields */
@@ -213,8 +247,11 @@ struct flextcp_pl_appctx {
 
 /** Enable out of order receive processing members */
 #define FLEXNIC_PL_OOO_RECV 1
+/** Max. number of out of order intervals tracked per flow */
+#define FLEXNIC_PL_OOO_INTERVALS 4
 
 #define FLEXNIC_PL_FLOWST_SLOWPATH 1
+#define FLEXNIC_PL_FLOWST_SACK 2
 #define FLEXNIC_PL_FLOWST_ECN 8
 #define FLEXNIC_PL_FLOWST_TXFIN 16
 #define FLEXNIC_PL_FLOWST_RXFIN 32
@@ -248,7 +285,9 @@ struct flextcp_pl_flowst {
   struct eth_addr remote_mac;
 
   /** Doorbell ID (identifying the app ctx to use) */
-  uint16_t db_id;
+  uint8_t db_id;
+  /** Window scale shift for windows received from remote end */
+  uint8_t tx_wscale;
 
   /** Flow group for this connection (rss bucket) */
   uint16_t flow_group;
@@ -273,12 +312,16 @@ struct flextcp_pl_flowst {
   /** Bytes available in remote end for received segments */
   uint32_t rx_remote_avail;
   /** Duplicate ack count */
-  uint32_t rx_dupack_cnt;
+  uint8_t rx_dupack_cnt;
+  /** Window scale shift for advertised receive window */
+  uint8_t rx_wscale;
+  /** Max. payload per segment (negotiated MSS minus timestamp option) */
+  uint16_t tx_mss;
 
 #ifdef FLEXNIC_PL_OOO_RECV
-  /* Start of interval of out-of-order received data */
+  /* Start of first interval of out-of-order received data */
   uint32_t rx_ooo_start;
-  /* Length of interval of out-of-order received data */
+  /* Length of first interval of out-of-order received data (0 if none) */
   uint32_t rx_ooo_len;
 #endif
 
@@ -310,29 +353,86 @@ struct flextcp_pl_flowst {
 // 128
 } __attribute__((packed, aligned(64)));
 
-#define FLEXNIC_PL_FLOWHTE_VALID  (1 << 31)
-#define FLEXNIC_PL_FLOWHTE_POSSHIFT 29
+#ifdef FLEXNIC_PL_OOO_RECV
+/** Additional out-of-order intervals of a flow, kept outside the flow state
+ * registers. Intervals are sorted by sequence number, following the first
+ * interval in the flow state, and terminated by a zero length. */
+struct flextcp_pl_flowooo {
+  uint32_t start[FLEXNIC_PL_OOO_INTERVALS - 1];
+  uint32_t len[FLEXNIC_PL_OOO_INTERVALS - 1];
+} __attribute__((packed));
+#endif
+
+/** Max. number of selectively acknowledged ranges tracked per flow */
+#define FLEXNIC_PL_SACK_RANGES 4
 
-/** Flow lookup table entry */
-struct flextcp_pl_flowhte {
-  uint32_t flow_id;
-  uint32_t flow_hash;
+/** Transmit scoreboard of a flow: ranges beyond the cumulative ack the
+ * receiver reported as received through SACK. Sorted by sequence number and
+ * terminated by a zero length. */
+struct flextcp_pl_flowsack {
+  uint32_t start[FLEXNIC_PL_SACK_RANGES];
+  uint32_t len[FLEXNIC_PL_SACK_RANGES];
+} __attribute__((packed));
+
+/** Congestion control state of a flow with fast path congestion control
+ * (--cc=fp-dctcp). Initialized by the slow path when the flow is installed,
+ * updated by the fast path on every ACK. */
+struct flextcp_pl_flowcc {
+  /** Congestion window [bytes] */
+  uint32_t cwnd;
+  /** Slow start threshold [bytes] */
+  uint32_t ssthresh;
+  /** Bytes acknowledged since the last additive increase */
+  uint32_t ca_bytes;
+  /** EWMA of the fraction of ECN marked bytes (UINT32_MAX = 1) */
+  uint32_t alpha;
+  /** Sequence number ending the current observation window for alpha */
+  uint32_t win_end;
+  /** Bytes acknowledged in the current observation window */
+  uint32_t win_ackb;
+  /** ECN marked bytes acknowledged in the current observation window */
+  uint32_t win_ecnb;
+  /** No further window reduction until this sequence number is acked */
+  uint32_t cwr_seq;
+} __attribute__((packed));
+
+/** Transmit header template of a flow, written by the slow path when the flow
+ * is installed: ethernet, IP, and TCP header followed by the timestamp
+ * option (without padding). Per-segment fields (lengths, sequence numbers,
+ * flags, window, timestamps, ECN) are zero, the IP checksum field holds the
+ * sum of the remaining IP header, the TCP checksum field the sum of the
+ * pseudo header without length, plus the constant TCP header fields if
+ * checksums are not offloaded. Sums are not complemented. */
+struct flextcp_pl_flowhdr {
+  uint8_t hdr[64];
+} __attribute__((packed));
+
+#define FLEXNIC_PL_FLOWHTE_VALID  (1U << 31)
+#define FLEXNIC_PL_FLOWHTE_IDMASK (FLEXNIC_PL_FLOWHTE_VALID - 1)
+
+/** Candidate buckets for a flow hash in a table with `n` buckets (cuckoo
+ * hashing) */
+#define FLEXNIC_PL_FLOWHT_B1(h, n) ((h) % (n))
+#define FLEXNIC_PL_FLOWHT_B2(h, n) \
+  ((uint32_t) (((uint64_t) ((uint32_t) (h) * 0x9e3779b1U) * (n)) >> 32))
+
+/** Flow lookup table bucket, one cache line. Hashes are stored together so
+ * all of them can be compared at once. Writers set the hash before the
+ * flow id, an entry is only used if its flow id is valid. */
+struct flextcp_pl_flowhtb {
+  uint32_t flow_hash[FLEXNIC_PL_FLOWHT_BSZ];
+  uint32_t flow_id[FLEXNIC_PL_FLOWHT_BSZ];
 } __attribute__((packed));
 
 
 #define FLEXNIC_PL_MAX_FLOWGROUPS 4096
 
-/** Layout of internal pipeline memory */
+/** Layout of internal pipeline memory. The per-flow tables are sized at
+ * startup and follow this header at the recorded offsets. */
 struct flextcp_pl_mem {
   /* registers for application context queues */
   struct flextcp_pl_appctx appctx[FLEXNIC_PL_APPST_CTX_MCS][FLEXNIC_PL_APPCTX_NUM];
 
-  /* registers for flow state */
-  struct flextcp_pl_flowst flowst[FLEXNIC_PL_FLOWST_NUM];
-
-  /* flow lookup table */
-  struct flextcp_pl_flowhte flowht[FLEXNIC_PL_FLOWHT_ENTRIES];
-
   /* registers for kernel queues */
   struct flextcp_pl_appctx kctx[FLEXNIC_PL_APPST_CTX_MCS];
 
@@ -340,8 +440,29 @@ struct flextcp_pl_mem {
   struct flextcp_pl_appst appst[FLEXNIC_PL_APPST_NUM];
 
   uint8_t flow_group_steering[FLEXNIC_PL_MAX_FLOWGROUPS];
+
+  /* number of flow states */
+  uint32_t flowst_num;
+  /* number of flow lookup table buckets */
+  uint32_t flowht_num;
+  /* incremented by the slow path before and after moving a lookup table
+   * entry to its other bucket, lookups missing while it changed retry */
+  volatile uint32_t flowht_seq;
+
+  /* offsets from start of this struct: flow states, additional out-of-order
+   * intervals, transmit scoreboards, congestion control state, header
+   * templates, and flow lookup table */
+  uint64_t flowst_off;
+  uint64_t flowooo_off;
+  uint64_t flowsack_off;
+  uint64_t flowcc_off;
+  uint64_t flowhdr_off;
+  uint64_t flowht_off;
 } __attribute__((packed));
 
+#define FLEXNIC_PL_MEM_TABLE(m, t, f) \
+  ((t *) ((uint8_t *) (m) + (m)->f##_off))
+
 
 void util_flexnic_kick(struct flextcp_pl_appctx *ctx, uint32_t ts_us);
 
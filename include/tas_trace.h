@@ -62,14 +62,14 @@ struct flexnic_trace_entry_qman_set {
   uint32_t id;
   uint32_t rate;
   uint32_t avail;
-  uint16_t max_chunk;
+  uint32_t max_chunk;
   uint8_t  opaque;
   uint8_t  flags;
 } __attribute__((packed));
 
 struct flexnic_trace_entry_qman_event {
   uint32_t id;
-  uint16_t bytes;
+  uint32_t bytes;
   uint8_t  opaque;
   uint8_t  pad;
 } __attribute__((packed));
@@ -253,6 +253,18 @@ int flextcp_context_poll(struct flextcp_context *ctx, int num,
 
 void flextcp_block(struct flextcp_context *ctx, int timeout_ms);
 
+/**
+ * Set fast path scheduling weight and rate limit [Kbps] (0 for none) for this
+ * application, effective when TAS runs with --fp-qman-fair.
+ *
+ * Each fast path core schedules its flows independently, so the rate limit
+ * applies per core: the application may send at up to the number of active
+ * fast path cores times `rate` in total. Divide the intended aggregate rate
+ * by the number of cores when flows are spread across all of them.
+ */
+int flextcp_app_sched(struct flextcp_context *ctx, uint16_t weight,
+    uint32_t rate);
+
 /*****************************************************************************/
 /* Regular TCP connection management */
 
@@ -556,6 +556,9 @@ static void flextcp_flexnic_kick(struct flextcp_context *ctx, int core)
 
 void flextcp_context_tx_done(struct flextcp_context *ctx, uint16_t core)
 {
+  struct flexnic_doorbell *db = FLEXNIC_INFO_DB(flexnic_info, core);
+  uint64_t bit = 1ULL << ctx->db_id;
+
   ctx->queues[core].txq_tail += sizeof(struct flextcp_pl_atx);
   if (ctx->queues[core].txq_tail >= ctx->txq_len) {
     ctx->queues[core].txq_tail -= ctx->txq_len;
@@ -563,6 +566,12 @@ void flextcp_context_tx_done(struct flextcp_context *ctx, uint16_t core)
 
   ctx->queues[core].txq_avail -= sizeof(struct flextcp_pl_atx);
 
+  /* ring doorbell so fast path polls our queue, fence orders the entry
+   * before reading the doorbell (fast path might just be clearing it) */
+  __sync_synchronize();
+  if ((db->ctxs & bit) == 0)
+    __sync_fetch_and_or(&db->ctxs, bit);
+
   flextcp_flexnic_kick(ctx, core);
 }
 
@@ -28,6 +28,7 @@
 #include <sys/un.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
 
 #include <kernel_appif.h>
 #include <utils_timeout.h>
@@ -164,9 +165,15 @@ int flextcp_kernel_newctx(struct flextcp_context *ctx)
   struct kernel_uxsock_request req = {
       .rxq_len = NIC_RXQ_LEN,
       .txq_len = NIC_TXQ_LEN,
+      .numa_node = KERNEL_UXSOCK_NONODE,
     };
+  unsigned cpu, node;
   uint16_t i;
 
+  /* let tas place the context queues on our NUMA node */
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+    req.numa_node = node;
+
   /* send request on kernel socket */
   struct iovec iov = {
     .iov_base = &req,
@@ -284,3 +291,32 @@ int flextcp_kernel_reqscale(struct flextcp_context *ctx, uint32_t cores)
 
   return 0;
 }
+
+int flextcp_app_sched(struct flextcp_context *ctx, uint16_t weight,
+    uint32_t rate)
+{
+  uint32_t pos = ctx->kin_head;
+  struct kernel_appout *kin = ctx->kin_base;
+
+  kin += pos;
+
+  if (kin->type != KERNEL_APPOUT_INVALID) {
+    fprintf(stderr, "flextcp_app_sched: no queue space\n");
+    return -1;
+  }
+
+  kin->data.app_sched.weight = weight;
+  kin->data.app_sched.rate = rate;
+  MEM_BARRIER();
+  kin->type = KERNEL_APPOUT_APP_SCHED;
+  kin->ts = util_rdtsc();
+  flextcp_kernel_kick();
+
+  pos = pos + 1;
+  if (pos >= ctx->kin_len) {
+    pos = 0;
+  }
+  ctx->kin_head = pos;
+
+  return 0;
+}
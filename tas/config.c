@@ -30,6 +30,7 @@
 #include <unistd.h>
 
 #include <utils.h>
+#include <tas_memif.h>
 
 #include <config.h>
 
@@ -46,6 +47,8 @@ enum cfg_params {
   CP_TCP_TXBUF_LEN,
   CP_TCP_HANDSHAKE_TO,
   CP_TCP_HANDSHAKE_RETRIES,
+  CP_TCP_NO_SACK,
+  CP_TCP_NO_WSCALE,
   CP_CC,
   CP_CC_CONTROL_GRANULARITY,
   CP_CC_CONTROL_INTERVAL,
@@ -67,9 +70,25 @@ enum cfg_params {
   CP_CC_TIMELY_MINRATE,
   CP_IP_ROUTE,
   CP_IP_ADDR,
+  CP_IP_MTU,
   CP_FP_CORES_MAX,
   CP_FP_NO_INTS,
   CP_FP_NO_XSUMOFFLOAD,
+  CP_FP_TSO,
+  CP_FP_NO_GRO,
+  CP_FP_TX_ZEROCOPY,
+  CP_FP_RX_NTSTORE,
+  CP_FP_BATCH_MAX,
+  CP_FP_FLOW_OWNER,
+  CP_FP_FLOWS,
+  CP_FP_QMAN_WHEEL,
+  CP_FP_QMAN_FAIR,
+  CP_FP_REBALANCE,
+  CP_FP_NUMA,
+  CP_FP_DELACK,
+  CP_FP_DELACK_TO,
+  CP_FP_RACK,
+  CP_FP_RTO,
   CP_FP_NO_AUTOSCALE,
   CP_FP_NO_HUGEPAGES,
   CP_KNI_NAME,
@@ -115,6 +134,12 @@ static struct option opts[] = {
     { .name = "tcp-handshake-retries",
       .has_arg = required_argument,
       .val = CP_TCP_HANDSHAKE_RETRIES },
+    { .name = "tcp-no-sack",
+      .has_arg = no_argument,
+      .val = CP_TCP_NO_SACK },
+    { .name = "tcp-no-wscale",
+      .has_arg = no_argument,
+      .val = CP_TCP_NO_WSCALE },
     { .name = "cc",
       .has_arg = required_argument,
       .val = CP_CC },
@@ -178,6 +203,9 @@ static struct option opts[] = {
     { .name = "ip-addr",
       .has_arg = required_argument,
       .val = CP_IP_ADDR },
+    { .name = "ip-mtu",
+      .has_arg = required_argument,
+      .val = CP_IP_MTU },
     { .name = "fp-cores-max",
       .has_arg = required_argument,
       .val = CP_FP_CORES_MAX },
@@ -187,6 +215,51 @@ static struct option opts[] = {
     { .name = "fp-no-xsumoffload",
       .has_arg = no_argument,
       .val = CP_FP_NO_XSUMOFFLOAD },
+    { .name = "fp-tso",
+      .has_arg = no_argument,
+      .val = CP_FP_TSO },
+    { .name = "fp-no-gro",
+      .has_arg = no_argument,
+      .val = CP_FP_NO_GRO },
+    { .name = "fp-tx-zerocopy",
+      .has_arg = no_argument,
+      .val = CP_FP_TX_ZEROCOPY },
+    { .name = "fp-rx-ntstore",
+      .has_arg = no_argument,
+      .val = CP_FP_RX_NTSTORE },
+    { .name = "fp-batch-max",
+      .has_arg = required_argument,
+      .val = CP_FP_BATCH_MAX },
+    { .name = "fp-flow-owner",
+      .has_arg = no_argument,
+      .val = CP_FP_FLOW_OWNER },
+    { .name = "fp-flows",
+      .has_arg = required_argument,
+      .val = CP_FP_FLOWS },
+    { .name = "fp-qman-wheel",
+      .has_arg = required_argument,
+      .val = CP_FP_QMAN_WHEEL },
+    { .name = "fp-qman-fair",
+      .has_arg = no_argument,
+      .val = CP_FP_QMAN_FAIR },
+    { .name = "fp-rebalance",
+      .has_arg = required_argument,
+      .val = CP_FP_REBALANCE },
+    { .name = "fp-numa",
+      .has_arg = no_argument,
+      .val = CP_FP_NUMA },
+    { .name = "fp-delack",
+      .has_arg = required_argument,
+      .val = CP_FP_DELACK },
+    { .name = "fp-delack-timeout",
+      .has_arg = required_argument,
+      .val = CP_FP_DELACK_TO },
+    { .name = "fp-rack",
+      .has_arg = no_argument,
+      .val = CP_FP_RACK },
+    { .name = "fp-rto",
+      .has_arg = required_argument,
+      .val = CP_FP_RTO },
     { .name = "fp-no-autoscale",
       .has_arg = no_argument,
       .val = CP_FP_NO_AUTOSCALE },
@@ -304,6 +377,12 @@ int config_parse(struct configuration *c, int argc, char *argv[])
           goto failed;
         }
         break;
+      case CP_TCP_NO_SACK:
+        c->tcp_sack = 0;
+        break;
+      case CP_TCP_NO_WSCALE:
+        c->tcp_wscale = 0;
+        break;
       case CP_CC:
         if (!strcmp(optarg, "dctcp-win")) {
           c->cc_algorithm = CONFIG_CC_DCTCP_WIN;
@@ -313,6 +392,8 @@ int config_parse(struct configuration *c, int argc, char *argv[])
           c->cc_algorithm = CONFIG_CC_CONST_RATE;
         } else if (!strcmp(optarg, "timely")) {
           c->cc_algorithm = CONFIG_CC_TIMELY;
+        } else if (!strcmp(optarg, "fp-dctcp")) {
+          c->cc_algorithm = CONFIG_CC_FP_DCTCP;
         } else {
           fprintf(stderr, "cc algorithm parsing failed\n");
           goto failed;
@@ -442,6 +523,14 @@ int config_parse(struct configuration *c, int argc, char *argv[])
           goto failed;
         }
         break;
+      case CP_IP_MTU:
+        if (parse_int32(optarg, &c->ip_mtu) != 0 || c->ip_mtu < 576 ||
+            c->ip_mtu > 9000)
+        {
+          fprintf(stderr, "ip mtu parsing failed\n");
+          goto failed;
+        }
+        break;
       case CP_FP_CORES_MAX:
         if (parse_int32(optarg, &c->fp_cores_max) != 0) {
           fprintf(stderr, "fp cores max parsing failed\n");
@@ -454,6 +543,78 @@ int config_parse(struct configuration *c, int argc, char *argv[])
       case CP_FP_NO_XSUMOFFLOAD:
         c->fp_xsumoffload = 0;
         break;
+      case CP_FP_TSO:
+        c->fp_tso = 1;
+        break;
+      case CP_FP_NO_GRO:
+        c->fp_gro = 0;
+        break;
+      case CP_FP_TX_ZEROCOPY:
+        c->fp_tx_zerocopy = 1;
+        break;
+      case CP_FP_RX_NTSTORE:
+        c->fp_rx_ntstore = 1;
+        break;
+      case CP_FP_BATCH_MAX:
+        if (parse_int32(optarg, &c->fp_batch_max) != 0) {
+          fprintf(stderr, "fp batch max parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_FLOW_OWNER:
+        c->fp_flow_owner = 1;
+        break;
+      case CP_FP_FLOWS:
+        if (parse_int32(optarg, &c->fp_flows) != 0 || c->fp_flows == 0 ||
+            c->fp_flows > FLEXNIC_PL_FLOWST_MAX)
+        {
+          fprintf(stderr, "fp flows parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_QMAN_WHEEL:
+        if (parse_int32(optarg, &c->fp_qman_wheel) != 0 ||
+            c->fp_qman_wheel == 0 || c->fp_qman_wheel > (1 << 20) ||
+            (c->fp_qman_wheel & (c->fp_qman_wheel - 1)) != 0)
+        {
+          fprintf(stderr, "fp qman wheel parsing failed (slot width must be a "
+              "power of two)\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_QMAN_FAIR:
+        c->fp_qman_fair = 1;
+        break;
+      case CP_FP_REBALANCE:
+        if (parse_int32(optarg, &c->fp_rebalance) != 0) {
+          fprintf(stderr, "fp rebalance interval parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_NUMA:
+        c->fp_numa = 1;
+        break;
+      case CP_FP_DELACK:
+        if (parse_int32(optarg, &c->fp_delack) != 0 || c->fp_delack > 64) {
+          fprintf(stderr, "fp delack segments parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_DELACK_TO:
+        if (parse_int32(optarg, &c->fp_delack_to) != 0) {
+          fprintf(stderr, "fp delack timeout parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_RACK:
+        c->fp_rack = 1;
+        break;
+      case CP_FP_RTO:
+        if (parse_int32(optarg, &c->fp_rto) != 0) {
+          fprintf(stderr, "fp rto parsing failed\n");
+          goto failed;
+        }
+        break;
       case CP_FP_NO_AUTOSCALE:
         c->fp_autoscale = 0;
         break;
@@ -513,6 +674,7 @@ failed:
 static int config_defaults(struct configuration *c, char *progname)
 {
   c->ip = 0;
+  c->ip_mtu = 1500;
   c->nic_rx_len = 16 * 1024;
   c->nic_tx_len = 16 * 1024;
   c->app_kin_len = 1024 * 1024;
@@ -525,6 +687,8 @@ static int config_defaults(struct configuration *c, char *progname)
   c->tcp_txbuf_len = 8192;
   c->tcp_handshake_to = 10000;
   c->tcp_handshake_retries = 10;
+  c->tcp_sack = 1;
+  c->tcp_wscale = 1;
   c->cc_algorithm = CONFIG_CC_DCTCP_RATE;
   c->cc_control_granularity = 50;
   c->cc_control_interval = 2;
@@ -547,6 +711,21 @@ static int config_defaults(struct configuration *c, char *progname)
   c->fp_cores_max = 1;
   c->fp_interrupts = 1;
   c->fp_xsumoffload = 1;
+  c->fp_tso = 0;
+  c->fp_gro = 1;
+  c->fp_tx_zerocopy = 0;
+  c->fp_rx_ntstore = 0;
+  c->fp_batch_max = 64;
+  c->fp_flow_owner = 0;
+  c->fp_flows = FLEXNIC_PL_FLOWST_NUM;
+  c->fp_qman_wheel = 0;
+  c->fp_qman_fair = 0;
+  c->fp_rebalance = 0;
+  c->fp_numa = 0;
+  c->fp_delack = 0;
+  c->fp_delack_to = 0;
+  c->fp_rack = 0;
+  c->fp_rto = 0;
   c->fp_autoscale = 1;
   c->fp_hugepages = 1;
   c->kni_name = NULL;
@@ -590,11 +769,15 @@ static void print_usage(struct configuration *c, char *progname)
           "[default: %"PRIu32"]\n"
       "  --tcp-handshake-retries=RETRIES  Handshake retries "
           "[default: %"PRIu32"]\n"
+      "  --tcp-no-sack               Disable selective acknowledgements "
+          "[default: enabled]\n"
+      "  --tcp-no-wscale             Disable window scaling, limiting "
+          "windows to 64KB [default: enabled]\n"
       "\n"
       "Congestion control parameters:\n"
       "  --cc=ALGORITHM              Congestion-control algorithm "
           "[default: dctcp-rate]\n"
-      "     Options: dctcp-win, dctcp-rate, const-rate, timely\n"
+      "     Options: dctcp-win, dctcp-rate, const-rate, timely, fp-dctcp\n"
       "  --cc-control-granularity=G  Minimal control iteration "
           "[default: %"PRIu32"]\n"
       "  --cc-control-interval=INT   Control interval (multiples of RTT) "
@@ -629,6 +812,8 @@ static void print_usage(struct configuration *c, char *progname)
       "IP protocol parameters:\n"
       "  --ip-route=DEST[/PREFIX],NEXTHOP  Add route\n"
       "  --ip-addr=ADDR[/PREFIXLEN]        Set local IP address\n"
+      "  --ip-mtu=MTU                Interface MTU, up to 9000 for jumbo "
+          "frames [default: %"PRIu32"]\n"
       "\n"
       "ARP protocol parameters:\n"
       "  --arp-timeout=TIMEOUT       ARP request timeout (us) "
@@ -643,6 +828,36 @@ static void print_usage(struct configuration *c, char *progname)
           "[default: enabled]\n"
       "  --fp-no-xsumoffload         Disable TX Checksum offload "
           "[default: enabled]\n"
+      "  --fp-tso                    Enable TCP segmentation offload "
+          "[default: disabled]\n"
+      "  --fp-no-gro                 Disable receive segment coalescing "
+          "[default: enabled]\n"
+      "  --fp-tx-zerocopy            Transmit from app buffers without copy "
+          "[default: disabled]\n"
+      "  --fp-rx-ntstore             Bypass cache when placing rx payload "
+          "[default: disabled]\n"
+      "  --fp-batch-max=SIZE         Max. adaptive batch size "
+          "[default: %"PRIu32"]\n"
+      "  --fp-flow-owner             Only owning core accesses flow state "
+          "[default: disabled]\n"
+      "  --fp-flows=FLOWS            Max. number of flows, timers take 48 B "
+          "per flow and core [default: %"PRIu32"]\n"
+      "  --fp-qman-wheel=NS          Pace flows with timing wheel, slot "
+          "width in ns [default: skiplist]\n"
+      "  --fp-qman-fair              Weighted fair queueing across apps "
+          "[default: disabled]\n"
+      "  --fp-rebalance=US           Move flow groups between cores every US "
+          "[default: disabled]\n"
+      "  --fp-numa                   Place memory on NUMA node of its users "
+          "[default: disabled]\n"
+      "  --fp-delack=SEGS            ACK every SEGS full segments, 0 ACKs "
+          "every segment [default: 0]\n"
+      "  --fp-delack-timeout=US      Max. delay for ACKs, 0 for end of rx "
+          "batch [default: 0]\n"
+      "  --fp-rack                   Time-based loss detection and tail "
+          "loss probes [default: disabled]\n"
+      "  --fp-rto=US                 Min. retransmission timeout in fast "
+          "path, 0 for slow path [default: 0]\n"
       "  --fp-no-autoscale           Disable autoscaling "
           "[default: enabled]\n"
       "  --fp-no-hugepages           Disable hugepages for SHM "
@@ -669,8 +884,8 @@ static void print_usage(struct configuration *c, char *progname)
       c->cc_timely_step, c->cc_timely_init,
       (double) c->cc_timely_alpha / UINT32_MAX,
       (double) c->cc_timely_beta / UINT32_MAX, c->cc_timely_min_rtt,
-      c->cc_timely_min_rate, c->arp_to, c->arp_to_max,
-      c->fp_cores_max);
+      c->cc_timely_min_rate, c->ip_mtu, c->arp_to, c->arp_to_max,
+      c->fp_cores_max, c->fp_batch_max, c->fp_flows);
 }
 
 static inline int parse_int64(const char *s, uint64_t *pi)
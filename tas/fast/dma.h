@@ -32,6 +32,12 @@
 #include <rte_memcpy.h>
 #include <tas.h>
 
+#include "xsum.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef DATAPLANE_STATS
 void dma_dump_stats(void);
 #endif
@@ -52,6 +58,29 @@ static inline void dma_read(uintptr_t addr, size_t len, void *buf)
 #endif
 }
 
+/**
+ * Like dma_read(), but also adds the data to checksum partial sum `sum` (see
+ * xsum.h) while copying, returns the new partial sum.
+ */
+static inline uint64_t dma_read_xsum(uintptr_t addr, size_t len, void *buf,
+    uint64_t sum)
+{
+  assert(addr + len >= addr && addr + len <= FLEXNIC_DMA_MEM_SIZE);
+
+  sum = xsum_copy(buf, (uint8_t *) tas_shm + addr, len, sum);
+
+#ifdef FLEXNIC_TRACE_DMA
+  struct flexnic_trace_entry_dma evt = {
+      .addr = addr,
+      .len = len,
+    };
+  trace_event2(FLEXNIC_TRACE_EV_DMARD, sizeof(evt), &evt,
+      MIN(len, UINT16_MAX - sizeof(evt)), buf);
+#endif
+
+  return sum;
+}
+
 static inline void dma_write(uintptr_t addr, size_t len, const void *buf)
 {
   assert(addr + len >= addr && addr + len <= FLEXNIC_DMA_MEM_SIZE);
@@ -68,6 +97,64 @@ static inline void dma_write(uintptr_t addr, size_t len, const void *buf)
 #endif
 }
 
+/**
+ * Like dma_write(), but bypasses the cache for the aligned bulk of the
+ * buffer. Stores are weakly ordered, dma_write_nt_fence() has to be called
+ * before the data is announced to the application.
+ */
+static inline void dma_write_nt(uintptr_t addr, size_t len, const void *buf)
+{
+  assert(addr + len >= addr && addr + len <= FLEXNIC_DMA_MEM_SIZE);
+
+#ifdef FLEXNIC_TRACE_DMA
+  struct flexnic_trace_entry_dma evt = {
+      .addr = addr,
+      .len = len,
+    };
+  trace_event2(FLEXNIC_TRACE_EV_DMAWR, sizeof(evt), &evt,
+      MIN(len, UINT16_MAX - sizeof(evt)), buf);
+#endif
+
+#ifdef __SSE2__
+  uint8_t *dst = (uint8_t *) tas_shm + addr;
+  const uint8_t *src = buf;
+  size_t head = (16 - ((uintptr_t) dst & 15)) & 15;
+  __m128i a, b, c, d;
+
+  if (len < head + 64) {
+    rte_memcpy(dst, src, len);
+    return;
+  }
+
+  /* copy unaligned head normally, then stream 64 byte blocks */
+  rte_memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  len -= head;
+  for (; len >= 64; len -= 64, dst += 64, src += 64) {
+    a = _mm_loadu_si128((const __m128i *) src);
+    b = _mm_loadu_si128((const __m128i *) (src + 16));
+    c = _mm_loadu_si128((const __m128i *) (src + 32));
+    d = _mm_loadu_si128((const __m128i *) (src + 48));
+    _mm_stream_si128((__m128i *) dst, a);
+    _mm_stream_si128((__m128i *) (dst + 16), b);
+    _mm_stream_si128((__m128i *) (dst + 32), c);
+    _mm_stream_si128((__m128i *) (dst + 48), d);
+  }
+  rte_memcpy(dst, src, len);
+#else
+  rte_memcpy((uint8_t *) tas_shm + addr, buf, len);
+#endif
+}
+
+/** Order preceding dma_write_nt() stores before subsequent stores */
+static inline void dma_write_nt_fence(void)
+{
+#ifdef __SSE2__
+  _mm_sfence();
+#endif
+}
+
 static inline void *dma_pointer(uintptr_t addr, size_t len)
 {
   /* validate address */
@@ -65,12 +65,12 @@ int fast_appctx_poll_fetch(struct dataplane_context *ctx, uint32_t id,
 
   /* update RX/TX queue pointers for connection */
   flow_id = atx->msg.connupdate.flow_id;
-  if (flow_id >= FLEXNIC_PL_FLOWST_NUM) {
+  if (flow_id >= fp_state->flowst_num) {
     fprintf(stderr, "fast_appctx_poll: invalid flow id=%u\n", flow_id);
     abort();
   }
 
-  void *fs = &fp_state->flowst[flow_id];
+  void *fs = &fp_flowst[flow_id];
   rte_prefetch0(fs);
   rte_prefetch0(fs + 64);
 
@@ -166,5 +166,9 @@ int fast_actx_rxq_probe(struct dataplane_context *ctx, uint32_t id)
     MEM_BARRIER();
   }
 
+  /* all entries freed by the app */
+  if (actx->rx_avail == actx->rx_len)
+    return 1;
+
   return 0;
 }
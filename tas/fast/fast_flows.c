@@ -23,19 +23,36 @@
  */
 
 #include <assert.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include <rte_config.h>
 #include <rte_ip.h>
 #include <rte_hash_crc.h>
+#include <rte_malloc.h>
+#include <rte_pause.h>
 
 #include <tas_memif.h>
 #include <utils_sync.h>
+#include <utils_timeout.h>
 
 #include "internal.h"
 #include "fastemu.h"
 #include "tcp_common.h"
+#include "xsum.h"
 
-#define TCP_MSS 1448
 #define TCP_MAX_RTT 100000
+/** Max payload for TSO super-segments (fits in 16-bit IP len) */
+#define TCP_TSO_MAX (44 * 1448)
+/** Max bytes handed out by the queue manager at once for a flow (rounded
+ * down to a multiple of the flow's MSS for TSO) */
+#define TCP_MAX_CHUNK(fs) (config.fp_tso ? \
+    TCP_TSO_MAX - TCP_TSO_MAX % (fs)->tx_mss : (fs)->tx_mss)
+/** Min. payload written to receive buffers with non-temporal stores */
+#define TCP_RX_NTSTORE_MIN 1024
+/** Header length for data segments (with timestamp option) */
+#define TCP_SEG_HDRLEN \
+  (sizeof(struct pkt_tcp) + ((sizeof(struct tcp_timestamp_opt) + 3) & ~3))
 
 //#define SKIP_ACK 1
 
@@ -46,34 +63,268 @@ struct flow_key {
   beui16_t remote_port;
 } __attribute__((packed));
 
-#if 1
-#define fs_lock(fs) util_spin_lock(&fs->lock)
-#define fs_unlock(fs) util_spin_unlock(&fs->lock)
-#else
-#define fs_lock(fs) do {} while (0)
-#define fs_unlock(fs) do {} while (0)
-#endif
+/* with flow ownership only the owning core touches a flow, no lock needed */
+#define fs_lock(fs) \
+  do { if (!config.fp_flow_owner) util_spin_lock(&fs->lock); } while (0)
+#define fs_unlock(fs) \
+  do { if (!config.fp_flow_owner) util_spin_unlock(&fs->lock); } while (0)
+
+/** Entry types on the per-core forwarding ring (qman_fwd_ring) */
+enum fwd_type {
+  /** re-arm queue manager for flow migrated to this core */
+  FWD_QMAN = 0,
+  /** apply bumps accumulated in flow_fwd by other cores */
+  FWD_BUMP = 1,
+  /** retransmit request for flow owned by this core */
+  FWD_REXMIT = 2,
+  /** hand over flow group to core now steered to */
+  FWD_HANDOFF = 3,
+  /** hand flow over to the slow path */
+  FWD_DISABLE = 4,
+  /** flow timer expired on another core's wheel (id is the timer id) */
+  FWD_TIMER = 5,
+};
+#define FWD_ENTRY(t, id) ((void *) (((uintptr_t) (id) << 3) | (t)))
+#define FWD_TYPE(e) ((uintptr_t) (e) & 7)
+#define FWD_ID(e) ((uintptr_t) (e) >> 3)
+/** Max. time the slow path waits for the owning core to disable a flow [us] */
+#define FWD_DISABLE_TIMEOUT 100000
+
+/** Requests from other cores pending for a flow (ownership mode) */
+struct flow_fwd {
+  uint32_t rx_bump;
+  uint32_t tx_bump;
+  uint8_t flags;
+  uint8_t bump_pending;
+  uint8_t rexmit_pending;
+
+  /* state reported back to the slow path on disable, done echoes the
+   * request number once the owner filled in the rest */
+  volatile uint8_t disable_req;
+  volatile uint8_t disable_done;
+  uint8_t tx_closed;
+  uint8_t rx_closed;
+  uint32_t tx_seq;
+  uint32_t rx_seq;
+} __attribute__((aligned(32)));
+
+/** Core currently owning each flow group, only written by the owner when
+ * handing the group off */
+static volatile uint8_t flow_group_owner[FLEXNIC_PL_MAX_FLOWGROUPS];
+static struct flow_fwd *flow_fwds;
+
+/** Timer state per flow, the timers are queued on the wheels of the cores
+ * arming them and checked against this on expiry */
+struct flow_timers {
+  /** Deadline per timer type (if armed) */
+  uint32_t ts[FLOW_TIMER_NUM];
+  /** Armed timer types */
+  uint8_t armed;
+  /** Consecutive retransmission timeouts or window probes */
+  uint8_t backoff;
+} __attribute__((aligned(32)));
+
+static struct flow_timers *flow_timers;
+
+/** Max. doublings of the retransmission timeout */
+#define RTO_BACKOFF_MAX 6
+
+/** Received bytes not acknowledged yet per flow */
+static uint32_t *flow_delacks;
+
+/** Data sent after the oldest unacknowledged segment was delivered */
+#define RACK_REORDER 1
+/** Tail loss probe sent for the current flight */
+#define RACK_TLP 2
+/** Min. tail loss probe timeout [us] */
+#define RACK_PTO_MIN 20
+
+/** Loss detection state per flow, kept outside the flow state */
+struct flow_rack {
+  /** Send time of the oldest unacknowledged segment */
+  uint32_t una_ts;
+  /** Presumed lost data has been retransmitted up to here */
+  uint32_t rexmit_seq;
+  /** Time of last retransmission */
+  uint32_t rexmit_ts;
+  uint8_t flags;
+} __attribute__((aligned(16)));
+
+static struct flow_rack *flow_racks;
 
 
 static void flow_tx_read(struct flextcp_pl_flowst *fs, uint32_t pos,
     uint16_t len, void *dst);
+static uint64_t flow_tx_read_xsum(struct flextcp_pl_flowst *fs, uint32_t pos,
+    uint16_t len, void *dst);
+static void flow_tx_read_chain(struct flextcp_pl_flowst *fs, uint32_t pos,
+    uint32_t len, struct network_buf_handle *nbh);
+static uint32_t flow_tx_chain(struct dataplane_context *ctx,
+    struct network_buf_handle *nbh, uint32_t len);
+static uint32_t flow_tx_chain_ext(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, struct network_buf_handle *nbh,
+    uint32_t len);
+static void flow_tx_attach(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, uint32_t pos, uint32_t len,
+    struct network_buf_handle *nbh);
 static void flow_rx_write(struct flextcp_pl_flowst *fs, uint32_t pos,
-    uint16_t len, const void *src);
+    uint16_t len, const void *src, int nt);
+static void flow_rx_write_segs(struct flextcp_pl_flowst *fs, uint32_t pos,
+    uint16_t len, struct network_buf_handle **nbhs, uint16_t num,
+    uint16_t skip);
 #ifdef FLEXNIC_PL_OOO_RECV
 static void flow_rx_seq_write(struct flextcp_pl_flowst *fs, uint32_t seq,
-    uint16_t len, const void *src);
+    uint16_t len, struct network_buf_handle **nbhs, uint16_t num,
+    uint16_t skip);
+static int flow_rx_ooo_add(struct flextcp_pl_flowst *fs, uint32_t seq,
+    uint32_t len);
+static uint32_t flow_rx_ooo_advance(struct flextcp_pl_flowst *fs);
+static uint16_t flow_rx_sack_opt(struct flextcp_pl_flowst *fs, uint8_t *opt);
 #endif
+static void flow_tx_sack_update(struct flextcp_pl_flowst *fs, uint32_t ack,
+    struct tcp_sack_opt *sack);
+static uint32_t flow_tx_sack_skip(struct flextcp_pl_flowst *fs);
 static void flow_tx_segment(struct dataplane_context *ctx,
     struct network_buf_handle *nbh, struct flextcp_pl_flowst *fs,
-    uint32_t seq, uint32_t ack, uint32_t rxwnd, uint16_t payload,
+    uint32_t seq, uint32_t ack, uint32_t rxwnd, uint32_t payload,
     uint32_t payload_pos, uint32_t ts_echo, uint32_t ts_my, uint8_t fin);
-static void flow_tx_ack(struct dataplane_context *ctx, uint32_t seq,
-    uint32_t ack, uint32_t rxwnd, uint32_t echo_ts, uint32_t my_ts,
-    struct network_buf_handle *nbh, struct tcp_timestamp_opt *ts_opt);
+static void flow_tx_ack(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, uint32_t seq, uint32_t ack, uint32_t rxwnd,
+    uint32_t echo_ts, uint32_t my_ts, struct network_buf_handle *nbh);
 static void flow_reset_retransmit(struct flextcp_pl_flowst *fs);
+static int flow_bump_apply(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, uint32_t rx_bump, uint32_t tx_bump,
+    uint8_t flags, struct network_buf_handle *nbh, uint32_t ts);
+static void flow_retransmit(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs);
+static int flow_fwd_try(uint16_t core, void *entry, uint32_t ts);
+static void flow_fwd_post(struct dataplane_context *ctx, uint16_t core,
+    void *entry, uint32_t ts);
+static inline void flow_timer_arm(struct dataplane_context *ctx,
+    uint32_t flow_id, uint8_t type, uint32_t deadline);
+static inline void flow_timer_cancel(struct dataplane_context *ctx,
+    uint32_t flow_id, uint8_t type);
+static inline void flow_rto_sent(struct dataplane_context *ctx,
+    uint32_t flow_id, struct flextcp_pl_flowst *fs, uint32_t ts);
+static inline void flow_rto_ack(struct dataplane_context *ctx,
+    uint32_t flow_id, struct flextcp_pl_flowst *fs, uint32_t tx_bump,
+    uint32_t ts);
+static inline void flow_persist_arm(struct dataplane_context *ctx,
+    uint32_t flow_id, struct flextcp_pl_flowst *fs, uint32_t ts);
+static int flow_delack(struct dataplane_context *ctx, uint32_t flow_id,
+    uint32_t bytes, uint32_t ts);
+static inline void flow_delack_clear(uint32_t flow_id);
+static inline void flow_rack_sent(struct dataplane_context *ctx,
+    uint32_t flow_id, struct flextcp_pl_flowst *fs, uint32_t ts);
+static void flow_rack_ack(struct dataplane_context *ctx, uint32_t flow_id,
+    struct flextcp_pl_flowst *fs, uint32_t tx_bump, uint32_t ts_ecr,
+    uint32_t ts);
+static inline void flow_tx_loss(struct flextcp_pl_flowst *fs);
+static inline uint32_t flow_txavail(uint32_t flow_id,
+    const struct flextcp_pl_flowst *fs, const uint32_t *pavail);
+static inline void flow_cc_ack(uint32_t flow_id,
+    struct flextcp_pl_flowst *fs, uint32_t tx_bump, int ece);
+static inline void flow_cc_timeout(uint32_t flow_id,
+    struct flextcp_pl_flowst *fs);
 
 static inline void tcp_checksums(struct network_buf_handle *nbh,
     struct pkt_tcp *p, beui32_t ip_s, beui32_t ip_d, uint16_t l3_paylen);
+static inline void tcp_checksums_sw(struct pkt_tcp *p, uint16_t l3_paylen,
+    uint16_t l4_hdrlen, uint64_t payload_sum);
+static inline int tcp_rx_xsums_ok(struct network_buf_handle *nbh);
+static inline void flow_hdr_copy(struct pkt_tcp *p, uint32_t flow_id);
+static inline void flow_hdr_xsums(struct network_buf_handle *nbh,
+    struct pkt_tcp *p, uint32_t flow_id, uint16_t l4_hdrlen, uint32_t payload,
+    uint64_t payload_sum);
+static inline uint16_t tcp_payload(struct network_buf_handle *nbh,
+    uint8_t **payload);
+
+int fast_flows_init(void)
+{
+  uint16_t i;
+
+  if (config.fp_delack != 0) {
+    flow_delacks = rte_calloc("flow delack", fp_state->flowst_num,
+        sizeof(*flow_delacks), 64);
+    if (flow_delacks == NULL) {
+      fprintf(stderr, "fast_flows_init: allocating delayed ack table failed\n");
+      return -1;
+    }
+  }
+
+  if (config.fp_delack != 0 || config.fp_rack || config.fp_rto != 0) {
+    flow_timers = rte_calloc("flow timers", fp_state->flowst_num,
+        sizeof(*flow_timers), 64);
+    if (flow_timers == NULL) {
+      fprintf(stderr, "fast_flows_init: allocating timer table failed\n");
+      return -1;
+    }
+  }
+
+  if (config.fp_rack) {
+    flow_racks = rte_calloc("flow rack", fp_state->flowst_num,
+        sizeof(*flow_racks), 64);
+    if (flow_racks == NULL) {
+      fprintf(stderr, "fast_flows_init: allocating loss detection table "
+          "failed\n");
+      return -1;
+    }
+  }
+
+  if (!config.fp_flow_owner)
+    return 0;
+
+  flow_fwds = rte_calloc("flow fwd", fp_state->flowst_num,
+      sizeof(*flow_fwds), 64);
+  if (flow_fwds == NULL) {
+    fprintf(stderr, "fast_flows_init: allocating forwarding table failed\n");
+    return -1;
+  }
+
+  for (i = 0; i < FLEXNIC_PL_MAX_FLOWGROUPS; i++)
+    flow_group_owner[i] = fp_state->flow_group_steering[i];
+
+  return 0;
+}
+
+/* core responsible for flow: the owner in ownership mode, otherwise the one
+ * its flow group is steered to */
+static inline uint16_t flow_core(struct flextcp_pl_flowst *fs)
+{
+  if (config.fp_flow_owner)
+    return flow_group_owner[fs->flow_group];
+  return fp_state->flow_group_steering[fs->flow_group];
+}
+
+/* tell queue manager which application the flow belongs to before arming
+ * its queue, only needed for per-app fair queueing */
+static inline void flow_qman_app(struct dataplane_context *ctx,
+    uint32_t flow_id, struct flextcp_pl_flowst *fs)
+{
+  if (config.fp_qman_fair)
+    qman_set_app(&ctx->qman, flow_id,
+        fp_state->appctx[ctx->id][fs->db_id].appst_id);
+}
+
+/* start handing off flow groups whose steering changed to their new cores,
+ * called after the redirection table was updated. Returns -1 if a forwarding
+ * ring was full, the caller calls again later (hand-offs are idempotent). */
+int fast_flows_scale(uint32_t ts)
+{
+  uint16_t i, owner;
+  int ret = 0;
+
+  if (!config.fp_flow_owner)
+    return 0;
+
+  for (i = 0; i < FLEXNIC_PL_MAX_FLOWGROUPS; i++) {
+    owner = flow_group_owner[i];
+    if (owner != fp_state->flow_group_steering[i] &&
+        flow_fwd_try(owner, FWD_ENTRY(FWD_HANDOFF, i), ts) != 0)
+      ret = -1;
+  }
+  return ret;
+}
 
 void fast_flows_qman_pf(struct dataplane_context *ctx, uint32_t *queues,
     uint16_t n)
@@ -81,7 +332,7 @@ void fast_flows_qman_pf(struct dataplane_context *ctx, uint32_t *queues,
   uint16_t i;
 
   for (i = 0; i < n; i++) {
-    rte_prefetch0(&fp_state->flowst[queues[i]]);
+    rte_prefetch0(&fp_flowst[queues[i]]);
   }
 }
 
@@ -93,7 +344,7 @@ void fast_flows_qman_pfbufs(struct dataplane_context *ctx, uint32_t *queues,
   void *p;
 
   for (i = 0; i < n; i++) {
-    fs = &fp_state->flowst[queues[i]];
+    fs = &fp_flowst[queues[i]];
     p = dma_pointer(fs->tx_base + fs->tx_next_pos, 1);
     rte_prefetch0(p);
     rte_prefetch0(p + 64);
@@ -105,8 +356,8 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
     struct network_buf_handle *nbh, uint32_t ts)
 {
   uint32_t flow_id = queue;
-  struct flextcp_pl_flowst *fs = &fp_state->flowst[flow_id];
-  uint32_t avail, len, tx_pos, tx_seq, ack, rx_wnd;
+  struct flextcp_pl_flowst *fs = &fp_flowst[flow_id];
+  uint32_t avail, len, seg_len, tx_pos, tx_seq, ack, rx_wnd, sack_lim;
   uint16_t new_core;
   uint8_t fin;
   int ret = 0;
@@ -114,17 +365,11 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
   fs_lock(fs);
 
   /* if connection has been moved, add to forwarding queue and stop */
-  new_core = fp_state->flow_group_steering[fs->flow_group];
+  new_core = flow_core(fs);
   if (new_core != ctx->id) {
     /*fprintf(stderr, "fast_flows_qman: arrived on wrong core, forwarding "
         "%u -> %u (fs=%p, fg=%u)\n", ctx->id, new_core, fs, fs->flow_group);*/
 
-    /* enqueue flo state on forwarding queue */
-    if (rte_ring_enqueue(ctxs[new_core]->qman_fwd_ring, fs) != 0) {
-      fprintf(stderr, "fast_flows_qman: rte_ring_enqueue failed\n");
-      abort();
-    }
-
     /* clear queue manager queue */
     if (qman_set(&ctx->qman, flow_id, 0, 0, 0,
           QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_SET_AVAIL) != 0)
@@ -133,14 +378,27 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
       abort();
     }
 
-    util_flexnic_kick(&fp_state->kctx[new_core], ts);
+    /* enqueue flow on forwarding queue */
+    flow_fwd_post(ctx, new_core, FWD_ENTRY(FWD_QMAN, flow_id), ts);
 
     ret = -1;
     goto unlock;
   }
 
+  if (ctx->fg_pkts != NULL)
+    ctx->fg_pkts[fs->flow_group]++;
+
+  /* skip over data the receiver already has, and stop at the next such
+   * range */
+  sack_lim = UINT32_MAX;
+  if (UNLIKELY((fs->rx_base_sp & FLEXNIC_PL_FLOWST_SACK) ==
+        FLEXNIC_PL_FLOWST_SACK))
+  {
+    sack_lim = flow_tx_sack_skip(fs);
+  }
+
   /* calculate how much is available to be sent */
-  avail = tcp_txavail(fs, NULL);
+  avail = MIN(flow_txavail(flow_id, fs, NULL), sack_lim);
 
 #if PL_DEBUG_ATX
   fprintf(stderr, "ATX try_sendseg local=%08x:%05u remote=%08x:%05u "
@@ -167,7 +425,30 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
     ret = -1;
     goto unlock;
   }
-  len = MIN(avail, TCP_MSS);
+  len = MIN(avail, TCP_MAX_CHUNK(fs));
+
+  /* super-segments and zero-copy payloads need additional buffers, if we
+   * can't get enough, return the rest to the queue manager */
+  seg_len = len;
+  if (config.fp_tx_zerocopy) {
+    seg_len = flow_tx_chain_ext(ctx, fs, nbh, len);
+  } else if (len > fs->tx_mss) {
+    seg_len = flow_tx_chain(ctx, nbh, len);
+  }
+  if (seg_len < len) {
+    if (qman_set(&ctx->qman, flow_id, 0, len - seg_len, 0, QMAN_ADD_AVAIL)
+        != 0)
+    {
+      fprintf(stderr, "fast_flows_qman: qman_set failed, UNEXPECTED\n");
+      abort();
+    }
+    len = seg_len;
+
+    if (len == 0) {
+      ret = -1;
+      goto unlock;
+    }
+  }
 
   /* state snapshot for creating segment */
   tx_seq = fs->tx_next_seq;
@@ -175,6 +456,11 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
   rx_wnd = fs->rx_avail;
   ack = fs->rx_next_seq;
 
+  if (config.fp_rto != 0)
+    flow_rto_sent(ctx, flow_id, fs, ts);
+  if (flow_racks != NULL)
+    flow_rack_sent(ctx, flow_id, fs, ts);
+
   /* update tx flow state */
   fs->tx_next_seq += len;
   fs->tx_next_pos += len;
@@ -193,38 +479,598 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
     len--;
   }
 
-  /* send out segment */
+  /* send out segment, also acknowledges everything received so far */
   flow_tx_segment(ctx, nbh, fs, tx_seq, ack, rx_wnd, len, tx_pos,
       fs->tx_next_ts, ts, fin);
+  flow_delack_clear(flow_id);
 unlock:
   fs_unlock(fs);
   return ret;
 }
 
-int fast_flows_qman_fwd(struct dataplane_context *ctx,
-    struct flextcp_pl_flowst *fs)
+/* Process entry from forwarding ring, returns 0 if `nbh` was used. */
+int fast_flows_qman_fwd(struct dataplane_context *ctx, void *entry,
+    struct network_buf_handle *nbh, uint32_t ts)
 {
-  unsigned avail;
-  uint16_t flow_id = fs - fp_state->flowst;
+  struct flextcp_pl_flowst *fs;
+  struct flow_fwd *ff;
+  uint32_t flow_id = FWD_ID(entry), avail, rx_bump, tx_bump;
+  uint16_t core;
+  uint8_t flags;
+  int ret = -1;
 
-  /*fprintf(stderr, "fast_flows_qman_fwd: fs=%p\n", fs);*/
+  /*fprintf(stderr, "fast_flows_qman_fwd: entry=%p\n", entry);*/
+
+  if (FWD_TYPE(entry) == FWD_HANDOFF) {
+    /* nothing of this group is in flight on this core between loop stages,
+     * publish everything written so far before giving up ownership */
+    core = fp_state->flow_group_steering[flow_id];
+    if (flow_group_owner[flow_id] == ctx->id && core != ctx->id) {
+      MEM_BARRIER();
+      flow_group_owner[flow_id] = core;
+      util_flexnic_kick(&fp_state->kctx[core], ts);
+    }
+    return -1;
+  } else if (FWD_TYPE(entry) == FWD_TIMER) {
+    return fast_flows_timer(ctx, FWD_ID(entry), nbh, ts);
+  }
+
+  fs = &fp_flowst[flow_id];
+
+  /* ownership moved on again since this was posted, pass it along */
+  core = flow_core(fs);
+  if (config.fp_flow_owner && core != ctx->id) {
+    flow_fwd_post(ctx, core, entry, ts);
+    return -1;
+  }
 
   fs_lock(fs);
 
-  avail = tcp_txavail(fs, NULL);
+  switch (FWD_TYPE(entry)) {
+    case FWD_QMAN:
+      avail = flow_txavail(flow_id, fs, NULL);
 
-  /* re-arm queue manager */
-  if (qman_set(&ctx->qman, flow_id, fs->tx_rate, avail, TCP_MSS,
-        QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_SET_AVAIL) != 0)
-  {
-    fprintf(stderr, "fast_flows_qman_fwd: qman_set failed, UNEXPECTED\n");
-    abort();
+      /* re-arm queue manager */
+      flow_qman_app(ctx, flow_id, fs);
+      if (qman_set(&ctx->qman, flow_id, fs->tx_rate, avail, TCP_MAX_CHUNK(fs),
+            QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_SET_AVAIL) != 0)
+      {
+        fprintf(stderr, "fast_flows_qman_fwd: qman_set failed, UNEXPECTED\n");
+        abort();
+      }
+      break;
+
+    case FWD_BUMP:
+      /* clear pending before collecting, so later bumps post a new entry */
+      ff = &flow_fwds[flow_id];
+      __sync_lock_release(&ff->bump_pending);
+      __sync_synchronize();
+      rx_bump = __sync_lock_test_and_set(&ff->rx_bump, 0);
+      tx_bump = __sync_lock_test_and_set(&ff->tx_bump, 0);
+      flags = __sync_lock_test_and_set(&ff->flags, 0);
+      ret = flow_bump_apply(ctx, fs, rx_bump, tx_bump, flags, nbh, ts);
+      break;
+
+    case FWD_REXMIT:
+      __sync_lock_release(&flow_fwds[flow_id].rexmit_pending);
+      flow_retransmit(ctx, fs);
+      break;
+
+    case FWD_DISABLE:
+      ff = &flow_fwds[flow_id];
+      ff->tx_seq = fs->tx_next_seq;
+      ff->rx_seq = fs->rx_next_seq;
+      fs->rx_base_sp |= FLEXNIC_PL_FLOWST_SLOWPATH;
+      ff->rx_closed = !!(fs->rx_base_sp & FLEXNIC_PL_FLOWST_RXFIN);
+      ff->tx_closed = !!(fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXFIN) &&
+          fs->tx_sent == 0;
+      MEM_BARRIER();
+      ff->disable_done = ff->disable_req;
+      break;
   }
 
   fs_unlock(fs);
+  return ret;
+}
+
+/* Mark flow as handled by slow path and return its sequence numbers. In
+ * ownership mode this is done by the owning core, the caller waits for it and
+ * gives up after FWD_DISABLE_TIMEOUT. A request that completes late still
+ * hands the flow to the slow path, but cannot be mistaken for a later one. */
+int dataplane_flow_disable(uint32_t flow_id, uint32_t *tx_seq,
+    uint32_t *rx_seq, int *tx_closed, int *rx_closed, uint32_t ts)
+{
+  struct flextcp_pl_flowst *fs = &fp_flowst[flow_id];
+  struct flow_fwd *ff = &flow_fwds[flow_id];
+  uint8_t req = ff->disable_req + 1;
+  int posted = 0;
+
+  ff->disable_req = req;
+  MEM_BARRIER();
+
+  while (ff->disable_done != req) {
+    /* forwarding ring might be full, keep trying while waiting */
+    if (!posted)
+      posted = (flow_fwd_try(flow_core(fs), FWD_ENTRY(FWD_DISABLE, flow_id),
+            ts) == 0);
+
+    if (util_timeout_time_us() - ts > FWD_DISABLE_TIMEOUT) {
+      fprintf(stderr, "dataplane_flow_disable: flow %u not disabled by core "
+          "%u in time\n", flow_id, flow_core(fs));
+      return -1;
+    }
+    rte_pause();
+  }
+  MEM_BARRIER();
+
+  *tx_seq = ff->tx_seq;
+  *rx_seq = ff->rx_seq;
+  *tx_closed = ff->tx_closed;
+  *rx_closed = ff->rx_closed;
   return 0;
 }
 
+/* enqueue entry on forwarding ring of `core` and wake it up, fails if the
+ * ring is full */
+static int flow_fwd_try(uint16_t core, void *entry, uint32_t ts)
+{
+  if (rte_ring_enqueue(ctxs[core]->qman_fwd_ring, entry) != 0)
+    return -1;
+
+  util_flexnic_kick(&fp_state->kctx[core], ts);
+  return 0;
+}
+
+/* forward entry to `core`, if its ring is full keep the entry to retry from
+ * the dataplane loop. Entries waiting already go first to preserve order. */
+static void flow_fwd_post(struct dataplane_context *ctx, uint16_t core,
+    void *entry, uint32_t ts)
+{
+  if (LIKELY(ctx->fwd_retry_num == 0) && flow_fwd_try(core, entry, ts) == 0)
+    return;
+
+  /* the loop holds back stages forwarding entries while this is not empty */
+  if (ctx->fwd_retry_num >= FWD_RETRY_NUM) {
+    fprintf(stderr, "flow_fwd_post: retry buffer full, UNEXPECTED\n");
+    abort();
+  }
+
+  ctx->fwd_retry[ctx->fwd_retry_num] = entry;
+  ctx->fwd_retry_core[ctx->fwd_retry_num] = core;
+  ctx->fwd_retry_num++;
+}
+
+/* retry entries that did not fit into forwarding rings earlier */
+void fast_flows_fwd_retry(struct dataplane_context *ctx, uint32_t ts)
+{
+  uint16_t i, n = ctx->fwd_retry_num;
+
+  for (i = 0; i < n; i++) {
+    if (flow_fwd_try(ctx->fwd_retry_core[i], ctx->fwd_retry[i], ts) != 0)
+      break;
+  }
+
+  memmove(ctx->fwd_retry, ctx->fwd_retry + i, (n - i) * sizeof(void *));
+  memmove(ctx->fwd_retry_core, ctx->fwd_retry_core + i,
+      (n - i) * sizeof(ctx->fwd_retry_core[0]));
+  ctx->fwd_retry_num = n - i;
+}
+
+/* arm flow timer on this core's wheel (called with flow locked) */
+static inline void flow_timer_arm(struct dataplane_context *ctx,
+    uint32_t flow_id, uint8_t type, uint32_t deadline)
+{
+  struct flow_timers *ft = &flow_timers[flow_id];
+
+  ft->ts[type] = deadline;
+  ft->armed |= 1 << type;
+  timer_wheel_arm(&ctx->timers, flow_id * FLOW_TIMER_NUM + type, deadline);
+}
+
+/* cancel flow timer (called with flow locked), entries left on other cores'
+ * wheels are dropped when they expire */
+static inline void flow_timer_cancel(struct dataplane_context *ctx,
+    uint32_t flow_id, uint8_t type)
+{
+  flow_timers[flow_id].armed &= ~(1 << type);
+  timer_wheel_cancel(&ctx->timers, flow_id * FLOW_TIMER_NUM + type);
+}
+
+static inline int flow_timer_armed(uint32_t flow_id, uint8_t type)
+{
+  return (flow_timers[flow_id].armed & (1 << type)) != 0;
+}
+
+/* smoothed rtt, the initial estimate until sampled */
+static inline uint32_t flow_rtt(struct flextcp_pl_flowst *fs)
+{
+  return (fs->rtt_est != 0 ? fs->rtt_est : config.tcp_rtt_init);
+}
+
+/* retransmission timeout: srtt + 4 * rttvar with the variance estimated as
+ * half the rtt, allowing for a delayed ack, backed off exponentially */
+static inline uint32_t flow_rto(uint32_t flow_id, struct flextcp_pl_flowst *fs)
+{
+  uint32_t rto = MAX(3 * flow_rtt(fs) + config.fp_delack_to, config.fp_rto);
+
+  return rto << flow_timers[flow_id].backoff;
+}
+
+/* new data is about to be sent (called with flow locked): start the
+ * retransmission timer unless it is running */
+static inline void flow_rto_sent(struct dataplane_context *ctx,
+    uint32_t flow_id, struct flextcp_pl_flowst *fs, uint32_t ts)
+{
+  if (!flow_timer_armed(flow_id, FLOW_TIMER_RTO))
+    flow_timer_arm(ctx, flow_id, FLOW_TIMER_RTO, ts + flow_rto(flow_id, fs));
+}
+
+/* valid ack received (called with flow locked): restart the retransmission
+ * timer on progress, stop it once everything is acknowledged */
+static inline void flow_rto_ack(struct dataplane_context *ctx,
+    uint32_t flow_id, struct flextcp_pl_flowst *fs, uint32_t tx_bump,
+    uint32_t ts)
+{
+  if (tx_bump == 0)
+    return;
+
+  flow_timers[flow_id].backoff = 0;
+  if (fs->tx_sent == 0)
+    flow_timer_cancel(ctx, flow_id, FLOW_TIMER_RTO);
+  else
+    flow_timer_arm(ctx, flow_id, FLOW_TIMER_RTO, ts + flow_rto(flow_id, fs));
+}
+
+/* retransmission timeout expired (called with flow locked) */
+static void flow_rto_timeout(struct dataplane_context *ctx, uint32_t flow_id,
+    struct flextcp_pl_flowst *fs)
+{
+  struct flow_timers *ft = &flow_timers[flow_id];
+
+  if (fs->tx_sent == 0)
+    return;
+
+  if (ft->backoff < RTO_BACKOFF_MAX)
+    ft->backoff++;
+  flow_retransmit(ctx, fs);
+}
+
+/* arm zero window probe if data is held back by a closed receive window with
+ * nothing in flight whose ack could open it (called with flow locked) */
+static inline void flow_persist_arm(struct dataplane_context *ctx,
+    uint32_t flow_id, struct flextcp_pl_flowst *fs, uint32_t ts)
+{
+  if (config.fp_rto != 0 && fs->rx_remote_avail == 0 && fs->tx_sent == 0 &&
+      fs->tx_avail != 0 && !flow_timer_armed(flow_id, FLOW_TIMER_PERSIST))
+  {
+    flow_timer_arm(ctx, flow_id, FLOW_TIMER_PERSIST,
+        ts + flow_rto(flow_id, fs));
+  }
+}
+
+/* zero window probe timer expired (called with flow locked): send an empty
+ * segment just below the receive window, which the receiver answers with an
+ * ack carrying its current window. Returns 0 if `nbh` was used. */
+static int flow_persist_timeout(struct dataplane_context *ctx,
+    uint32_t flow_id, struct flextcp_pl_flowst *fs,
+    struct network_buf_handle *nbh, uint32_t ts)
+{
+  struct flow_timers *ft = &flow_timers[flow_id];
+
+  if (fs->rx_remote_avail != 0 || fs->tx_sent != 0 || fs->tx_avail == 0)
+    return -1;
+
+  flow_tx_segment(ctx, nbh, fs, fs->tx_next_seq - 1, fs->rx_next_seq,
+      fs->rx_avail, 0, 0, fs->tx_next_ts, ts, 0);
+  flow_delack_clear(flow_id);
+
+  if (ft->backoff < RTO_BACKOFF_MAX)
+    ft->backoff++;
+  flow_timer_arm(ctx, flow_id, FLOW_TIMER_PERSIST, ts + flow_rto(flow_id, fs));
+  return 0;
+}
+
+/* account in-order bytes received for delayed ack, returns 0 if the ack can
+ * be delayed, -1 if it has to be sent now (called with flow locked) */
+static int flow_delack(struct dataplane_context *ctx, uint32_t flow_id,
+    uint32_t bytes, uint32_t ts)
+{
+  uint32_t pending = flow_delacks[flow_id] + bytes, limit = config.fp_delack *
+    fp_flowst[flow_id].tx_mss;
+
+  /* enough full segments, or receive window closing */
+  if (pending >= limit || fp_flowst[flow_id].rx_avail < limit) {
+    flow_delacks[flow_id] = 0;
+    return -1;
+  }
+
+  if (!flow_timer_armed(flow_id, FLOW_TIMER_DELACK))
+    flow_timer_arm(ctx, flow_id, FLOW_TIMER_DELACK, ts + config.fp_delack_to);
+
+  flow_delacks[flow_id] = pending;
+  return 0;
+}
+
+/* flow acknowledged everything received so far */
+static inline void flow_delack_clear(uint32_t flow_id)
+{
+  if (flow_delacks != NULL)
+    flow_delacks[flow_id] = 0;
+}
+
+/* delayed ack timer expired (called with flow locked): send the ack unless
+ * it went out in the meantime. Returns 0 if `nbh` was used. */
+static int flow_delack_timeout(struct dataplane_context *ctx,
+    uint32_t flow_id, struct flextcp_pl_flowst *fs,
+    struct network_buf_handle *nbh, uint32_t ts)
+{
+  if (flow_delacks[flow_id] == 0)
+    return -1;
+
+  flow_tx_segment(ctx, nbh, fs, fs->tx_next_seq, fs->rx_next_seq,
+      fs->rx_avail, 0, 0, fs->tx_next_ts, ts, 0);
+  flow_delacks[flow_id] = 0;
+  return 0;
+}
+
+/* tail loss probe timeout, allowing for a delayed ack from the receiver */
+static inline uint32_t flow_rack_pto(struct flextcp_pl_flowst *fs)
+{
+  return MAX(2 * flow_rtt(fs) + config.fp_delack_to, RACK_PTO_MIN);
+}
+
+/* new data is about to be sent (called with flow locked, before tx_sent is
+ * updated): starts the clock for a new flight and pushes out the tail loss
+ * probe */
+static inline void flow_rack_sent(struct dataplane_context *ctx,
+    uint32_t flow_id, struct flextcp_pl_flowst *fs, uint32_t ts)
+{
+  struct flow_rack *r = &flow_racks[flow_id];
+
+  if (fs->tx_sent == 0) {
+    r->una_ts = ts;
+    r->rexmit_seq = fs->tx_next_seq;
+    r->flags &= ~(RACK_REORDER | RACK_TLP);
+  }
+
+  /* pending loss detection keeps its earlier deadline */
+  if ((r->flags & RACK_REORDER) == 0)
+    flow_timer_arm(ctx, flow_id, FLOW_TIMER_RACK, ts + flow_rack_pto(fs));
+}
+
+/* update loss detection for valid ack (called with flow locked, after the
+ * SACK scoreboard and duplicate ack count were updated) */
+static void flow_rack_ack(struct dataplane_context *ctx, uint32_t flow_id,
+    struct flextcp_pl_flowst *fs, uint32_t tx_bump, uint32_t ts_ecr,
+    uint32_t ts)
+{
+  struct flow_rack *r = &flow_racks[flow_id];
+  uint32_t una = fs->tx_next_seq - fs->tx_sent, rtt;
+
+  if (tx_bump != 0) {
+    /* data after the acknowledged part was sent no earlier than the segment
+     * whose timestamp is echoed */
+    if (ts_ecr != 0 && (int32_t) (ts_ecr - r->una_ts) > 0)
+      r->una_ts = ts_ecr;
+    r->flags &= ~RACK_TLP;
+  }
+
+  if (fs->tx_sent == 0) {
+    r->flags &= ~RACK_REORDER;
+    flow_timer_cancel(ctx, flow_id, FLOW_TIMER_RACK);
+    return;
+  }
+
+  if (fp_flowsack[flow_id].len[0] != 0 || fs->rx_dupack_cnt != 0) {
+    /* later data was delivered: the oldest segment is presumed lost once it
+     * is overdue by more than a quarter rtt of reordering. While
+     * retransmitting, the timer is left to flow_rack_timeout(). */
+    if ((r->flags & RACK_REORDER) == 0 ||
+        (tx_bump != 0 && (int32_t) (r->rexmit_seq - una) <= 0))
+    {
+      r->flags |= RACK_REORDER;
+      rtt = flow_rtt(fs);
+      flow_timer_arm(ctx, flow_id, FLOW_TIMER_RACK, r->una_ts + rtt + rtt / 4);
+    }
+  } else {
+    r->flags &= ~RACK_REORDER;
+    if (tx_bump != 0)
+      flow_timer_arm(ctx, flow_id, FLOW_TIMER_RACK, ts + flow_rack_pto(fs));
+  }
+}
+
+/* retransmit `len` bytes starting at `seq` (up to tx_next_seq) without
+ * touching the transmit state. Returns 0 if `nbh` was used. */
+static int flow_rack_send(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, struct network_buf_handle *nbh,
+    uint32_t seq, uint32_t len, uint32_t ts)
+{
+  uint32_t off = fs->tx_next_seq - seq, pos, first;
+  uint8_t fin;
+
+  pos = (fs->tx_next_pos >= off ? fs->tx_next_pos - off :
+      fs->tx_next_pos + fs->tx_len - off);
+
+  /* do not send the dummy byte for FIN */
+  fin = (fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXFIN) ==
+    FLEXNIC_PL_FLOWST_TXFIN && fs->tx_avail == 0 && off == len;
+  if (fin)
+    len--;
+
+  /* attached payload needs a buffer per contiguous part */
+  if (len > 0 && config.fp_tx_zerocopy) {
+    first = fs->tx_len - pos;
+    switch (network_buf_chain(&ctx->net, nbh, (len > first ? 2 : 1))) {
+      case 0:
+        return -1;
+      case 1:
+        if (len > first) {
+          len = first;
+          fin = 0;
+        }
+        break;
+    }
+  }
+
+  flow_tx_segment(ctx, nbh, fs, seq, fs->rx_next_seq, fs->rx_avail, len, pos,
+      fs->tx_next_ts, ts, fin);
+  flow_delack_clear(fs - fp_flowst);
+  return 0;
+}
+
+/* loss detection timer expired (called with flow locked): retransmits the
+ * next segment presumed lost, or sends a tail loss probe if nothing after
+ * the oldest segment was acknowledged. Returns 0 if `nbh` was used. */
+static int flow_rack_timeout(struct dataplane_context *ctx, uint32_t flow_id,
+    struct flextcp_pl_flowst *fs, struct network_buf_handle *nbh,
+    uint32_t ts)
+{
+  struct flow_rack *r = &flow_racks[flow_id];
+  struct flextcp_pl_flowsack *sb = &fp_flowsack[flow_id];
+  uint32_t una, high, lost_to, end, len;
+  unsigned i;
+
+  una = fs->tx_next_seq - fs->tx_sent;
+  lost_to = flow_rtt(fs);
+  lost_to += lost_to / 4;
+
+  /* start over if retransmissions were acknowledged, the flow was reset to
+   * the last acknowledged position, or retransmissions are overdue */
+  if ((int32_t) (r->rexmit_seq - una) <= 0 ||
+      (int32_t) (r->rexmit_seq - fs->tx_next_seq) > 0)
+  {
+    r->rexmit_seq = una;
+  } else if ((int32_t) (ts - r->rexmit_ts - lost_to) >= 0) {
+    r->rexmit_seq = una;
+    r->una_ts = r->rexmit_ts;
+  }
+
+  /* everything below the highest selectively acknowledged sequence number
+   * that is not acknowledged is presumed lost, without SACK only the oldest
+   * segment */
+  high = una;
+  for (i = 0; i < FLEXNIC_PL_SACK_RANGES && sb->len[i] != 0; i++)
+    high = sb->start[i] + sb->len[i];
+  if (high == una && fs->rx_dupack_cnt != 0)
+    high = una + MIN(fs->tx_mss, fs->tx_sent);
+  if ((int32_t) (high - fs->tx_next_seq) > 0)
+    high = fs->tx_next_seq;
+
+  if (high == una) {
+    /* no later data delivered: probe with the last segment once per flight
+     * to get an ack with SACK blocks, the retransmit timeout covers the
+     * rest */
+    if ((r->flags & RACK_TLP) != 0)
+      return -1;
+
+    len = MIN(fs->tx_mss, fs->tx_sent);
+    if (flow_rack_send(ctx, fs, nbh, fs->tx_next_seq - len, len, ts) != 0)
+      return -1;
+    r->flags |= RACK_TLP;
+    return 0;
+  }
+
+  /* oldest segment still within reordering window */
+  if (r->rexmit_seq == una && (int32_t) (ts - r->una_ts - lost_to) < 0) {
+    flow_timer_arm(ctx, flow_id, FLOW_TIMER_RACK, r->una_ts + lost_to);
+    return -1;
+  }
+
+  /* skip selectively acknowledged data to the next hole */
+  end = high;
+  for (i = 0; i < FLEXNIC_PL_SACK_RANGES && sb->len[i] != 0; i++) {
+    if ((int32_t) (r->rexmit_seq - sb->start[i]) < 0) {
+      end = sb->start[i];
+      break;
+    } else if ((int32_t) (r->rexmit_seq - sb->start[i] - sb->len[i]) < 0) {
+      r->rexmit_seq = sb->start[i] + sb->len[i];
+    }
+  }
+  if ((int32_t) (end - high) > 0)
+    end = high;
+
+  if ((int32_t) (r->rexmit_seq - high) >= 0) {
+    /* all retransmitted, wait for them to be acknowledged */
+    flow_timer_arm(ctx, flow_id, FLOW_TIMER_RACK, r->rexmit_ts + lost_to);
+    return -1;
+  }
+
+  len = MIN(end - r->rexmit_seq, fs->tx_mss);
+  if (flow_rack_send(ctx, fs, nbh, r->rexmit_seq, len, ts) != 0) {
+    flow_timer_arm(ctx, flow_id, FLOW_TIMER_RACK, ts);
+    return -1;
+  }
+
+  /* first loss in this flight */
+  if (r->rexmit_seq == una)
+    flow_tx_loss(fs);
+
+  r->rexmit_seq += len;
+  r->rexmit_ts = ts;
+
+  /* next lost segment in the next round, then wait for acks */
+  flow_timer_arm(ctx, flow_id, FLOW_TIMER_RACK,
+      (int32_t) (r->rexmit_seq - high) < 0 ? ts : ts + lost_to);
+  return 0;
+}
+
+/* Flow timer expired on this core's wheel. Returns 0 if `nbh` was used. */
+int fast_flows_timer(struct dataplane_context *ctx, uint32_t timer,
+    struct network_buf_handle *nbh, uint32_t ts)
+{
+  uint32_t flow_id = timer / FLOW_TIMER_NUM;
+  uint8_t type = timer % FLOW_TIMER_NUM;
+  struct flextcp_pl_flowst *fs = &fp_flowst[flow_id];
+  struct flow_timers *ft = &flow_timers[flow_id];
+  uint16_t core;
+  int ret = -1;
+
+  /* flow handed off to another core, only the owner touches it */
+  if (config.fp_flow_owner && (core = flow_core(fs)) != ctx->id) {
+    flow_fwd_post(ctx, core, FWD_ENTRY(FWD_TIMER, timer), ts);
+    return -1;
+  }
+
+  fs_lock(fs);
+
+  /* cancelled, or already handled by another core's entry */
+  if ((ft->armed & (1 << type)) == 0)
+    goto unlock;
+
+  /* pushed out in the meantime */
+  if ((int32_t) (ts - ft->ts[type]) < 0) {
+    timer_wheel_arm(&ctx->timers, timer, ft->ts[type]);
+    goto unlock;
+  }
+  ft->armed &= ~(1 << type);
+
+  if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_SLOWPATH) != 0)
+    goto unlock;
+
+  switch (type) {
+    case FLOW_TIMER_DELACK:
+      ret = flow_delack_timeout(ctx, flow_id, fs, nbh, ts);
+      break;
+
+    case FLOW_TIMER_RACK:
+      if (fs->tx_sent != 0)
+        ret = flow_rack_timeout(ctx, flow_id, fs, nbh, ts);
+      break;
+
+    case FLOW_TIMER_RTO:
+      flow_rto_timeout(ctx, flow_id, fs);
+      break;
+
+    case FLOW_TIMER_PERSIST:
+      ret = flow_persist_timeout(ctx, flow_id, fs, nbh, ts);
+      break;
+  }
+
+unlock:
+  fs_unlock(fs);
+  return ret;
+}
+
 void fast_flows_packet_parse(struct dataplane_context *ctx,
     struct network_buf_handle **nbhs, void **fss, struct tcp_opts *tos,
     uint16_t n)
@@ -255,6 +1101,52 @@ void fast_flows_packet_parse(struct dataplane_context *ctx,
   }
 }
 
+/* Returns how many packets starting at nbhs[0] can be processed as one
+ * coalesced segment: back-to-back in-order data segments of the same flow
+ * without special flags. Checksums of coalesced segments are verified here,
+ * so a corrupted segment ends the run and is dropped on its own. */
+uint16_t fast_flows_packet_gro(struct dataplane_context *ctx,
+    struct network_buf_handle **nbhs, void **fss, uint16_t n)
+{
+  struct pkt_tcp *p;
+  uint32_t seq, total;
+  uint16_t i, len;
+  uint8_t ecn;
+  uint8_t *payload;
+
+  p = network_buf_bufoff(nbhs[0]);
+  len = tcp_payload(nbhs[0], &payload);
+  if ((TCPH_FLAGS(&p->tcp) & ~TCP_PSH) != TCP_ACK || len == 0)
+    return 1;
+
+  seq = f_beui32(p->tcp.seqno) + len;
+  ecn = IPH_ECN(&p->ip);
+  total = len;
+
+  for (i = 1; i < n && fss[i] == fss[0]; i++) {
+    p = network_buf_bufoff(nbhs[i]);
+    len = tcp_payload(nbhs[i], &payload);
+
+    if ((TCPH_FLAGS(&p->tcp) & ~TCP_PSH) != TCP_ACK || len == 0 ||
+        f_beui32(p->tcp.seqno) != seq || IPH_ECN(&p->ip) != ecn ||
+        total + len > UINT16_MAX)
+    {
+      break;
+    }
+
+    /* single segments are checked in fast_flows_packet() */
+    if (UNLIKELY(i == 1 && !tcp_rx_xsums_ok(nbhs[0])))
+      return 1;
+    if (UNLIKELY(!tcp_rx_xsums_ok(nbhs[i])))
+      break;
+
+    seq += len;
+    total += len;
+  }
+
+  return i;
+}
+
 void fast_flows_packet_pfbufs(struct dataplane_context *ctx,
     void **fss, uint16_t n)
 {
@@ -274,26 +1166,29 @@ void fast_flows_packet_pfbufs(struct dataplane_context *ctx,
   }
 }
 
-/* Received packet */
+/* Received packet, or `num` coalesced in-order segments (see
+ * fast_flows_packet_gro()). Header fields are taken from the last segment,
+ * which is also the buffer re-used for the ACK. */
 int fast_flows_packet(struct dataplane_context *ctx,
-    struct network_buf_handle *nbh, void *fsp, struct tcp_opts *opts,
-    uint32_t ts)
+    struct network_buf_handle **nbhs, uint16_t num, void *fsp,
+    struct tcp_opts *opts, uint32_t ts)
 {
+  struct network_buf_handle *nbh = nbhs[num - 1];
   struct pkt_tcp *p = network_buf_bufoff(nbh);
+  struct pkt_tcp *p_first = network_buf_bufoff(nbhs[0]);
   struct flextcp_pl_flowst *fs = fsp;
-  uint32_t payload_bytes, payload_off, seq, ack, old_avail, new_avail,
-           orig_payload;
-  uint8_t *payload;
+  uint32_t payload_bytes = 0, seq, ack, old_avail, new_avail, orig_payload;
   uint32_t rx_bump = 0, tx_bump = 0, rx_pos, rtt;
   int no_permanent_sp = 0;
-  uint16_t tcp_extra_hlen, trim_start, trim_end;
-  uint16_t flow_id = fs - fp_state->flowst;
-  int trigger_ack = 0, fin_bump = 0;
-
-  tcp_extra_hlen = (TCPH_HDRLEN(&p->tcp) - 5) * 4;
-  payload_off = sizeof(*p) + tcp_extra_hlen;
-  payload_bytes =
-      f_beui16(p->ip.len) - (sizeof(p->ip) + sizeof(p->tcp) + tcp_extra_hlen);
+  uint16_t i, trim_start, trim_end;
+  uint32_t flow_id = fs - fp_flowst;
+  int trigger_ack = 0, fin_bump = 0, ack_delay = 0, rx_hold;
+  uint8_t *payload;
+
+  opts = &opts[num - 1];
+  for (i = 0; i < num; i++) {
+    payload_bytes += tcp_payload(nbhs[i], &payload);
+  }
   orig_payload = payload_bytes;
 
 #if PL_DEBUG_ARX
@@ -304,6 +1199,29 @@ int fast_flows_packet(struct dataplane_context *ctx,
       f_beui32(p->tcp.ackno), TCPH_FLAGS(&p->tcp), payload_bytes);
 #endif
 
+  /* packets steered here while the flow group is still being handed off are
+   * dropped, the sender will retransmit */
+  if (config.fp_flow_owner && flow_core(fs) != ctx->id) {
+    return 0;
+  }
+
+  /* app is not keeping up with notifications and parking space is running
+   * out: unless the flow's notifications merge into a parked entry, take
+   * neither payload nor acks freeing transmit buffer (a later cumulative ack
+   * covers them), only the peer's window and timestamps */
+  rx_hold = UNLIKELY(arx_ovf_full(ctx, fs->db_id)) &&
+      !arx_ovf_parked(ctx, fs->db_id, flow_id);
+
+  /* drop corrupted segments before touching any flow state, coalesced runs
+   * were already checked */
+  if (num == 1 && UNLIKELY(!tcp_rx_xsums_ok(nbh))) {
+    STATS_ADD(ctx, rx_xsum_drop, 1);
+    return 0;
+  }
+
+  if (ctx->fg_pkts != NULL)
+    ctx->fg_pkts[fs->flow_group] += num;
+
   fs_lock(fs);
 
 #ifdef FLEXNIC_TRACING
@@ -314,7 +1232,7 @@ int fast_flows_packet(struct dataplane_context *ctx,
       .remote_port = f_beui16(p->tcp.src),
 
       .flow_id = flow_id,
-      .flow_seq = f_beui32(p->tcp.seqno),
+      .flow_seq = f_beui32(p_first->tcp.seqno),
       .flow_ack = f_beui32(p->tcp.ackno),
       .flow_flags = TCPH_FLAGS(&p->tcp),
       .flow_len = payload_bytes,
@@ -362,25 +1280,25 @@ int fast_flows_packet(struct dataplane_context *ctx,
 
   /* calculate how much data is available to be sent before processing this
    * packet, to detect whether more data can be sent afterwards */
-  old_avail = tcp_txavail(fs, NULL);
+  old_avail = flow_txavail(flow_id, fs, NULL);
 
-  seq = f_beui32(p->tcp.seqno);
+  seq = f_beui32(p_first->tcp.seqno);
   ack = f_beui32(p->tcp.ackno);
   rx_pos = fs->rx_next_pos;
 
   /* trigger an ACK if there is payload (even if we discard it) */
 #ifndef SKIP_ACK
-  if (payload_bytes > 0)
+  if (payload_bytes > 0 && !rx_hold)
     trigger_ack = 1;
 #endif
 
   /* Stats for CC */
   if ((TCPH_FLAGS(&p->tcp) & TCP_ACK) == TCP_ACK) {
-    fs->cnt_rx_acks++;
+    fs->cnt_rx_acks += num;
   }
 
   /* if there is a valid ack, process it */
-  if (LIKELY((TCPH_FLAGS(&p->tcp) & TCP_ACK) == TCP_ACK &&
+  if (LIKELY((TCPH_FLAGS(&p->tcp) & TCP_ACK) == TCP_ACK && !rx_hold &&
       tcp_valid_rxack(fs, ack, &tx_bump) == 0))
   {
     fs->cnt_rx_ack_bytes += tx_bump;
@@ -405,27 +1323,48 @@ int fast_flows_packet(struct dataplane_context *ctx,
 #endif
     }
 
+    /* update transmit scoreboard from SACK blocks */
+    if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_SACK) == FLEXNIC_PL_FLOWST_SACK) {
+      flow_tx_sack_update(fs, ack, opts->sack);
+    }
+
     /* duplicate ack */
     if (UNLIKELY(tx_bump != 0)) {
       fs->rx_dupack_cnt = 0;
+    } else if (flow_racks != NULL) {
+      /* only counted as evidence for time-based loss detection */
+      if (orig_payload == 0 && fs->rx_dupack_cnt < UINT8_MAX)
+        fs->rx_dupack_cnt++;
     } else if (UNLIKELY(orig_payload == 0 && ++fs->rx_dupack_cnt >= 3)) {
       /* reset to last acknowledged position */
       flow_reset_retransmit(fs);
       goto unlock;
     }
+
+    if (config.cc_algorithm == CONFIG_CC_FP_DCTCP) {
+      flow_cc_ack(flow_id, fs, tx_bump,
+          (TCPH_FLAGS(&p->tcp) & TCP_ECE) == TCP_ECE);
+    }
+    if (config.fp_rto != 0)
+      flow_rto_ack(ctx, flow_id, fs, tx_bump, ts);
+    if (flow_racks != NULL) {
+      flow_rack_ack(ctx, flow_id, fs, tx_bump, f_beui32(opts->ts->ts_ecr),
+          ts);
+    }
   }
 
 #ifdef FLEXNIC_PL_OOO_RECV
   /* check if we should drop this segment */
   if (UNLIKELY(tcp_trim_rxbuf(fs, seq, payload_bytes, &trim_start, &trim_end) != 0)) {
-    /* packet is completely outside of unused receive buffer */
+    /* packet is completely outside of unused receive buffer, ack it if it
+     * has payload (e.g. a retransmit after our ack was lost), and answer
+     * window probes with the current window */
+    trigger_ack |= (payload_bytes == 0 && seq == fs->rx_next_seq - 1);
     goto unlock;
   }
 
   /* trim payload to what we can actually use */
   payload_bytes -= trim_start + trim_end;
-  payload_off += trim_start;
-  payload = (uint8_t *) p + payload_off;
   seq += trim_start;
 
   /* handle out of order segment */
@@ -437,28 +1376,11 @@ int fast_flows_packet(struct dataplane_context *ctx,
       goto unlock;
     }
 
-    /* otherwise check if we can add it to the out of order interval */
-    if (fs->rx_ooo_len == 0) {
-      fs->rx_ooo_start = seq;
-      fs->rx_ooo_len = payload_bytes;
-      flow_rx_seq_write(fs, seq, payload_bytes, payload);
-      /*fprintf(stderr, "created OOO interval (%p start=%u len=%u)\n",
-          fs, fs->rx_ooo_start, fs->rx_ooo_len);*/
-    } else if (seq + payload_bytes == fs->rx_ooo_start) {
-      /* TODO: those two overlap checks should be more sophisticated */
-      fs->rx_ooo_start = seq;
-      fs->rx_ooo_len += payload_bytes;
-      flow_rx_seq_write(fs, seq, payload_bytes, payload);
-      /*fprintf(stderr, "extended OOO interval (%p start=%u len=%u)\n",
-          fs, fs->rx_ooo_start, fs->rx_ooo_len);*/
-    } else if (fs->rx_ooo_start + fs->rx_ooo_len == seq) {
-      /* TODO: those two overlap checks should be more sophisticated */
-      fs->rx_ooo_len += payload_bytes;
-      flow_rx_seq_write(fs, seq, payload_bytes, payload);
-      /*fprintf(stderr, "extended OOO interval (%p start=%u len=%u)\n",
-          fs, fs->rx_ooo_start, fs->rx_ooo_len);*/
+    /* otherwise check if we can add it to the out of order intervals */
+    if (flow_rx_ooo_add(fs, seq, payload_bytes) == 0) {
+      flow_rx_seq_write(fs, seq, payload_bytes, nbhs, num, trim_start);
     } else {
-      /*fprintf(stderr, "Sad, no luck with OOO interval (%p ooo.start=%u "
+      /*fprintf(stderr, "Sad, no luck with OOO intervals (%p ooo.start=%u "
           "ooo.len=%u seq=%u bytes=%u)\n", fs, fs->rx_ooo_start,
           fs->rx_ooo_len, seq, payload_bytes);*/
     }
@@ -468,6 +1390,7 @@ int fast_flows_packet(struct dataplane_context *ctx,
 #else
   /* check if we should drop this segment */
   if (tcp_valid_rxseq(fs, seq, payload_bytes, &trim_start, &trim_end) != 0) {
+    trigger_ack |= (payload_bytes == 0 && seq == fs->rx_next_seq - 1);
 #if 0
     fprintf(stderr, "dma_krx_pkt_fastpath: packet with bad seq "
         "(got %u, expect %u, avail %u, payload %u)\n", seq, fs->rx_next_seq,
@@ -478,8 +1401,6 @@ int fast_flows_packet(struct dataplane_context *ctx,
 
   /* trim payload to what we can actually use */
   payload_bytes -= trim_start + trim_end;
-  payload_off += trim_start;
-  payload = (uint8_t *) p + payload_off;
 #endif
 
   /* update rtt estimate */
@@ -497,7 +1418,13 @@ int fast_flows_packet(struct dataplane_context *ctx,
     }
   }
 
-  fs->rx_remote_avail = f_beui16(p->tcp.wnd);
+  fs->rx_remote_avail = (uint32_t) f_beui16(p->tcp.wnd) << fs->tx_wscale;
+  flow_persist_arm(ctx, flow_id, fs, ts);
+
+  /* no room to notify the app, drop payload and FIN without acking them,
+   * the sender will retransmit */
+  if (UNLIKELY(rx_hold))
+    goto unlock;
 
   /* make sure we don't receive anymore payload after FIN */
   if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_RXFIN) == FLEXNIC_PL_FLOWST_RXFIN &&
@@ -509,7 +1436,8 @@ int fast_flows_packet(struct dataplane_context *ctx,
 
   /* if there is payload, dma it to the receive buffer */
   if (payload_bytes > 0) {
-    flow_rx_write(fs, fs->rx_next_pos, payload_bytes, payload);
+    flow_rx_write_segs(fs, fs->rx_next_pos, payload_bytes, nbhs, num,
+        trim_start);
 
     rx_bump = payload_bytes;
     fs->rx_avail -= payload_bytes;
@@ -522,42 +1450,15 @@ int fast_flows_packet(struct dataplane_context *ctx,
 #ifndef SKIP_ACK
     trigger_ack = 1;
 #endif
+    /* in-order data can be acked later, unless congestion was signalled */
+    ack_delay = flow_delacks != NULL && IPH_ECN(&p->ip) != IP_ECN_CE;
 
 #ifdef FLEXNIC_PL_OOO_RECV
     /* if we have out of order segments, check whether buffer is continuous
-     * or superfluous */
+     * or superfluous, ack immediately to let the sender know */
     if (UNLIKELY(fs->rx_ooo_len != 0)) {
-      if (tcp_trim_rxbuf(fs, fs->rx_ooo_start, fs->rx_ooo_len, &trim_start,
-            &trim_end) != 0) {
-          /*fprintf(stderr, "dropping ooo (%p ooo.start=%u ooo.len=%u seq=%u "
-              "len=%u next_seq=%u)\n", fs, fs->rx_ooo_start, fs->rx_ooo_len, seq,
-              payload_bytes, fs->rx_next_seq);*/
-        /* completely superfluous: drop out of order interval */
-        fs->rx_ooo_len = 0;
-      } else {
-        /* adjust based on overlap */
-        fs->rx_ooo_start += trim_start;
-        fs->rx_ooo_len -= trim_start + trim_end;
-        /*fprintf(stderr, "adjusting ooo (%p ooo.start=%u ooo.len=%u seq=%u "
-            "len=%u next_seq=%u)\n", fs, fs->rx_ooo_start, fs->rx_ooo_len, seq,
-            payload_bytes, fs->rx_next_seq);*/
-        if (fs->rx_ooo_len > 0 && fs->rx_ooo_start == fs->rx_next_seq) {
-          /* yay, we caught up, make continuous and drop OOO interval */
-          /*fprintf(stderr, "caught up with ooo buffer (%p start=%u len=%u)\n",
-              fs, fs->rx_ooo_start, fs->rx_ooo_len);*/
-
-          rx_bump += fs->rx_ooo_len;
-          fs->rx_avail -= fs->rx_ooo_len;
-          fs->rx_next_pos += fs->rx_ooo_len;
-          if (fs->rx_next_pos >= fs->rx_len) {
-            fs->rx_next_pos -= fs->rx_len;
-          }
-          assert(fs->rx_next_pos < fs->rx_len);
-          fs->rx_next_seq += fs->rx_ooo_len;
-
-          fs->rx_ooo_len = 0;
-        }
-      }
+      rx_bump += flow_rx_ooo_advance(fs);
+      ack_delay = 0;
     }
 #endif
   }
@@ -565,12 +1466,15 @@ int fast_flows_packet(struct dataplane_context *ctx,
   if ((TCPH_FLAGS(&p->tcp) & TCP_FIN) == TCP_FIN &&
       !(fs->rx_base_sp & FLEXNIC_PL_FLOWST_RXFIN))
   {
-    if (fs->rx_next_seq == f_beui32(p->tcp.seqno) + orig_payload && !fs->rx_ooo_len) {
+    if (fs->rx_next_seq == f_beui32(p_first->tcp.seqno) + orig_payload &&
+        !fs->rx_ooo_len)
+    {
       fin_bump = 1;
       fs->rx_base_sp |= FLEXNIC_PL_FLOWST_RXFIN;
       /* FIN takes up sequence number space */
       fs->rx_next_seq++;
       trigger_ack = 1;
+      ack_delay = 0;
     } else {
       fprintf(stderr, "fast_flows_packet: ignored fin because out of order\n");
     }
@@ -610,15 +1514,17 @@ unlock:
     trace_event(FLEXNIC_PL_TREV_ARX, sizeof(te_arx), &te_arx);
 #endif
 
-    arx_cache_add(ctx, fs->db_id, fs->opaque, rx_bump, rx_pos, tx_bump, type);
+    arx_cache_add(ctx, fs->db_id, flow_id, fs->opaque, rx_bump, rx_pos,
+        tx_bump, type);
   }
 
   /* Flow control: More receiver space? -> might need to start sending */
-  new_avail = tcp_txavail(fs, NULL);
+  new_avail = flow_txavail(flow_id, fs, NULL);
   if (new_avail > old_avail) {
     /* update qman queue */
+    flow_qman_app(ctx, flow_id, fs);
     if (qman_set(&ctx->qman, flow_id, fs->tx_rate, new_avail -
-          old_avail, TCP_MSS, QMAN_SET_RATE | QMAN_SET_MAXCHUNK
+          old_avail, TCP_MAX_CHUNK(fs), QMAN_SET_RATE | QMAN_SET_MAXCHUNK
           | QMAN_ADD_AVAIL) != 0)
     {
       fprintf(stderr, "fast_flows_packet: qman_set 1 failed, UNEXPECTED\n");
@@ -626,10 +1532,16 @@ unlock:
     }
   }
 
-  /* if we need to send an ack, also send packet to TX pipeline to do so */
-  if (trigger_ack) {
-    flow_tx_ack(ctx, fs->tx_next_seq, fs->rx_next_seq, fs->rx_avail,
-        fs->tx_next_ts, ts, nbh, opts->ts);
+  /* if we need to send an ack, also send packet to TX pipeline to do so,
+   * unless it can be delayed */
+  if (trigger_ack && ack_delay &&
+      flow_delack(ctx, flow_id, payload_bytes, ts) == 0)
+  {
+    trigger_ack = 0;
+  } else if (trigger_ack) {
+    flow_tx_ack(ctx, fs, fs->tx_next_seq, fs->rx_next_seq, fs->rx_avail,
+        fs->tx_next_ts, ts, nbh);
+    flow_delack_clear(flow_id);
   }
 
   fs_unlock(fs);
@@ -650,10 +1562,22 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
     uint16_t bump_seq, uint32_t rx_bump, uint32_t tx_bump, uint8_t flags,
     struct network_buf_handle *nbh, uint32_t ts)
 {
-  struct flextcp_pl_flowst *fs = &fp_state->flowst[flow_id];
-  uint32_t rx_avail_prev, old_avail, new_avail, tx_avail;
+  struct flextcp_pl_flowst *fs = &fp_flowst[flow_id];
+  struct flow_fwd *ff;
+  uint16_t core;
   int ret = -1;
 
+  /* flow owned by another core: accumulate bump and notify owner */
+  if (config.fp_flow_owner && (core = flow_core(fs)) != ctx->id) {
+    ff = &flow_fwds[flow_id];
+    __sync_fetch_and_add(&ff->rx_bump, rx_bump);
+    __sync_fetch_and_add(&ff->tx_bump, tx_bump);
+    __sync_fetch_and_or(&ff->flags, flags);
+    if (__sync_lock_test_and_set(&ff->bump_pending, 1) == 0)
+      flow_fwd_post(ctx, core, FWD_ENTRY(FWD_BUMP, flow_id), ts);
+    return -1;
+  }
+
   fs_lock(fs);
 #ifdef FLEXNIC_TRACING
   struct flextcp_pl_trev_atx te_atx = {
@@ -696,6 +1620,22 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
   }
   fs->bump_seq = bump_seq;
 
+  ret = flow_bump_apply(ctx, fs, rx_bump, tx_bump, flags, nbh, ts);
+
+unlock:
+  fs_unlock(fs);
+  return ret;
+}
+
+/* Apply validated bump to flow, returns 0 if `nbh` was used for a window
+ * update. Forwarded bumps are merged, so they skip the bump_seq check. */
+static int flow_bump_apply(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, uint32_t rx_bump, uint32_t tx_bump,
+    uint8_t flags, struct network_buf_handle *nbh, uint32_t ts)
+{
+  uint32_t rx_avail_prev, old_avail, new_avail, tx_avail;
+  uint32_t flow_id = fs - fp_flowst;
+
   if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXFIN) == FLEXNIC_PL_FLOWST_TXFIN &&
       tx_bump != 0)
   {
@@ -708,7 +1648,7 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
   {
     /* Closing TX requires at least one byte (dummy) */
     fprintf(stderr, "fast_flows_bump: tx eos without dummy byte\n");
-    goto unlock;
+    return -1;
   }
 
   tx_avail = fs->tx_avail + tx_bump;
@@ -718,16 +1658,16 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
       tx_avail + fs->tx_sent > fs->tx_len)
   {
     fprintf(stderr, "fast_flows_bump: tx bump too large\n");
-    goto unlock;
+    return -1;
   }
   /* validate rx bump */
   if (rx_bump > fs->rx_len || rx_bump + fs->rx_avail > fs->tx_len) {
     fprintf(stderr, "fast_flows_bump: rx bump too large\n");
-    goto unlock;
+    return -1;
   }
   /* calculate how many bytes can be sent before and after this bump */
-  old_avail = tcp_txavail(fs, NULL);
-  new_avail = tcp_txavail(fs, &tx_avail);
+  old_avail = flow_txavail(flow_id, fs, NULL);
+  new_avail = flow_txavail(flow_id, fs, &tx_avail);
 
   /* mark connection as closed if requested */
   if ((flags & FLEXTCP_PL_ATX_FLTXDONE) == FLEXTCP_PL_ATX_FLTXDONE &&
@@ -738,8 +1678,9 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
 
   /* update queue manager queue */
   if (old_avail < new_avail) {
+    flow_qman_app(ctx, flow_id, fs);
     if (qman_set(&ctx->qman, flow_id, fs->tx_rate, new_avail -
-          old_avail, TCP_MSS, QMAN_SET_RATE | QMAN_SET_MAXCHUNK
+          old_avail, TCP_MAX_CHUNK(fs), QMAN_SET_RATE | QMAN_SET_MAXCHUNK
           | QMAN_ADD_AVAIL) != 0)
     {
       fprintf(stderr, "flast_flows_bump: qman_set 1 failed, UNEXPECTED\n");
@@ -751,28 +1692,47 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
   fs->tx_avail = tx_avail;
   rx_avail_prev = fs->rx_avail;
   fs->rx_avail += rx_bump;
+  flow_persist_arm(ctx, flow_id, fs, ts);
 
-  /* receive buffer freed up from empty, need to send out a window update, if
-   * we're not sending anyways. */
-  if (new_avail == 0 && rx_avail_prev == 0 && fs->rx_avail != 0) {
+  /* advertised receive window opened up from zero, need to send out a window
+   * update, if we're not sending anyways. */
+  if (new_avail == 0 && (rx_avail_prev >> fs->rx_wscale) == 0 &&
+      (fs->rx_avail >> fs->rx_wscale) != 0)
+  {
     flow_tx_segment(ctx, nbh, fs, fs->tx_next_seq, fs->rx_next_seq,
         fs->rx_avail, 0, 0, fs->tx_next_ts, ts, 0);
-    ret = 0;
+    flow_delack_clear(flow_id);
+    return 0;
+  }
+
+  return -1;
+}
+
+/* start retransmitting */
+void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id,
+    uint32_t ts)
+{
+  struct flextcp_pl_flowst *fs = &fp_flowst[flow_id];
+  uint16_t core;
+
+  /* flow owned by another core: let the owner retransmit */
+  if (config.fp_flow_owner && (core = flow_core(fs)) != ctx->id) {
+    if (__sync_lock_test_and_set(&flow_fwds[flow_id].rexmit_pending, 1) == 0)
+      flow_fwd_post(ctx, core, FWD_ENTRY(FWD_REXMIT, flow_id), ts);
+    return;
   }
 
-unlock:
+  fs_lock(fs);
+  flow_retransmit(ctx, fs);
   fs_unlock(fs);
-  return ret;
 }
 
-/* start retransmitting */
-void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id)
+static void flow_retransmit(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs)
 {
-  struct flextcp_pl_flowst *fs = &fp_state->flowst[flow_id];
+  uint32_t flow_id = fs - fp_flowst;
   uint32_t old_avail, new_avail = -1;
 
-  fs_lock(fs);
-
 #ifdef FLEXNIC_TRACING
     struct flextcp_pl_trev_rexmit te_rexmit = {
         .flow_id = flow_id,
@@ -790,7 +1750,7 @@ void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id)
       uint32_t old_sent = fs->tx_sent;
       uint32_t old_pos = fs->tx_next_pos;*/
 
-  old_avail = tcp_txavail(fs, NULL);
+  old_avail = flow_txavail(flow_id, fs, NULL);
 
   if (fs->tx_sent == 0) {
     /*fprintf(stderr, "fast_flows_retransmit: tx sent == 0\n");
@@ -803,9 +1763,14 @@ void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id)
     goto out;
   }
 
+  /* receiver may have discarded selectively acknowledged data, so
+   * retransmit everything after a timeout */
+  fp_flowsack[flow_id].len[0] = 0;
 
   flow_reset_retransmit(fs);
-  new_avail = tcp_txavail(fs, NULL);
+  if (config.cc_algorithm == CONFIG_CC_FP_DCTCP)
+    flow_cc_timeout(flow_id, fs);
+  new_avail = flow_txavail(flow_id, fs, NULL);
 
   /*    fprintf(stderr, "fast_flows_retransmit: "
           "old_avail=%u new_avail=%u head=%u tx_next_seq=%u old_head=%u "
@@ -815,8 +1780,10 @@ void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id)
 
   /* update queue manager */
   if (new_avail > old_avail) {
+    flow_qman_app(ctx, flow_id, fs);
     if (qman_set(&ctx->qman, flow_id, fs->tx_rate, new_avail - old_avail,
-          TCP_MSS, QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_ADD_AVAIL) != 0)
+          TCP_MAX_CHUNK(fs), QMAN_SET_RATE | QMAN_SET_MAXCHUNK |
+          QMAN_ADD_AVAIL) != 0)
     {
       fprintf(stderr, "flast_flows_bump: qman_set 1 failed, UNEXPECTED\n");
       abort();
@@ -824,7 +1791,6 @@ void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id)
   }
 
 out:
-  fs_unlock(fs);
   return;
 }
 
@@ -843,14 +1809,131 @@ static void flow_tx_read(struct flextcp_pl_flowst *fs, uint32_t pos,
   }
 }
 
+/* like flow_tx_read(), but also returns the checksum partial sum of the data,
+ * computed while copying */
+static uint64_t flow_tx_read_xsum(struct flextcp_pl_flowst *fs, uint32_t pos,
+    uint16_t len, void *dst)
+{
+  uint32_t part;
+  uint64_t sum;
+
+  if (LIKELY(pos + len <= fs->tx_len)) {
+    return dma_read_xsum(fs->tx_base + pos, len, dst, 0);
+  }
+
+  part = fs->tx_len - pos;
+  sum = dma_read_xsum(fs->tx_base + pos, part, dst, 0);
+  if ((part & 1) == 0) {
+    return dma_read_xsum(fs->tx_base, len - part, (uint8_t *) dst + part, sum);
+  } else {
+    return sum + xsum_swap(dma_read_xsum(fs->tx_base, len - part,
+          (uint8_t *) dst + part, 0));
+  }
+}
+
+/* read `len` bytes from position `pos` into buffers chained after `nbh` */
+static void flow_tx_read_chain(struct flextcp_pl_flowst *fs, uint32_t pos,
+    uint32_t len, struct network_buf_handle *nbh)
+{
+  uint16_t seg_len;
+
+  if (pos >= fs->tx_len)
+    pos -= fs->tx_len;
+
+  while (len > 0 && (nbh = network_buf_next(nbh)) != NULL) {
+    seg_len = MIN(len, network_buf_size(nbh));
+    flow_tx_read(fs, pos, seg_len, network_buf_buf(nbh));
+    network_buf_setoff(nbh, 0);
+    network_buf_setlen(nbh, seg_len);
+
+    pos += seg_len;
+    if (pos >= fs->tx_len)
+      pos -= fs->tx_len;
+    len -= seg_len;
+  }
+}
+
+/* chain enough buffers to `nbh` for a `len` byte segment, returns how many
+ * payload bytes fit */
+static uint32_t flow_tx_chain(struct dataplane_context *ctx,
+    struct network_buf_handle *nbh, uint32_t len)
+{
+  uint32_t first, size;
+  unsigned num;
+
+  size = network_buf_size(nbh);
+  first = size - TCP_SEG_HDRLEN;
+  if (len <= first)
+    return len;
+
+  num = (len - first + size - 1) / size;
+  num = network_buf_chain(&ctx->net, nbh, num);
+  return MIN(len, first + num * size);
+}
+
+/* chain buffers to `nbh` for attaching a `len` byte segment (excluding a FIN
+ * dummy byte) from the transmit buffer, one per contiguous part. Returns how
+ * many bytes can be sent. */
+static uint32_t flow_tx_chain_ext(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, struct network_buf_handle *nbh,
+    uint32_t len)
+{
+  uint32_t payload = len, first;
+  unsigned num;
+
+  if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXFIN) == FLEXNIC_PL_FLOWST_TXFIN &&
+      len == fs->tx_avail)
+  {
+    payload--;
+  }
+  if (payload == 0)
+    return len;
+
+  first = fs->tx_len - fs->tx_next_pos;
+  num = network_buf_chain(&ctx->net, nbh, (payload > first ? 2 : 1));
+  if (num == 0)
+    return 0;
+
+  /* without a buffer for the wrapped around part, stop at the end */
+  return (payload > first && num < 2 ? first : len);
+}
+
+/* attach `len` bytes from position `pos` in circular transmit buffer to the
+ * buffers chained to `nbh` */
+static void flow_tx_attach(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, uint32_t pos, uint32_t len,
+    struct network_buf_handle *nbh)
+{
+  uint32_t part;
+
+  while (len > 0 && (nbh = network_buf_next(nbh)) != NULL) {
+    part = MIN(len, fs->tx_len - pos);
+    network_buf_extattach(&ctx->net, nbh,
+        dma_pointer(fs->tx_base + pos, part), part);
+
+    pos += part;
+    if (pos >= fs->tx_len)
+      pos -= fs->tx_len;
+    len -= part;
+  }
+}
+
 /* write `len` bytes to position `pos` in cirucular receive buffer */
 static void flow_rx_write(struct flextcp_pl_flowst *fs, uint32_t pos,
-    uint16_t len, const void *src)
+    uint16_t len, const void *src, int nt)
 {
   uint32_t part;
   uint64_t rx_base = fs->rx_base_sp & FLEXNIC_PL_FLOWST_RX_MASK;
 
-  if (LIKELY(pos + len <= fs->rx_len)) {
+  if (nt) {
+    if (LIKELY(pos + len <= fs->rx_len)) {
+      dma_write_nt(rx_base + pos, len, src);
+    } else {
+      part = fs->rx_len - pos;
+      dma_write_nt(rx_base + pos, part, src);
+      dma_write_nt(rx_base, len - part, (const uint8_t *) src + part);
+    }
+  } else if (LIKELY(pos + len <= fs->rx_len)) {
     dma_write(rx_base + pos, len, src);
   } else {
     part = fs->rx_len - pos;
@@ -859,47 +1942,237 @@ static void flow_rx_write(struct flextcp_pl_flowst *fs, uint32_t pos,
   }
 }
 
+/* write `len` bytes of payload from received segments, skipping the first
+ * `skip` bytes, to position `pos` in circular receive buffer */
+static void flow_rx_write_segs(struct flextcp_pl_flowst *fs, uint32_t pos,
+    uint16_t len, struct network_buf_handle **nbhs, uint16_t num,
+    uint16_t skip)
+{
+  uint16_t i, seg_len;
+  uint8_t *payload;
+  int nt = config.fp_rx_ntstore && len >= TCP_RX_NTSTORE_MIN;
+
+  for (i = 0; i < num && len > 0; i++) {
+    seg_len = tcp_payload(nbhs[i], &payload);
+    if (skip >= seg_len) {
+      skip -= seg_len;
+      continue;
+    }
+
+    payload += skip;
+    seg_len = MIN(seg_len - skip, len);
+    skip = 0;
+
+    flow_rx_write(fs, pos, seg_len, payload, nt);
+    pos += seg_len;
+    if (pos >= fs->rx_len)
+      pos -= fs->rx_len;
+    len -= seg_len;
+  }
+
+  /* payload has to be visible before the application is notified */
+  if (nt)
+    dma_write_nt_fence();
+}
+
 #ifdef FLEXNIC_PL_OOO_RECV
 static void flow_rx_seq_write(struct flextcp_pl_flowst *fs, uint32_t seq,
-    uint16_t len, const void *src)
+    uint16_t len, struct network_buf_handle **nbhs, uint16_t num,
+    uint16_t skip)
 {
   uint32_t diff = seq - fs->rx_next_seq;
   uint32_t pos = fs->rx_next_pos + diff;
   if (pos >= fs->rx_len)
     pos -= fs->rx_len;
   assert(pos < fs->rx_len);
-  flow_rx_write(fs, pos, len, src);
+  flow_rx_write_segs(fs, pos, len, nbhs, num, skip);
+}
+
+/* add interval of out of order data to the flow's out of order intervals,
+ * merging it with overlapping or adjacent ones. Returns -1 if the interval
+ * does not fit because all slots hold data closer to rx_next_seq. */
+static int flow_rx_ooo_add(struct flextcp_pl_flowst *fs, uint32_t seq,
+    uint32_t len)
+{
+  struct flextcp_pl_flowooo *fo = &fp_flowooo[fs - fp_flowst];
+  uint32_t starts[FLEXNIC_PL_OOO_INTERVALS];
+  uint32_t lens[FLEXNIC_PL_OOO_INTERVALS];
+
+  starts[0] = fs->rx_ooo_start;
+  lens[0] = fs->rx_ooo_len;
+  memcpy(starts + 1, fo->start, sizeof(fo->start));
+  memcpy(lens + 1, fo->len, sizeof(fo->len));
+
+  if (seq_ivs_add(starts, lens, FLEXNIC_PL_OOO_INTERVALS, fs->rx_next_seq,
+        seq, len) != 0)
+  {
+    return -1;
+  }
+
+  fs->rx_ooo_start = starts[0];
+  fs->rx_ooo_len = lens[0];
+  memcpy(fo->start, starts + 1, sizeof(fo->start));
+  memcpy(fo->len, lens + 1, sizeof(fo->len));
+  return 0;
+}
+
+/* after in-order data was received, drop out of order intervals covered by
+ * it and append those that became contiguous. Returns number of bytes
+ * appended to the receive buffer. */
+static uint32_t flow_rx_ooo_advance(struct flextcp_pl_flowst *fs)
+{
+  struct flextcp_pl_flowooo *fo = &fp_flowooo[fs - fp_flowst];
+  uint32_t diff, bump = 0;
+  unsigned i;
+
+  while (fs->rx_ooo_len != 0) {
+    diff = fs->rx_next_seq - fs->rx_ooo_start;
+    if ((int32_t) diff < 0) {
+      /* still a hole before the first interval */
+      break;
+    }
+
+    /* trim part already received in order */
+    if (diff < fs->rx_ooo_len) {
+      fs->rx_ooo_len -= diff;
+
+      bump += fs->rx_ooo_len;
+      fs->rx_avail -= fs->rx_ooo_len;
+      fs->rx_next_pos += fs->rx_ooo_len;
+      if (fs->rx_next_pos >= fs->rx_len) {
+        fs->rx_next_pos -= fs->rx_len;
+      }
+      assert(fs->rx_next_pos < fs->rx_len);
+      fs->rx_next_seq += fs->rx_ooo_len;
+    }
+
+    /* interval consumed, move up next one */
+    fs->rx_ooo_start = fo->start[0];
+    fs->rx_ooo_len = fo->len[0];
+    for (i = 1; i < FLEXNIC_PL_OOO_INTERVALS - 1; i++) {
+      fo->start[i - 1] = fo->start[i];
+      fo->len[i - 1] = fo->len[i];
+    }
+    fo->len[FLEXNIC_PL_OOO_INTERVALS - 2] = 0;
+  }
+
+  return bump;
+}
+
+/* write SACK option describing out of order intervals to `opt`, following
+ * the 10 byte timestamp option, so the options end 4 byte aligned without
+ * padding. Returns length written. */
+static uint16_t flow_rx_sack_opt(struct flextcp_pl_flowst *fs, uint8_t *opt)
+{
+  struct flextcp_pl_flowooo *fo = &fp_flowooo[fs - fp_flowst];
+  struct tcp_sack_opt *sack = (struct tcp_sack_opt *) opt;
+  unsigned i, n;
+
+  sack->blocks[0].start = t_beui32(fs->rx_ooo_start);
+  sack->blocks[0].end = t_beui32(fs->rx_ooo_start + fs->rx_ooo_len);
+  for (n = 1; n < TCP_SACK_MAX_BLOCKS && n < FLEXNIC_PL_OOO_INTERVALS &&
+      fo->len[n - 1] != 0; n++)
+  {
+    i = n - 1;
+    sack->blocks[n].start = t_beui32(fo->start[i]);
+    sack->blocks[n].end = t_beui32(fo->start[i] + fo->len[i]);
+  }
+
+  sack->kind = TCP_OPT_SACK;
+  sack->length = sizeof(*sack) + n * sizeof(sack->blocks[0]);
+  return sack->length;
 }
 #endif
 
+/* merge SACK blocks from received ACK into transmit scoreboard, and drop
+ * ranges now covered by the cumulative ACK */
+static void flow_tx_sack_update(struct flextcp_pl_flowst *fs, uint32_t ack,
+    struct tcp_sack_opt *sack)
+{
+  struct flextcp_pl_flowsack *sb = &fp_flowsack[fs - fp_flowst];
+  uint32_t start, end;
+  unsigned i, n;
+
+  if (LIKELY(sack == NULL && sb->len[0] == 0)) {
+    return;
+  }
+
+  seq_ivs_trim(sb->start, sb->len, FLEXNIC_PL_SACK_RANGES, ack);
+  if (sack == NULL) {
+    return;
+  }
+
+  n = (sack->length - sizeof(*sack)) / sizeof(sack->blocks[0]);
+  for (i = 0; i < n; i++) {
+    start = f_beui32(sack->blocks[i].start);
+    end = f_beui32(sack->blocks[i].end);
+
+    /* ignore blocks below the cumulative ack (D-SACK) or bogus ones */
+    if ((int32_t) (start - ack) <= 0 || (int32_t) (end - start) <= 0 ||
+        end - ack > fs->tx_len)
+    {
+      continue;
+    }
+
+    seq_ivs_add(sb->start, sb->len, FLEXNIC_PL_SACK_RANGES, ack, start,
+        end - start);
+  }
+}
+
+/* skip transmit data at tx_next_seq the receiver selectively acknowledged,
+ * accounting it as sent. Returns number of bytes that can be sent before the
+ * next acknowledged range. */
+static uint32_t flow_tx_sack_skip(struct flextcp_pl_flowst *fs)
+{
+  struct flextcp_pl_flowsack *sb = &fp_flowsack[fs - fp_flowst];
+  uint32_t diff, skip;
+  unsigned i;
+
+  for (i = 0; i < FLEXNIC_PL_SACK_RANGES && sb->len[i] != 0; i++) {
+    diff = fs->tx_next_seq - sb->start[i];
+    if ((int32_t) diff < 0) {
+      /* range starts further ahead */
+      return -diff;
+    } else if (diff >= sb->len[i]) {
+      /* range already passed */
+      continue;
+    }
+
+    skip = MIN(sb->len[i] - diff, fs->tx_avail);
+    fs->tx_next_seq += skip;
+    fs->tx_next_pos += skip;
+    if (fs->tx_next_pos >= fs->tx_len) {
+      fs->tx_next_pos -= fs->tx_len;
+    }
+    fs->tx_sent += skip;
+    fs->tx_avail -= skip;
+
+    if (skip < sb->len[i] - diff) {
+      /* ran out of data to send */
+      return 0;
+    }
+  }
+
+  return UINT32_MAX;
+}
+
 static void flow_tx_segment(struct dataplane_context *ctx,
     struct network_buf_handle *nbh, struct flextcp_pl_flowst *fs,
-    uint32_t seq, uint32_t ack, uint32_t rxwnd, uint16_t payload,
+    uint32_t seq, uint32_t ack, uint32_t rxwnd, uint32_t payload,
     uint32_t payload_pos, uint32_t ts_echo, uint32_t ts_my, uint8_t fin)
 {
-  uint16_t hdrs_len, optlen, fin_fl;
+  uint16_t hdrs_len, optlen, fin_fl, first = 0;
   struct pkt_tcp *p = network_buf_buf(nbh);
   struct tcp_timestamp_opt *opt_ts;
+  uint64_t payload_sum = 0;
 
   /* calculate header length depending on options */
   optlen = (sizeof(*opt_ts) + 3) & ~3;
   hdrs_len = sizeof(*p) + optlen;
 
-  /* fill headers */
-  p->eth.dest = fs->remote_mac;
-  memcpy(&p->eth.src, &eth_addr, ETH_ADDR_LEN);
-  p->eth.type = t_beui16(ETH_TYPE_IP);
-
-  IPH_VHL_SET(&p->ip, 4, 5);
-  p->ip._tos = 0;
+  /* copy headers from flow template, and fill in per-segment fields */
+  flow_hdr_copy(p, fs - fp_flowst);
   p->ip.len = t_beui16(hdrs_len - offsetof(struct pkt_tcp, ip) + payload);
-  p->ip.id = t_beui16(3); /* TODO: not sure why we have 3 here */
-  p->ip.offset = t_beui16(0);
-  p->ip.ttl = 0xff;
-  p->ip.proto = IP_PROTO_TCP;
-  p->ip.chksum = 0;
-  p->ip.src = fs->local_ip;
-  p->ip.dest = fs->remote_ip;
 
   /* mark as ECN capable if flow marked so */
   if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_ECN) == FLEXNIC_PL_FLOWST_ECN) {
@@ -908,31 +2181,34 @@ static void flow_tx_segment(struct dataplane_context *ctx,
 
   fin_fl = (fin ? TCP_FIN : 0);
 
-  p->tcp.src = fs->local_port;
-  p->tcp.dest = fs->remote_port;
   p->tcp.seqno = t_beui32(seq);
   p->tcp.ackno = t_beui32(ack);
   TCPH_HDRLEN_FLAGS_SET(&p->tcp, 5 + optlen / 4, TCP_PSH | TCP_ACK | fin_fl);
-  p->tcp.wnd = t_beui16(MIN(0xFFFF, rxwnd));
-  p->tcp.chksum = 0;
-  p->tcp.urgp = t_beui16(0);
+  p->tcp.wnd = t_beui16(MIN(0xFFFF, rxwnd >> fs->rx_wscale));
 
-  /* fill in timestamp option */
-  memset(p + 1, 0, optlen);
   opt_ts = (struct tcp_timestamp_opt *) (p + 1);
-  opt_ts->kind = TCP_OPT_TIMESTAMP;
-  opt_ts->length = sizeof(*opt_ts);
   opt_ts->ts_val = t_beui32(ts_my);
   opt_ts->ts_ecr = t_beui32(ts_echo);
 
-  /* add payload if requested */
-  if (payload > 0) {
-    flow_tx_read(fs, payload_pos, payload, (uint8_t *) p + hdrs_len);
+  /* add payload if requested, super-segments spill into chained buffers */
+  if (payload > 0 && config.fp_tx_zerocopy) {
+    flow_tx_attach(ctx, fs, payload_pos, payload, nbh);
+  } else if (payload > 0 && !config.fp_xsumoffload) {
+    /* software checksums: sum payload while copying it (no TSO without
+     * checksum offload, so the payload always fits) */
+    payload_sum = flow_tx_read_xsum(fs, payload_pos, payload,
+        (uint8_t *) p + hdrs_len);
+  } else if (payload > 0) {
+    first = MIN(payload, network_buf_size(nbh) - hdrs_len);
+    flow_tx_read(fs, payload_pos, first, (uint8_t *) p + hdrs_len);
+    if (first < payload) {
+      flow_tx_read_chain(fs, payload_pos + first, payload - first, nbh);
+    }
   }
 
   /* checksums */
-  tcp_checksums(nbh, p, fs->local_ip, fs->remote_ip, hdrs_len - offsetof(struct
-        pkt_tcp, tcp) + payload);
+  flow_hdr_xsums(nbh, p, fs - fp_flowst, hdrs_len -
+      offsetof(struct pkt_tcp, tcp), payload, payload_sum);
 
 #ifdef FLEXNIC_TRACING
   struct flextcp_pl_trev_txseg te_txseg = {
@@ -949,18 +2225,19 @@ static void flow_tx_segment(struct dataplane_context *ctx,
   trace_event(FLEXNIC_PL_TREV_TXSEG, sizeof(te_txseg), &te_txseg);
 #endif
 
-  tx_send(ctx, nbh, 0, hdrs_len + payload);
+  tx_send(ctx, nbh, 0, hdrs_len + first);
+  if (first < payload) {
+    network_buf_setpktlen(nbh, hdrs_len + payload);
+  }
 }
 
-static void flow_tx_ack(struct dataplane_context *ctx, uint32_t seq,
-    uint32_t ack, uint32_t rxwnd, uint32_t echots, uint32_t myts,
-    struct network_buf_handle *nbh, struct tcp_timestamp_opt *ts_opt)
+static void flow_tx_ack(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, uint32_t seq, uint32_t ack, uint32_t rxwnd,
+    uint32_t echots, uint32_t myts, struct network_buf_handle *nbh)
 {
   struct pkt_tcp *p;
-  struct eth_addr eth;
-  ip_addr_t ip;
-  beui16_t port;
-  uint16_t hdrlen;
+  struct tcp_timestamp_opt *ts_opt;
+  uint16_t hdrlen, optlen;
   uint16_t ecn_flags = 0;
 
   p = network_buf_bufoff(nbh);
@@ -971,44 +2248,39 @@ static void flow_tx_ack(struct dataplane_context *ctx, uint32_t seq,
       f_beui32(p->ip.src), f_beui16(p->tcp.src), seq, ack);
 #endif
 
-  /* swap addresses */
-  eth = p->eth.src;
-  p->eth.src = p->eth.dest;
-  p->eth.dest = eth;
-  ip = p->ip.src;
-  p->ip.src = p->ip.dest;
-  p->ip.dest = ip;
-  port = p->tcp.src;
-  p->tcp.src = p->tcp.dest;
-  p->tcp.dest = port;
-
-  hdrlen = sizeof(*p) + (TCPH_HDRLEN(&p->tcp) - 5) * 4;
-
   /* If ECN flagged, set TCP response flag */
   if (IPH_ECN(&p->ip) == IP_ECN_CE) {
     ecn_flags = TCP_ECE;
   }
 
-  /* mark ACKs as ECN in-capable */
-  IPH_ECN_SET(&p->ip, IP_ECN_NONE);
+  /* replace headers with the flow's template, ACKs are ECN in-capable. The
+   * options are the timestamp, followed by SACK blocks if there are out of
+   * order intervals */
+  flow_hdr_copy(p, fs - fp_flowst);
+  optlen = (sizeof(*ts_opt) + 3) & ~3;
+  ts_opt = (struct tcp_timestamp_opt *) (p + 1);
+  ts_opt->ts_val = t_beui32(myts);
+  ts_opt->ts_ecr = t_beui32(echots);
+#ifdef FLEXNIC_PL_OOO_RECV
+  if (UNLIKELY(fs->rx_ooo_len != 0 &&
+        (fs->rx_base_sp & FLEXNIC_PL_FLOWST_SACK) == FLEXNIC_PL_FLOWST_SACK))
+  {
+    optlen = sizeof(*ts_opt) + flow_rx_sack_opt(fs, (uint8_t *) (ts_opt + 1));
+  }
+#endif
+  hdrlen = sizeof(*p) + optlen;
 
   /* change TCP header to ACK */
   p->tcp.seqno = t_beui32(seq);
   p->tcp.ackno = t_beui32(ack);
-  TCPH_HDRLEN_FLAGS_SET(&p->tcp, TCPH_HDRLEN(&p->tcp), TCP_ACK | ecn_flags);
-  p->tcp.wnd = t_beui16(MIN(0xFFFF, rxwnd));
-  p->tcp.urgp = t_beui16(0);
-
-  /* fill in timestamp option */
-  ts_opt->ts_val = t_beui32(myts);
-  ts_opt->ts_ecr = t_beui32(echots);
+  TCPH_HDRLEN_FLAGS_SET(&p->tcp, 5 + optlen / 4, TCP_ACK | ecn_flags);
+  p->tcp.wnd = t_beui16(MIN(0xFFFF, rxwnd >> fs->rx_wscale));
 
   p->ip.len = t_beui16(hdrlen - offsetof(struct pkt_tcp, ip));
-  p->ip.ttl = 0xff;
 
   /* checksums */
-  tcp_checksums(nbh, p, p->ip.src, p->ip.dest, hdrlen - offsetof(struct
-        pkt_tcp, tcp));
+  flow_hdr_xsums(nbh, p, fs - fp_flowst, hdrlen - offsetof(struct pkt_tcp,
+        tcp), 0, 0);
 
 #ifdef FLEXNIC_TRACING
   struct flextcp_pl_trev_txack te_txack = {
@@ -1031,6 +2303,9 @@ static void flow_reset_retransmit(struct flextcp_pl_flowst *fs)
 {
   uint32_t x;
 
+  /* before rewinding, so the window reduction covers everything sent */
+  flow_tx_loss(fs);
+
   /* reset flow state as if we never transmitted those segments */
   fs->rx_dupack_cnt = 0;
 
@@ -1044,6 +2319,19 @@ static void flow_reset_retransmit(struct flextcp_pl_flowst *fs)
   fs->tx_avail += fs->tx_sent;
   fs->rx_remote_avail += fs->tx_sent;
   fs->tx_sent = 0;
+}
+
+/* keep congestion window between one segment and the transmit buffer */
+static inline uint32_t flow_cc_clamp(const struct flextcp_pl_flowst *fs,
+    uint32_t cwnd)
+{
+  return MAX(MIN(cwnd, fs->tx_len), fs->tx_mss);
+}
+
+/* congestion response to a loss, counted for the slow path's control loop */
+static inline void flow_tx_loss(struct flextcp_pl_flowst *fs)
+{
+  struct flextcp_pl_flowcc *cc = &fp_flowcc[fs - fp_flowst];
 
   /* cut rate by half if first drop in control interval */
   if (fs->cnt_tx_drops == 0) {
@@ -1051,6 +2339,84 @@ static void flow_reset_retransmit(struct flextcp_pl_flowst *fs)
   }
 
   fs->cnt_tx_drops++;
+
+  /* halve congestion window, at most once per window of data */
+  if (config.cc_algorithm == CONFIG_CC_FP_DCTCP &&
+      (int32_t) (fs->tx_next_seq - fs->tx_sent - cc->cwr_seq) >= 0)
+  {
+    cc->cwnd = flow_cc_clamp(fs, cc->cwnd / 2);
+    cc->ssthresh = cc->cwnd;
+    cc->ca_bytes = 0;
+    cc->cwr_seq = fs->tx_next_seq;
+  }
+}
+
+/* bytes that can be sent: limited by data in the buffer, the receive window,
+ * and with fast path congestion control the congestion window */
+static inline uint32_t flow_txavail(uint32_t flow_id,
+    const struct flextcp_pl_flowst *fs, const uint32_t *pavail)
+{
+  uint32_t avail = tcp_txavail(fs, pavail), cwnd;
+
+  if (config.cc_algorithm != CONFIG_CC_FP_DCTCP)
+    return avail;
+
+  cwnd = fp_flowcc[flow_id].cwnd;
+  return (cwnd > fs->tx_sent ? MIN(avail, cwnd - fs->tx_sent) : 0);
+}
+
+/* per-ACK DCTCP window update for `tx_bump` newly acknowledged bytes, `ece`
+ * is set if the ACK echoes a congestion mark */
+static inline void flow_cc_ack(uint32_t flow_id,
+    struct flextcp_pl_flowst *fs, uint32_t tx_bump, int ece)
+{
+  struct flextcp_pl_flowcc *cc = &fp_flowcc[flow_id];
+  uint32_t una = fs->tx_next_seq - fs->tx_sent, cwnd = cc->cwnd;
+  uint64_t frac;
+
+  if (tx_bump == 0)
+    return;
+
+  /* once per window of data, fold fraction of marked bytes into alpha */
+  cc->win_ackb += tx_bump;
+  if (ece)
+    cc->win_ecnb += tx_bump;
+  if ((int32_t) (una - cc->win_end) >= 0) {
+    frac = ((uint64_t) cc->win_ecnb * UINT32_MAX) / cc->win_ackb;
+    cc->alpha = ((uint64_t) cc->alpha * (UINT32_MAX - config.cc_dctcp_weight)
+        + frac * config.cc_dctcp_weight) / UINT32_MAX;
+    cc->win_ackb = cc->win_ecnb = 0;
+    cc->win_end = fs->tx_next_seq;
+  }
+
+  if (ece) {
+    /* reduce by alpha / 2, at most once per window of data */
+    if ((int32_t) (una - cc->cwr_seq) < 0)
+      return;
+    cwnd = flow_cc_clamp(fs, ((uint64_t) cwnd * (UINT32_MAX - cc->alpha / 2))
+        / UINT32_MAX);
+    cc->ssthresh = cwnd;
+    cc->ca_bytes = 0;
+    cc->cwr_seq = fs->tx_next_seq;
+  } else if (cwnd < cc->ssthresh) {
+    /* slow start */
+    cwnd = flow_cc_clamp(fs, cwnd + tx_bump);
+  } else if ((cc->ca_bytes += tx_bump) >= cwnd) {
+    /* additive increase: one segment per window acknowledged */
+    cc->ca_bytes -= cwnd;
+    cwnd = flow_cc_clamp(fs, cwnd + fs->tx_mss);
+  }
+  cc->cwnd = cwnd;
+}
+
+/* retransmission timeout: restart from a single segment */
+static inline void flow_cc_timeout(uint32_t flow_id,
+    struct flextcp_pl_flowst *fs)
+{
+  struct flextcp_pl_flowcc *cc = &fp_flowcc[flow_id];
+
+  cc->cwnd = flow_cc_clamp(fs, 0);
+  cc->ca_bytes = 0;
 }
 
 static inline void tcp_checksums(struct network_buf_handle *nbh,
@@ -1060,10 +2426,193 @@ static inline void tcp_checksums(struct network_buf_handle *nbh,
   if (config.fp_xsumoffload) {
     p->tcp.chksum = tx_xsum_enable(nbh, &p->ip, ip_s, ip_d, l3_paylen);
   } else {
-    p->tcp.chksum = 0;
-    p->ip.chksum = rte_ipv4_cksum((void *) &p->ip);
-    p->tcp.chksum = rte_ipv4_udptcp_cksum((void *) &p->ip, (void *) &p->tcp);
+    tcp_checksums_sw(p, l3_paylen, l3_paylen, 0);
+  }
+}
+
+/* sum of the TCP pseudo header */
+static inline uint64_t tcp_phdr_xsum(struct pkt_tcp *p, uint16_t l3_paylen)
+{
+  return (uint64_t) p->ip.src.x + p->ip.dest.x + (IP_PROTO_TCP << 8) +
+    t_beui16(l3_paylen).x;
+}
+
+/* calculate ip and tcp checksums in software, the first `l4_hdrlen` bytes of
+ * the tcp segment are summed here, the rest is passed in as `payload_sum` */
+static inline void tcp_checksums_sw(struct pkt_tcp *p, uint16_t l3_paylen,
+    uint16_t l4_hdrlen, uint64_t payload_sum)
+{
+  uint16_t xsum;
+
+  p->ip.chksum = 0;
+  p->ip.chksum = ~xsum_fold(xsum_partial(&p->ip, sizeof(p->ip), 0));
+
+  p->tcp.chksum = 0;
+  xsum = ~xsum_fold(xsum_partial(&p->tcp, l4_hdrlen,
+        tcp_phdr_xsum(p, l3_paylen) + payload_sum));
+  p->tcp.chksum = (xsum == 0 ? 0xffff : xsum);
+}
+
+/* check ip and tcp checksums of a received segment, in software unless the
+ * NIC already did */
+static inline int tcp_rx_xsums_ok(struct network_buf_handle *nbh)
+{
+  struct pkt_tcp *p = network_buf_bufoff(nbh);
+  uint16_t l3_paylen;
+  int good;
+
+  good = network_buf_rxxsum(nbh);
+  if (LIKELY(good == (NETWORK_RXXSUM_IP | NETWORK_RXXSUM_L4)))
+    return 1;
+  else if (good < 0)
+    return 0;
+
+  if ((good & NETWORK_RXXSUM_IP) == 0 &&
+      xsum_fold(xsum_partial(&p->ip, sizeof(p->ip), 0)) != 0xffff)
+    return 0;
+
+  if ((good & NETWORK_RXXSUM_L4) == 0) {
+    if (f_beui16(p->ip.len) < sizeof(p->ip) + sizeof(p->tcp))
+      return 0;
+    l3_paylen = f_beui16(p->ip.len) - sizeof(p->ip);
+    return xsum_fold(xsum_partial(&p->tcp, l3_paylen,
+          tcp_phdr_xsum(p, l3_paylen))) == 0xffff;
+  }
+  return 1;
+}
+
+/* copy header template of flow to `p`, including the zero padding after the
+ * timestamp option */
+static inline void flow_hdr_copy(struct pkt_tcp *p, uint32_t flow_id)
+{
+  const uint8_t *t = fp_flowhdr[flow_id].hdr;
+
+#if defined(__AVX512F__)
+  _mm512_storeu_si512(p, _mm512_loadu_si512(t));
+#elif defined(__AVX__)
+  _mm256_storeu_si256((__m256i *) p, _mm256_loadu_si256((const __m256i *) t));
+  _mm256_storeu_si256((__m256i *) p + 1,
+      _mm256_loadu_si256((const __m256i *) t + 1));
+#else
+  memcpy(p, t, sizeof(fp_flowhdr[flow_id].hdr));
+#endif
+  memset((uint8_t *) p + sizeof(fp_flowhdr[flow_id].hdr), 0, 2);
+}
+
+/* checksums for headers copied from the flow's template: the template's
+ * partial sums are updated with the per-segment fields, and TCP options
+ * beyond the timestamp (SACK blocks) are added. The payload sum is passed in
+ * if checksums are not offloaded. */
+static inline void flow_hdr_xsums(struct network_buf_handle *nbh,
+    struct pkt_tcp *p, uint32_t flow_id, uint16_t l4_hdrlen, uint32_t payload,
+    uint64_t payload_sum)
+{
+  const struct pkt_tcp *t = (const struct pkt_tcp *) fp_flowhdr[flow_id].hdr;
+  struct tcp_timestamp_opt *opt = (struct tcp_timestamp_opt *) (p + 1);
+  uint16_t l3_paylen = l4_hdrlen + payload, xsum;
+  uint16_t mss = fp_flowst[flow_id].tx_mss;
+  uint64_t sum;
+
+  if (payload > mss) {
+    /* TSO: pseudo header sum without length */
+    p->ip.chksum = 0;
+    p->tcp.chksum = t->tcp.chksum;
+    tx_tso_offload(nbh, l4_hdrlen, mss);
+    return;
+  } else if (config.fp_xsumoffload) {
+    p->ip.chksum = 0;
+    p->tcp.chksum = xsum_fold((uint64_t) t->tcp.chksum +
+        t_beui16(l3_paylen).x);
+    tx_xsum_offload(nbh);
+    return;
+  }
+
+  sum = (uint64_t) t->ip.chksum + p->ip.len.x + ((uint16_t) p->ip._tos << 8);
+  p->ip.chksum = ~xsum_fold(sum);
+
+  sum = (uint64_t) t->tcp.chksum + t_beui16(l3_paylen).x + p->tcp.seqno.x +
+    p->tcp.ackno.x + p->tcp._hdrlen_rsvd_flags + p->tcp.wnd.x +
+    opt->ts_val.x + opt->ts_ecr.x + payload_sum;
+  sum = xsum_partial(opt + 1, l4_hdrlen - sizeof(p->tcp) - sizeof(*opt), sum);
+  xsum = ~xsum_fold(sum);
+  p->tcp.chksum = (xsum == 0 ? 0xffff : xsum);
+}
+
+/* payload length and start of received segment */
+static inline uint16_t tcp_payload(struct network_buf_handle *nbh,
+    uint8_t **payload)
+{
+  struct pkt_tcp *p = network_buf_bufoff(nbh);
+  uint16_t hlen = TCPH_HDRLEN(&p->tcp) * 4;
+
+  *payload = (uint8_t *) &p->tcp + hlen;
+  return f_beui16(p->ip.len) - sizeof(p->ip) - hlen;
+}
+
+/* insert interval [seq, seq + len) into sorted set of at most `max` disjoint
+ * intervals (terminated by a zero length), merging overlapping and adjacent
+ * intervals. Positions are compared relative to `base`. If the set is full
+ * the interval furthest from `base` is dropped, returns -1 if that would be
+ * the new one. */
+int seq_ivs_add(uint32_t *starts, uint32_t *lens, unsigned max,
+    uint32_t base, uint32_t seq, uint32_t len)
+{
+  uint32_t a = seq - base, b = a + len, s, e;
+  unsigned i, j, n, tail;
+
+  for (n = 0; n < max && lens[n] != 0; n++);
+
+  /* skip intervals completely before new one */
+  for (i = 0; i < n && starts[i] - base + lens[i] < a; i++);
+  if (i == max) {
+    return -1;
+  }
+
+  /* merge overlapping and adjacent intervals into new one */
+  for (j = i; j < n && starts[j] - base <= b; j++) {
+    s = starts[j] - base;
+    e = s + lens[j];
+    a = MIN(a, s);
+    b = MAX(b, e);
+  }
+
+  /* move following intervals into place */
+  tail = MIN(n - j, max - i - 1);
+  memmove(starts + i + 1, starts + j, tail * sizeof(*starts));
+  memmove(lens + i + 1, lens + j, tail * sizeof(*lens));
+  starts[i] = base + a;
+  lens[i] = b - a;
+  if (i + 1 + tail < max) {
+    lens[i + 1 + tail] = 0;
   }
+  return 0;
+}
+
+/* remove everything before `seq` from set of intervals */
+void seq_ivs_trim(uint32_t *starts, uint32_t *lens, unsigned max,
+    uint32_t seq)
+{
+  uint32_t diff;
+  unsigned i, n;
+
+  for (i = 0; i < max && lens[i] != 0; i++) {
+    diff = seq - starts[i];
+    if ((int32_t) diff <= 0) {
+      break;
+    } else if (diff < lens[i]) {
+      starts[i] += diff;
+      lens[i] -= diff;
+      break;
+    }
+  }
+  if (i == 0) {
+    return;
+  }
+
+  for (n = i; n < max && lens[n] != 0; n++);
+  memmove(starts, starts + i, (n - i) * sizeof(*starts));
+  memmove(lens, lens + i, (n - i) * sizeof(*lens));
+  lens[n - i] = 0;
 }
 
 void fast_flows_kernelxsums(struct network_buf_handle *nbh,
@@ -1079,18 +2628,76 @@ static inline uint32_t flow_hash(struct flow_key *k)
       crc32c_sse42_u64(k->local_ip.x | (((uint64_t) k->remote_ip.x) << 32), 0));
 }
 
+/* bit mask of slots in bucket with hash `h` */
+static inline uint32_t flowht_match(const struct flextcp_pl_flowhtb *htb,
+    uint32_t h)
+{
+#if defined(__AVX2__)
+  __m256i v = _mm256_loadu_si256((const __m256i *) htb->flow_hash);
+  v = _mm256_cmpeq_epi32(v, _mm256_set1_epi32(h));
+  return _mm256_movemask_ps(_mm256_castsi256_ps(v));
+#elif defined(__SSE2__)
+  __m128i k = _mm_set1_epi32(h);
+  __m128i v0 = _mm_loadu_si128((const __m128i *) htb->flow_hash);
+  __m128i v1 = _mm_loadu_si128((const __m128i *) htb->flow_hash + 1);
+  v0 = _mm_cmpeq_epi32(v0, k);
+  v1 = _mm_cmpeq_epi32(v1, k);
+  return _mm_movemask_ps(_mm_castsi128_ps(v0)) |
+    (_mm_movemask_ps(_mm_castsi128_ps(v1)) << 4);
+#else
+  uint32_t i, m = 0;
+  for (i = 0; i < FLEXNIC_PL_FLOWHT_BSZ; i++)
+    m |= (uint32_t) (htb->flow_hash[i] == h) << i;
+  return m;
+#endif
+}
+
+/* flow state for packet `p` with hash `h` in the lookup table, or NULL */
+static inline struct flextcp_pl_flowst *flowht_lookup(uint32_t h,
+    struct pkt_tcp *p)
+{
+  uint32_t b, j, m, s, ffid, nb = fp_state->flowht_num;
+  struct flextcp_pl_flowhtb *htb;
+  struct flextcp_pl_flowst *fs;
+
+  for (j = 0; j < 2; j++) {
+    b = (j == 0 ? FLEXNIC_PL_FLOWHT_B1(h, nb) : FLEXNIC_PL_FLOWHT_B2(h, nb));
+    htb = &fp_flowht[b];
+
+    for (m = flowht_match(htb, h); m != 0; m &= m - 1) {
+      s = __builtin_ctz(m);
+      MEM_BARRIER();
+      ffid = htb->flow_id[s];
+      if ((ffid & FLEXNIC_PL_FLOWHTE_VALID) == 0) {
+        continue;
+      }
+
+      MEM_BARRIER();
+      fs = &fp_flowst[ffid & FLEXNIC_PL_FLOWHTE_IDMASK];
+      if ((fs->local_ip.x == p->ip.dest.x) &
+          (fs->remote_ip.x == p->ip.src.x) &
+          (fs->local_port.x == p->tcp.dest.x) &
+          (fs->remote_port.x == p->tcp.src.x))
+      {
+        rte_prefetch0((uint8_t *) fs + 64);
+        return fs;
+      }
+    }
+  }
+  return NULL;
+}
+
 void fast_flows_packet_fss(struct dataplane_context *ctx,
     struct network_buf_handle **nbhs, void **fss, uint16_t n)
 {
   uint32_t hashes[n];
-  uint32_t h, k, j, eh, fid, ffid;
+  uint32_t h, b, j, m, s, ffid, seq, nb = fp_state->flowht_num;
   uint16_t i;
   struct pkt_tcp *p;
   struct flow_key key;
-  struct flextcp_pl_flowhte *e;
-  struct flextcp_pl_flowst *fs;
+  struct flextcp_pl_flowhtb *htb;
 
-  /* calculate hashes and prefetch hash table buckets */
+  /* calculate hashes and prefetch both candidate buckets */
   for (i = 0; i < n; i++) {
     p = network_buf_bufoff(nbhs[i]);
 
@@ -1100,62 +2707,42 @@ void fast_flows_packet_fss(struct dataplane_context *ctx,
     key.remote_port = p->tcp.src;
     h = flow_hash(&key);
 
-    rte_prefetch0(&fp_state->flowht[h % FLEXNIC_PL_FLOWHT_ENTRIES]);
-    rte_prefetch0(&fp_state->flowht[(h + 3) % FLEXNIC_PL_FLOWHT_ENTRIES]);
+    rte_prefetch0(&fp_flowht[FLEXNIC_PL_FLOWHT_B1(h, nb)]);
+    rte_prefetch0(&fp_flowht[FLEXNIC_PL_FLOWHT_B2(h, nb)]);
     hashes[i] = h;
   }
 
-  /* prefetch flow state for buckets with matching hashes
+  /* prefetch flow state for slots with matching hashes
    * (usually 1 per packet, except in case of collisions) */
   for (i = 0; i < n; i++) {
     h = hashes[i];
-    for (j = 0; j < FLEXNIC_PL_FLOWHT_NBSZ; j++) {
-      k = (h + j) % FLEXNIC_PL_FLOWHT_ENTRIES;
-      e = &fp_state->flowht[k];
-
-      ffid = e->flow_id;
-      MEM_BARRIER();
-      eh = e->flow_hash;
+    for (j = 0; j < 2; j++) {
+      b = (j == 0 ? FLEXNIC_PL_FLOWHT_B1(h, nb) : FLEXNIC_PL_FLOWHT_B2(h, nb));
+      htb = &fp_flowht[b];
+
+      for (m = flowht_match(htb, h); m != 0; m &= m - 1) {
+        s = __builtin_ctz(m);
+        MEM_BARRIER();
+        ffid = htb->flow_id[s];
+        if ((ffid & FLEXNIC_PL_FLOWHTE_VALID) == 0) {
+          continue;
+        }
 
-      fid = ffid & ((1 << FLEXNIC_PL_FLOWHTE_POSSHIFT) - 1);
-      if ((ffid & FLEXNIC_PL_FLOWHTE_VALID) == 0 || eh != h) {
-        continue;
+        rte_prefetch0(&fp_flowst[ffid & FLEXNIC_PL_FLOWHTE_IDMASK]);
       }
-
-      rte_prefetch0(&fp_state->flowst[fid]);
     }
   }
 
-  /* finish hash table lookup by checking 5-tuple in flow state */
+  /* finish hash table lookup by checking 5-tuple in flow state, a miss
+   * while the slow path was moving entries between buckets is retried */
   for (i = 0; i < n; i++) {
     p = network_buf_bufoff(nbhs[i]);
-    fss[i] = NULL;
-    h = hashes[i];
-
-    for (j = 0; j < FLEXNIC_PL_FLOWHT_NBSZ; j++) {
-      k = (h + j) % FLEXNIC_PL_FLOWHT_ENTRIES;
-      e = &fp_state->flowht[k];
-
-      ffid = e->flow_id;
+    do {
+      seq = fp_state->flowht_seq;
       MEM_BARRIER();
-      eh = e->flow_hash;
-
-      fid = ffid & ((1 << FLEXNIC_PL_FLOWHTE_POSSHIFT) - 1);
-      if ((ffid & FLEXNIC_PL_FLOWHTE_VALID) == 0 || eh != h) {
-        continue;
-      }
-
+      fss[i] = flowht_lookup(hashes[i], p);
       MEM_BARRIER();
-      fs = &fp_state->flowst[fid];
-      if ((fs->local_ip.x == p->ip.dest.x) &
-          (fs->remote_ip.x == p->ip.src.x) &
-          (fs->local_port.x == p->tcp.dest.x) &
-          (fs->remote_port.x == p->tcp.src.x))
-      {
-        rte_prefetch0((uint8_t *) fs + 64);
-        fss[i] = &fp_state->flowst[fid];
-        break;
-      }
-    }
+    } while (fss[i] == NULL &&
+        ((seq & 1) != 0 || seq != fp_state->flowht_seq));
   }
 }
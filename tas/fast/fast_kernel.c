@@ -82,12 +82,12 @@ int fast_kernel_poll(struct dataplane_context *ctx,
     tx_send(ctx, nbh, 0, len);
   } else if (ktx->type == FLEXTCP_PL_KTX_CONNRETRAN) {
     flow_id = ktx->msg.connretran.flow_id;
-    if (flow_id >= FLEXNIC_PL_FLOWST_NUM) {
+    if (flow_id >= fp_state->flowst_num) {
       fprintf(stderr, "fast_kernel_qman: invalid flow id=%u\n", flow_id);
       abort();
     }
 
-    fast_flows_retransmit(ctx, flow_id);
+    fast_flows_retransmit(ctx, flow_id, ts);
     ret = 1;
   } else {
     fprintf(stderr, "fast_appctx_poll: unknown type: %u\n", ktx->type);
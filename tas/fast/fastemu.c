@@ -43,7 +43,9 @@ static unsigned poll_queues(struct dataplane_context *ctx, uint32_t ts)  __attri
 static unsigned poll_kernel(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
 static unsigned poll_qman(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
 static unsigned poll_qman_fwd(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
-static void poll_scale(struct dataplane_context *ctx);
+static void poll_scale(struct dataplane_context *ctx, uint32_t ts);
+static void poll_rebalance(struct dataplane_context *ctx, uint32_t ts);
+static unsigned poll_timers(struct dataplane_context *ctx, uint32_t ts);
 
 static inline uint8_t bufcache_prealloc(struct dataplane_context *ctx, uint16_t num,
     struct network_buf_handle ***handles);
@@ -56,37 +58,100 @@ static inline void tx_send(struct dataplane_context *ctx,
     struct network_buf_handle *nbh, uint16_t off, uint16_t len);
 
 static void arx_cache_flush(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
+static void arx_ovf_park(struct dataplane_context *ctx, uint16_t i);
+static void arx_ovf_drain(struct dataplane_context *ctx, uint32_t ts);
+
+static inline void batch_init(struct dataplane_batch *b, uint16_t limit);
+static inline uint16_t batch_limit(struct dataplane_batch *b,
+    struct dataplane_context *ctx);
+static inline void batch_adapt(struct dataplane_batch *b, unsigned n);
 
 int dataplane_init(void)
 {
-  if (FLEXNIC_INTERNAL_MEM_SIZE < sizeof(struct flextcp_pl_mem)) {
-    fprintf(stderr, "dataplane_init: internal flexnic memory size not "
-        "sufficient (got %x, need %zx)\n", FLEXNIC_INTERNAL_MEM_SIZE,
-        sizeof(struct flextcp_pl_mem));
-    return -1;
-  }
-
   if (fp_cores_max > FLEXNIC_PL_APPST_CTX_MCS) {
     fprintf(stderr, "dataplane_init: more cores than FLEXNIC_PL_APPST_CTX_MCS "
         "(%u)\n", FLEXNIC_PL_APPST_CTX_MCS);
     return -1;
   }
-  if (FLEXNIC_PL_FLOWST_NUM > FLEXNIC_NUM_QMQUEUES) {
+  if (fp_state->flowst_num > FLEXNIC_NUM_QMQUEUES) {
     fprintf(stderr, "dataplane_init: more flow states than queue manager queues"
-        "(%u > %u)\n", FLEXNIC_PL_FLOWST_NUM, FLEXNIC_NUM_QMQUEUES);
+        "(%u > %u)\n", fp_state->flowst_num, FLEXNIC_NUM_QMQUEUES);
+    return -1;
+  }
+
+  if (config.fp_batch_max < BATCH_MIN || config.fp_batch_max > BATCH_SIZE) {
+    fprintf(stderr, "dataplane_init: fp batch max must be between %u and %u\n",
+        BATCH_MIN, BATCH_SIZE);
+    return -1;
+  }
+
+  if (fast_flows_init() != 0) {
+    fprintf(stderr, "dataplane_init: fast_flows_init failed\n");
     return -1;
   }
 
   return 0;
 }
 
+#define ARX_OVF_INVAL (-1U)
+
+/** Parked arx entry, coalesced per flow and app context */
+struct arx_overflow_entry {
+  struct flextcp_pl_arx arx;
+  uint32_t flow_id;
+  uint16_t ctx_id;
+  /** next in context list or free list */
+  uint32_t next;
+  /** next in hash bucket */
+  uint32_t hnext;
+};
+
+/** Per-core arx entries parked while app rx queues are full */
+struct arx_overflow {
+  struct arx_overflow_entry ents[ARX_OVF_NUM];
+  uint32_t ht[ARX_OVF_HT];
+  uint32_t head[FLEXNIC_PL_APPCTX_NUM];
+  uint32_t tail[FLEXNIC_PL_APPCTX_NUM];
+  uint32_t free;
+};
+
+STATIC_ASSERT(ARX_OVF_NUM > ARX_OVF_RESERVE, arx_ovf_reserve);
+/* flow timer ids and the list heads after them fit into 32 bits */
+STATIC_ASSERT((uint64_t) FLEXNIC_PL_FLOWST_MAX * FLOW_TIMER_NUM +
+    2 * TIMER_WHEEL_SLOTS + 1 <= UINT32_MAX, timer_wheel_ids);
+
+static int arx_ovf_init(struct dataplane_context *ctx)
+{
+  struct arx_overflow *o;
+  uint32_t i;
+
+  if ((o = calloc(1, sizeof(*o))) == NULL)
+    return -1;
+
+  for (i = 0; i < ARX_OVF_NUM; i++)
+    o->ents[i].next = i + 1;
+  o->ents[ARX_OVF_NUM - 1].next = ARX_OVF_INVAL;
+  o->free = 0;
+  for (i = 0; i < ARX_OVF_HT; i++)
+    o->ht[i] = ARX_OVF_INVAL;
+  for (i = 0; i < FLEXNIC_PL_APPCTX_NUM; i++)
+    o->head[i] = o->tail[i] = ARX_OVF_INVAL;
+
+  ctx->arx_ovf = o;
+  ctx->arx_ovf_ctxs = 0;
+  ctx->arx_ovf_avail = ARX_OVF_NUM;
+  return 0;
+}
+
 int dataplane_context_init(struct dataplane_context *ctx)
 {
   char name[32];
 
+  ctx->socket_id = rte_socket_id();
+
   /* initialize forwarding queue */
   sprintf(name, "qman_fwd_ring_%u", ctx->id);
-  if ((ctx->qman_fwd_ring = rte_ring_create(name, 32 * 1024, rte_socket_id(),
+  if ((ctx->qman_fwd_ring = rte_ring_create(name, 32 * 1024, ctx->socket_id,
           RING_F_SC_DEQ)) == NULL)
   {
     fprintf(stderr, "initializing rte_ring_create");
@@ -107,6 +172,35 @@ int dataplane_context_init(struct dataplane_context *ctx)
 
   ctx->poll_next_ctx = ctx->id;
 
+  /* initialize arx overflow */
+  if (arx_ovf_init(ctx) != 0) {
+    fprintf(stderr, "initializing arx overflow failed\n");
+    return -1;
+  }
+
+  /* flow timers, per core this takes 12 bytes per timer (links and
+   * deadline), i.e. 48 bytes per flow */
+  if ((config.fp_delack != 0 || config.fp_rack || config.fp_rto != 0) &&
+      timer_wheel_init(&ctx->timers, fp_state->flowst_num * FLOW_TIMER_NUM,
+        ctx->socket_id, qman_timestamp(rte_get_tsc_cycles())) != 0)
+  {
+    fprintf(stderr, "initializing timer wheel failed\n");
+    return -1;
+  }
+
+  /* per flow group load counters for rebalancing */
+  if (config.fp_rebalance != 0 && (ctx->fg_pkts =
+        calloc(FLEXNIC_PL_MAX_FLOWGROUPS, sizeof(*ctx->fg_pkts))) == NULL)
+  {
+    fprintf(stderr, "allocating flow group counters failed\n");
+    return -1;
+  }
+
+  batch_init(&ctx->batch_rx, 16);
+  batch_init(&ctx->batch_qm, 16);
+  batch_init(&ctx->batch_qs, 16);
+  batch_init(&ctx->batch_sp, 8);
+
   ctx->evfd = eventfd(0, 0);
   assert(ctx->evfd != -1);
   ctx->ev.epdata.event = EPOLLIN;
@@ -141,8 +235,15 @@ void dataplane_loop(struct dataplane_context *ctx)
 
     ts = qman_timestamp(cyc);
 
+    /* forwarding rings of other cores were full: retry, and hold back the
+     * stages that forward entries until the backlog was accepted */
+    if (UNLIKELY(ctx->fwd_retry_num != 0))
+      fast_flows_fwd_retry(ctx, ts);
+
     STATS_TS(start);
     n += poll_rx(ctx, ts);
+    if (ctx->timers.next != NULL && LIKELY(ctx->fwd_retry_num == 0))
+      n += poll_timers(ctx, ts);
     STATS_TS(rx);
     STATS_ATOMIC_ADD(ctx, cyc_rx, rx - start);
 
@@ -153,14 +254,17 @@ void dataplane_loop(struct dataplane_context *ctx)
     n += poll_qman_fwd(ctx, ts);
 
     STATS_TS(poll_qman_start);
-    n += poll_qman(ctx, ts);
+    if (LIKELY(ctx->fwd_retry_num == 0))
+      n += poll_qman(ctx, ts);
     STATS_TS(poll_qman_end);
     STATS_ATOMIC_ADD(ctx, cyc_qm, poll_qman_end - poll_qman_start);
 
-    n += poll_queues(ctx, ts);
+    if (LIKELY(ctx->fwd_retry_num == 0))
+      n += poll_queues(ctx, ts);
     STATS_TS(qs);
     STATS_ATOMIC_ADD(ctx, cyc_qs, qs - poll_qman_end);
-    n += poll_kernel(ctx, ts);
+    if (LIKELY(ctx->fwd_retry_num == 0))
+      n += poll_kernel(ctx, ts);
     STATS_TS(sp);
     STATS_ATOMIC_ADD(ctx, cyc_sp, sp - qs);
 
@@ -170,9 +274,9 @@ void dataplane_loop(struct dataplane_context *ctx)
     STATS_ATOMIC_ADD(ctx, cyc_tx, tx - sp);
 
     if (ctx->id == 0)
-      poll_scale(ctx);
+      poll_scale(ctx, ts);
 
-    if(UNLIKELY(n == 0)) {
+    if(UNLIKELY(n == 0 && ctx->fwd_retry_num == 0)) {
       was_idle = 1;
 
       if(startwait == 0) {
@@ -183,7 +287,8 @@ void dataplane_loop(struct dataplane_context *ctx)
 
         // Only if device running
         if(r == 0) {
-          uint32_t timeout_us = qman_next_ts(&ctx->qman, ts);
+          uint32_t timeout_us = MIN(qman_next_ts(&ctx->qman, ts),
+              timer_wheel_next_ts(&ctx->timers, ts));
           /* fprintf(stderr, "[%u] fastemu idle - timeout %d ms\n", ctx->core, */
           /* 	  timeout_us == (uint32_t)-1 ? -1 : timeout_us / 1000); */
           struct rte_epoll_event event[2];
@@ -255,6 +360,9 @@ void dataplane_dump_stats(void)
             STATS_ATOMIC_FETCH(ctx, cyc_qs),
             STATS_ATOMIC_FETCH(ctx, cyc_sp),
             STATS_ATOMIC_FETCH(ctx, cyc_tx));
+    TAS_LOG(INFO, MAIN, "numa_remote=%"PRIu64" rx_xsum_drop=%"PRIu64"\n",
+            STATS_ATOMIC_FETCH(ctx, numa_remote),
+            STATS_ATOMIC_FETCH(ctx, rx_xsum_drop));
 
 #ifdef QUEUE_STATS
     TAS_LOG(INFO, MAIN, "slow -> fast (%"PRIu64",%"PRIu64") avg_queuing_delay=%lF\n", 
@@ -274,26 +382,26 @@ void dataplane_dump_stats(void)
 static unsigned poll_rx(struct dataplane_context *ctx, uint32_t ts)
 {
   int ret;
-  unsigned i, n;
+  unsigned i, j, n, num;
   uint8_t freebuf[BATCH_SIZE] = { 0 };
   void *fss[BATCH_SIZE];
   struct tcp_opts tcpopts[BATCH_SIZE];
   struct network_buf_handle *bhs[BATCH_SIZE];
 
-  n = BATCH_SIZE;
-  if (TXBUF_SIZE - ctx->tx_num < n)
-    n = TXBUF_SIZE - ctx->tx_num;
+  n = batch_limit(&ctx->batch_rx, ctx);
 
   STATS_ADD(ctx, rx_poll, 1);
 
   /* receive packets */
   ret = network_poll(&ctx->net, n, bhs);
   if (ret <= 0) {
+    batch_adapt(&ctx->batch_rx, 0);
     STATS_ADD(ctx, rx_empty, 1);
     return 0;
   }
   STATS_ADD(ctx, rx_total, n);
   n = ret;
+  batch_adapt(&ctx->batch_rx, n);
 
   /* prefetch packet contents (1st cache line) */
   for (i = 0; i < n; i++) {
@@ -311,18 +419,25 @@ static unsigned poll_rx(struct dataplane_context *ctx, uint32_t ts)
   /* parse packets */
   fast_flows_packet_parse(ctx, bhs, fss, tcpopts, n);
 
-  for (i = 0; i < n; i++) {
-    /* run fast-path for flows with flow state */
+  for (i = 0; i < n; i += num) {
+    num = 1;
+
+    /* run fast-path for flows with flow state, coalescing consecutive
+     * in-order segments of the same flow */
     if (fss[i] != NULL) {
-      ret = fast_flows_packet(ctx, bhs[i], fss[i], &tcpopts[i], ts);
+      if (config.fp_gro)
+        num = fast_flows_packet_gro(ctx, bhs + i, fss + i, n - i);
+      ret = fast_flows_packet(ctx, bhs + i, num, fss[i], &tcpopts[i], ts);
     } else {
       ret = -1;
     }
 
     if (ret > 0) {
-      freebuf[i] = 1;
+      /* last buffer re-used for ACK */
+      freebuf[i + num - 1] = 1;
     } else if (ret < 0) {
-      fast_kernel_packet(ctx, bhs[i]);
+      for (j = i; j < i + num; j++)
+        fast_kernel_packet(ctx, bhs[j]);
     }
   }
 
@@ -337,41 +452,76 @@ static unsigned poll_rx(struct dataplane_context *ctx, uint32_t ts)
   return n;
 }
 
+/* handle expired flow timers, delayed acks with a zero timeout go out at the
+ * end of the rx batch */
+static unsigned poll_timers(struct dataplane_context *ctx, uint32_t ts)
+{
+  struct network_buf_handle **handles;
+  uint32_t ids[BATCH_SIZE];
+  uint16_t n, max, i, off = 0;
+
+  if (!timer_wheel_advance(&ctx->timers, ts))
+    return 0;
+
+  max = MIN(BATCH_SIZE, TXBUF_SIZE - ctx->tx_num);
+  max = bufcache_prealloc(ctx, max, &handles);
+  n = timer_wheel_expired(&ctx->timers, ids, max);
+  for (i = 0; i < n; i++) {
+    if (fast_flows_timer(ctx, ids[i], handles[off], ts) == 0)
+      off++;
+  }
+
+  bufcache_alloc(ctx, off);
+  return n;
+}
+
 static unsigned poll_queues(struct dataplane_context *ctx, uint32_t ts)
 {
   struct network_buf_handle **handles;
+  struct flexnic_doorbell *db = FLEXNIC_INFO_DB(tas_info, ctx->id);
   void *aqes[BATCH_SIZE];
   unsigned n, i, total = 0;
   uint16_t max, k = 0, num_bufs = 0, j;
+  uint64_t pending, mask;
   int ret;
 
   STATS_ADD(ctx, qs_poll, 1);
 
-  max = BATCH_SIZE;
-  if (TXBUF_SIZE - ctx->tx_num < max)
-    max = TXBUF_SIZE - ctx->tx_num;
+  /* only poll contexts that rang the doorbell, or were not drained before */
+  pending = ctx->poll_pending;
+  if (db->ctxs != 0)
+    pending |= __atomic_exchange_n(&db->ctxs, 0, __ATOMIC_SEQ_CST);
+
+  max = batch_limit(&ctx->batch_qs, ctx);
 
   /* allocate buffers contents */
   max = bufcache_prealloc(ctx, max, &handles);
 
-  for (n = 0; n < FLEXNIC_PL_APPCTX_NUM; n++) {
-    fast_appctx_poll_pf(ctx, (ctx->poll_next_ctx + n) % FLEXNIC_PL_APPCTX_NUM);
+  for (mask = pending; mask != 0; mask &= mask - 1) {
+    fast_appctx_poll_pf(ctx, __builtin_ctzll(mask));
   }
 
-  for (n = 0; n < FLEXNIC_PL_APPCTX_NUM && k < max; n++) {
-    for (i = 0; i < BATCH_SIZE && k < max; i++) {
-      ret = fast_appctx_poll_fetch(ctx, ctx->poll_next_ctx, &aqes[k]);
-      if (ret == 0)
-        k++;
-      else
-        break;
+  for (n = 0; n < FLEXNIC_PL_APPCTX_NUM && k < max && pending != 0; n++) {
+    if ((pending & (1ULL << ctx->poll_next_ctx)) != 0) {
+      for (i = 0; i < max && k < max; i++) {
+        ret = fast_appctx_poll_fetch(ctx, ctx->poll_next_ctx, &aqes[k]);
+        if (ret == 0) {
+          k++;
+          STATS_ADD(ctx, numa_remote, fp_state->appctx[ctx->id][
+              ctx->poll_next_ctx].numa_node != ctx->socket_id);
+        } else {
+          pending &= ~(1ULL << ctx->poll_next_ctx);
+          break;
+        }
 
-      total++;
+        total++;
+      }
     }
 
     ctx->poll_next_ctx = (ctx->poll_next_ctx + 1) %
       FLEXNIC_PL_APPCTX_NUM;
   }
+  ctx->poll_pending = pending;
 
   for (j = 0; j < k; j++) {
     ret = fast_appctx_poll_bump(ctx, aqes[j], handles[num_bufs], ts);
@@ -382,8 +532,18 @@ static unsigned poll_queues(struct dataplane_context *ctx, uint32_t ts)
   /* apply buffer reservations */
   bufcache_alloc(ctx, num_bufs);
 
-  for (n = 0; n < FLEXNIC_PL_APPCTX_NUM; n++)
-    fast_actx_rxq_probe(ctx, n);
+  /* only probe contexts with receive queue entries still in use */
+  for (mask = ctx->rxq_outstanding; mask != 0; mask &= mask - 1) {
+    n = __builtin_ctzll(mask);
+    if (fast_actx_rxq_probe(ctx, n) == 1)
+      ctx->rxq_outstanding &= ~(1ULL << n);
+  }
+
+  /* retry parked arx entries now that the app might have freed space */
+  if (UNLIKELY(ctx->arx_ovf_ctxs != 0))
+    arx_ovf_drain(ctx, ts);
+
+  batch_adapt(&ctx->batch_qs, k);
 
   STATS_ADD(ctx, qs_total, total);
   if (total == 0)
@@ -401,15 +561,13 @@ static unsigned poll_kernel(struct dataplane_context *ctx, uint32_t ts)
 
   STATS_ADD(ctx, sp_poll, 1);
 
-  max = BATCH_SIZE;
-  if (TXBUF_SIZE - ctx->tx_num < max)
-    max = TXBUF_SIZE - ctx->tx_num;
+  max = batch_limit(&ctx->batch_sp, ctx);
 
-  max = (max > 8 ? 8 : max);
   /* allocate buffers contents */
   max = bufcache_prealloc(ctx, max, &handles);
 
-  for (k = 0; k < max;) {
+  /* entries not using a buffer might still forward a retransmit request */
+  for (k = 0; k < max && ctx->fwd_retry_num == 0;) {
     ret = fast_kernel_poll(ctx, handles[k], ts);
 
     if (ret == 0)
@@ -422,6 +580,7 @@ static unsigned poll_kernel(struct dataplane_context *ctx, uint32_t ts)
 
   /* apply buffer reservations */
   bufcache_alloc(ctx, k);
+  batch_adapt(&ctx->batch_sp, total);
 
   STATS_ADD(ctx, sp_total, total);
   if (total == 0)
@@ -433,14 +592,12 @@ static unsigned poll_kernel(struct dataplane_context *ctx, uint32_t ts)
 static unsigned poll_qman(struct dataplane_context *ctx, uint32_t ts)
 {
   unsigned q_ids[BATCH_SIZE];
-  uint16_t q_bytes[BATCH_SIZE];
+  uint32_t q_bytes[BATCH_SIZE];
   struct network_buf_handle **handles;
   uint16_t off = 0, max;
   int ret, i, use;
 
-  max = BATCH_SIZE;
-  if (TXBUF_SIZE - ctx->tx_num < max)
-    max = TXBUF_SIZE - ctx->tx_num;
+  max = batch_limit(&ctx->batch_qm, ctx);
 
   STATS_ADD(ctx, qm_poll, 1);
 
@@ -453,9 +610,11 @@ static unsigned poll_qman(struct dataplane_context *ctx, uint32_t ts)
   //STATS_TS(end_qman_poll);
 
   if (ret <= 0) {
+    batch_adapt(&ctx->batch_qm, 0);
     STATS_ADD(ctx, qm_empty, 1);
     return 0;
   }
+  batch_adapt(&ctx->batch_qm, ret);
 
   STATS_ADD(ctx, qm_total, ret);
 
@@ -494,18 +653,79 @@ static unsigned poll_qman(struct dataplane_context *ctx, uint32_t ts)
 
 static unsigned poll_qman_fwd(struct dataplane_context *ctx, uint32_t ts)
 {
-  void *flow_states[4 * BATCH_SIZE];
+  void *entries[4 * BATCH_SIZE];
+  struct network_buf_handle **handles = NULL;
+  uint16_t off = 0, max = 4 * BATCH_SIZE;
   int ret, i;
 
+  /* forwarded bumps may need a buffer for a window update, entries passed
+   * along to another owner may need room for a retry */
+  if (config.fp_flow_owner) {
+    if (TXBUF_SIZE - ctx->tx_num < max)
+      max = TXBUF_SIZE - ctx->tx_num;
+    if (FWD_RETRY_NUM - ctx->fwd_retry_num < max)
+      max = FWD_RETRY_NUM - ctx->fwd_retry_num;
+    max = bufcache_prealloc(ctx, max, &handles);
+  }
+
   /* poll queue manager forwarding ring */
-  ret = rte_ring_dequeue_burst(ctx->qman_fwd_ring, flow_states, 4 * BATCH_SIZE, NULL);
+  ret = rte_ring_dequeue_burst(ctx->qman_fwd_ring, entries, max, NULL);
   for (i = 0; i < ret; i++) {
-    fast_flows_qman_fwd(ctx, flow_states[i]);
+    if (fast_flows_qman_fwd(ctx, entries[i],
+          (config.fp_flow_owner ? handles[off] : NULL), ts) == 0)
+      off++;
   }
 
+  /* apply buffer reservations */
+  if (off > 0)
+    bufcache_alloc(ctx, off);
+
   return ret;
 }
 
+static inline void batch_init(struct dataplane_batch *b, uint16_t limit)
+{
+  if (limit > config.fp_batch_max)
+    limit = config.fp_batch_max;
+  b->limit = limit;
+  b->avg = limit << 4;
+}
+
+/** Current limit for a stage, capped by free space in the tx buffer. */
+static inline uint16_t batch_limit(struct dataplane_batch *b,
+    struct dataplane_context *ctx)
+{
+  uint16_t max = b->limit;
+  if (TXBUF_SIZE - ctx->tx_num < max)
+    max = TXBUF_SIZE - ctx->tx_num;
+  return max;
+}
+
+/**
+ * Update limit after a stage processed @n entries. A full batch doubles the
+ * limit to drain backlogs quickly, otherwise the limit decays towards twice
+ * the moving average so mostly idle stages stop reserving buffers and tx
+ * slots for work that does not arrive.
+ */
+static inline void batch_adapt(struct dataplane_batch *b, unsigned n)
+{
+  uint32_t lim;
+
+  b->avg = (b->avg * 7 + (n << 4)) / 8;
+
+  if (n >= b->limit) {
+    lim = (uint32_t) b->limit * 2;
+  } else {
+    lim = b->avg >> 3;
+    if (lim < BATCH_MIN)
+      lim = BATCH_MIN;
+  }
+
+  if (lim > config.fp_batch_max)
+    lim = config.fp_batch_max;
+  b->limit = lim;
+}
+
 static inline uint8_t bufcache_prealloc(struct dataplane_context *ctx, uint16_t num,
     struct network_buf_handle ***handles)
 {
@@ -575,7 +795,8 @@ static inline void tx_flush(struct dataplane_context *ctx)
   int ret;
   unsigned i;
 
-  if (ctx->tx_num == 0) {
+  /* software segments left over from the last flush go out first */
+  if (ctx->tx_num == 0 && ctx->net.gso_pend_num == 0) {
     return;
   }
 
@@ -600,12 +821,24 @@ static inline void tx_flush(struct dataplane_context *ctx)
     STATS_ATOMIC_ADD(ctx, tx_empty, 1);
 }
 
-static void poll_scale(struct dataplane_context *ctx)
+/** flow group hand-offs did not all fit into the forwarding rings */
+static int handoff_pending = 0;
+
+static void poll_scale(struct dataplane_context *ctx, uint32_t ts)
 {
   unsigned st = fp_scale_to;
 
-  if (st == 0)
+  /* finish handing off flow groups before scaling or rebalancing again */
+  if (UNLIKELY(handoff_pending)) {
+    handoff_pending = (fast_flows_scale(ts) != 0);
     return;
+  }
+
+  if (st == 0) {
+    if (config.fp_rebalance != 0)
+      poll_rebalance(ctx, ts);
+    return;
+  }
 
   fprintf(stderr, "Scaling fast path from %u to %u\n", fp_cores_cur, st);
   if (st < fp_cores_cur) {
@@ -622,37 +855,247 @@ static void poll_scale(struct dataplane_context *ctx)
     fprintf(stderr, "poll_scale: warning core number didn't change\n");
   }
 
+  handoff_pending = (fast_flows_scale(ts) != 0);
+
   fp_cores_cur = st;
   fp_scale_to = 0;
 }
 
+/* move hot flow groups from the busiest to the least busy core without
+ * changing the number of cores. The cost of a group is estimated as its share
+ * of the packets processed on its core times that core's busy cycles. */
+static void poll_rebalance(struct dataplane_context *ctx, uint32_t ts)
+{
+  static uint32_t last_ts = 0;
+  static uint64_t last_busy[FLEXNIC_PL_APPST_CTX_MCS];
+  static uint32_t last_pkts[FLEXNIC_PL_MAX_FLOWGROUPS];
+  static uint32_t fg_delta[FLEXNIC_PL_MAX_FLOWGROUPS];
+  uint64_t busy[FLEXNIC_PL_APPST_CTX_MCS], pkts[FLEXNIC_PL_APPST_CTX_MCS];
+  uint64_t x, gap, cost, best_cost;
+  uint16_t moves[REBALANCE_MOVES];
+  uint16_t c, g, hi, lo, n, best;
+  unsigned num_cores = fp_cores_cur;
+  uint32_t sum;
+
+  if (ts - last_ts < config.fp_rebalance)
+    return;
+  last_ts = ts;
+
+  /* busy cycles per core since last round */
+  for (c = 0; c < num_cores; c++) {
+    if (ctxs[c] == NULL || ctxs[c]->fg_pkts == NULL)
+      return;
+
+    x = ctxs[c]->loadmon_cyc_busy;
+    busy[c] = x - last_busy[c];
+    last_busy[c] = x;
+    pkts[c] = 0;
+  }
+
+  /* packets per flow group since last round, summed over all cores since
+   * groups can be processed on their old core while being moved */
+  for (g = 0; g < rss_reta_size; g++) {
+    sum = 0;
+    for (c = 0; c < fp_cores_max; c++) {
+      if (ctxs[c] != NULL && ctxs[c]->fg_pkts != NULL)
+        sum += ctxs[c]->fg_pkts[g];
+    }
+    fg_delta[g] = sum - last_pkts[g];
+    last_pkts[g] = sum;
+
+    c = fp_state->flow_group_steering[g];
+    if (c < num_cores)
+      pkts[c] += fg_delta[g];
+  }
+
+  hi = lo = 0;
+  for (c = 1; c < num_cores; c++) {
+    if (busy[c] > busy[hi])
+      hi = c;
+    if (busy[c] < busy[lo])
+      lo = c;
+  }
+
+  /* ignore imbalance below 1/8th of the busiest core */
+  if (hi == lo || pkts[hi] == 0 || busy[hi] - busy[lo] <= busy[hi] / 8)
+    return;
+
+  /* repeatedly pick the hottest group that does not overshoot */
+  gap = busy[hi] - busy[lo];
+  for (n = 0; n < REBALANCE_MOVES; n++) {
+    best = 0;
+    best_cost = 0;
+    for (g = 0; g < rss_reta_size; g++) {
+      if (fp_state->flow_group_steering[g] != hi || fg_delta[g] == 0)
+        continue;
+
+      cost = busy[hi] * fg_delta[g] / pkts[hi];
+      if (cost <= gap / 2 && cost > best_cost) {
+        best = g;
+        best_cost = cost;
+      }
+    }
+
+    if (best_cost == 0)
+      break;
+
+    moves[n] = best;
+    fg_delta[best] = 0;
+    gap -= 2 * best_cost;
+  }
+
+  if (n == 0)
+    return;
+
+  if (network_move_groups(moves, n, lo) != 0) {
+    fprintf(stderr, "network_move_groups failed\n");
+    abort();
+  }
+
+  handoff_pending = (fast_flows_scale(ts) != 0);
+}
+
 static void arx_cache_flush(struct dataplane_context *ctx, uint32_t ts)
 {
-  uint16_t i;
+  uint16_t i, n = 0;
   struct flextcp_pl_appctx *actx;
   struct flextcp_pl_arx *parx[BATCH_SIZE];
+  uint16_t idx[BATCH_SIZE];
 
   for (i = 0; i < ctx->arx_num; i++) {
     actx = &fp_state->appctx[ctx->id][ctx->arx_ctx[i]];
-    if (fast_actx_rxq_alloc(ctx, actx, &parx[i]) != 0) {
-      /* TODO: how do we handle this? */
-      fprintf(stderr, "arx_cache_flush: no space in app rx queue\n");
-      abort();
+
+    /* app rx queue full, or earlier entries still parked (keep per-flow
+     * order): park entry until the app frees space */
+    if (UNLIKELY((ctx->arx_ovf_ctxs & (1ULL << ctx->arx_ctx[i])) != 0 ||
+          fast_actx_rxq_alloc(ctx, actx, &parx[n]) != 0))
+    {
+      arx_ovf_park(ctx, i);
+      continue;
     }
+    ctx->rxq_outstanding |= 1ULL << ctx->arx_ctx[i];
+    STATS_ADD(ctx, numa_remote, actx->numa_node != ctx->socket_id);
+    idx[n++] = i;
   }
 
-  for (i = 0; i < ctx->arx_num; i++) {
+  for (i = 0; i < n; i++) {
     rte_prefetch0(parx[i]);
   }
 
-  for (i = 0; i < ctx->arx_num; i++) {
-    *parx[i] = ctx->arx_cache[i];
+  for (i = 0; i < n; i++) {
+    *parx[i] = ctx->arx_cache[idx[i]];
   }
 
-  for (i = 0; i < ctx->arx_num; i++) {
-    actx = &fp_state->appctx[ctx->id][ctx->arx_ctx[i]];
+  for (i = 0; i < n; i++) {
+    actx = &fp_state->appctx[ctx->id][ctx->arx_ctx[idx[i]]];
     actx_kick(actx, ts);
   }
 
   ctx->arx_num = 0;
 }
+
+/** Park arx cache entry `i`, merging it into a parked entry of the same flow
+ * if there is one */
+static void arx_ovf_park(struct dataplane_context *ctx, uint16_t i)
+{
+  struct arx_overflow *o = ctx->arx_ovf;
+  struct arx_overflow_entry *e;
+  struct flextcp_pl_arx *arx = &ctx->arx_cache[i];
+  uint32_t flow_id = ctx->arx_flow[i], b = flow_id % ARX_OVF_HT, ei;
+  uint16_t ctx_id = ctx->arx_ctx[i];
+
+  for (ei = o->ht[b]; ei != ARX_OVF_INVAL; ei = e->hnext) {
+    e = &o->ents[ei];
+    if (e->flow_id == flow_id && e->ctx_id == ctx_id) {
+      e->arx.msg.connupdate.rx_bump += arx->msg.connupdate.rx_bump;
+      e->arx.msg.connupdate.tx_bump += arx->msg.connupdate.tx_bump;
+      e->arx.msg.connupdate.flags |= arx->msg.connupdate.flags;
+      return;
+    }
+  }
+
+  /* cannot happen, once parking space runs out segments only add to parked
+   * entries of their flows */
+  if (o->free == ARX_OVF_INVAL) {
+    fprintf(stderr, "arx_ovf_park: no parking space, UNEXPECTED\n");
+    abort();
+  }
+
+  ei = o->free;
+  e = &o->ents[ei];
+  o->free = e->next;
+  ctx->arx_ovf_avail--;
+
+  e->arx = *arx;
+  e->flow_id = flow_id;
+  e->ctx_id = ctx_id;
+  e->hnext = o->ht[b];
+  o->ht[b] = ei;
+
+  e->next = ARX_OVF_INVAL;
+  if (o->tail[ctx_id] == ARX_OVF_INVAL) {
+    o->head[ctx_id] = ei;
+  } else {
+    o->ents[o->tail[ctx_id]].next = ei;
+  }
+  o->tail[ctx_id] = ei;
+  ctx->arx_ovf_ctxs |= 1ULL << ctx_id;
+}
+
+/** Flow has a parked entry that further notifications are merged into */
+int arx_ovf_parked(struct dataplane_context *ctx, uint16_t ctx_id,
+    uint32_t flow_id)
+{
+  struct arx_overflow *o = ctx->arx_ovf;
+  struct arx_overflow_entry *e;
+  uint32_t ei;
+
+  for (ei = o->ht[flow_id % ARX_OVF_HT]; ei != ARX_OVF_INVAL; ei = e->hnext) {
+    e = &o->ents[ei];
+    if (e->flow_id == flow_id && e->ctx_id == ctx_id)
+      return 1;
+  }
+  return 0;
+}
+
+/** Move parked arx entries to app rx queues that have space again */
+static void arx_ovf_drain(struct dataplane_context *ctx, uint32_t ts)
+{
+  struct arx_overflow *o = ctx->arx_ovf;
+  struct arx_overflow_entry *e;
+  struct flextcp_pl_appctx *actx;
+  struct flextcp_pl_arx *parx;
+  uint32_t ei, *pei;
+  uint64_t mask;
+  uint16_t id, n;
+
+  for (mask = ctx->arx_ovf_ctxs; mask != 0; mask &= mask - 1) {
+    id = __builtin_ctzll(mask);
+    actx = &fp_state->appctx[ctx->id][id];
+
+    for (n = 0; (ei = o->head[id]) != ARX_OVF_INVAL; n++) {
+      if (fast_actx_rxq_alloc(ctx, actx, &parx) != 0)
+        break;
+
+      e = &o->ents[ei];
+      *parx = e->arx;
+
+      /* remove from context list and hash bucket, then free */
+      if ((o->head[id] = e->next) == ARX_OVF_INVAL)
+        o->tail[id] = ARX_OVF_INVAL;
+      for (pei = &o->ht[e->flow_id % ARX_OVF_HT]; *pei != ei;
+          pei = &o->ents[*pei].hnext);
+      *pei = e->hnext;
+      e->next = o->free;
+      o->free = ei;
+      ctx->arx_ovf_avail++;
+    }
+
+    if (o->head[id] == ARX_OVF_INVAL)
+      ctx->arx_ovf_ctxs &= ~(1ULL << id);
+    if (n > 0) {
+      ctx->rxq_outstanding |= 1ULL << id;
+      actx_kick(actx, ts);
+    }
+  }
+}
@@ -49,17 +49,36 @@ int fast_actx_rxq_alloc(struct dataplane_context *ctx,
 int fast_actx_rxq_probe(struct dataplane_context *ctx, uint32_t id);
 
 /* fast_flows.c */
+
+/** Timers per flow, timer wheel ids are flow id * FLOW_TIMER_NUM + type */
+enum flow_timer_type {
+  /** send delayed ack */
+  FLOW_TIMER_DELACK = 0,
+  /** loss detection and tail loss probe */
+  FLOW_TIMER_RACK = 1,
+  /** retransmission timeout */
+  FLOW_TIMER_RTO = 2,
+  /** zero window probe */
+  FLOW_TIMER_PERSIST = 3,
+  FLOW_TIMER_NUM = 4,
+};
+
+int fast_flows_init(void);
+int fast_flows_scale(uint32_t ts);
+void fast_flows_fwd_retry(struct dataplane_context *ctx, uint32_t ts);
 void fast_flows_qman_pf(struct dataplane_context *ctx, uint32_t *queues,
     uint16_t n);
 void fast_flows_qman_pfbufs(struct dataplane_context *ctx, uint32_t *queues,
     uint16_t n);
 int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
     struct network_buf_handle *nbh, uint32_t ts);
-int fast_flows_qman_fwd(struct dataplane_context *ctx,
-    struct flextcp_pl_flowst *fs);
+int fast_flows_qman_fwd(struct dataplane_context *ctx, void *entry,
+    struct network_buf_handle *nbh, uint32_t ts);
 int fast_flows_packet(struct dataplane_context *ctx,
-    struct network_buf_handle *nbh, void *fs, struct tcp_opts *opts,
-    uint32_t ts);
+    struct network_buf_handle **nbhs, uint16_t num, void *fs,
+    struct tcp_opts *opts, uint32_t ts);
+uint16_t fast_flows_packet_gro(struct dataplane_context *ctx,
+    struct network_buf_handle **nbhs, void **fss, uint16_t n);
 void fast_flows_packet_fss(struct dataplane_context *ctx,
     struct network_buf_handle **nbhs, void **fss, uint16_t n);
 void fast_flows_packet_parse(struct dataplane_context *ctx,
@@ -73,7 +92,16 @@ void fast_flows_kernelxsums(struct network_buf_handle *nbh,
 int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
     uint16_t bump_seq, uint32_t rx_tail, uint32_t tx_head, uint8_t flags,
     struct network_buf_handle *nbh, uint32_t ts);
-void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id);
+void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id,
+    uint32_t ts);
+int fast_flows_timer(struct dataplane_context *ctx, uint32_t timer,
+    struct network_buf_handle *nbh, uint32_t ts);
+
+/* sorted sets of sequence number intervals (out of order data, SACK) */
+int seq_ivs_add(uint32_t *starts, uint32_t *lens, unsigned max,
+    uint32_t base, uint32_t seq, uint32_t len);
+void seq_ivs_trim(uint32_t *starts, uint32_t *lens, unsigned max,
+    uint32_t seq);
 
 /*****************************************************************************/
 /* Helpers */
@@ -101,13 +129,26 @@ static inline uint16_t tx_xsum_enable(struct network_buf_handle *nbh,
       ip_s, ip_d, IP_PROTO_TCP, l3_paylen);
 }
 
+static inline void tx_xsum_offload(struct network_buf_handle *nbh)
+{
+  network_buf_xsum_offload(nbh, sizeof(struct eth_hdr), sizeof(struct ip_hdr));
+}
+
+static inline void tx_tso_offload(struct network_buf_handle *nbh, uint8_t l4l,
+    uint16_t mss)
+{
+  network_buf_tso_offload(nbh, sizeof(struct eth_hdr), sizeof(struct ip_hdr),
+      l4l, mss);
+}
+
 static inline void arx_cache_add(struct dataplane_context *ctx, uint16_t ctx_id,
-    uint64_t opaque, uint32_t rx_bump, uint32_t rx_pos, uint32_t tx_bump,
-    uint16_t type_flags)
+    uint32_t flow_id, uint64_t opaque, uint32_t rx_bump, uint32_t rx_pos,
+    uint32_t tx_bump, uint16_t type_flags)
 {
   uint16_t id = ctx->arx_num++;
 
   ctx->arx_ctx[id] = ctx_id;
+  ctx->arx_flow[id] = flow_id;
   ctx->arx_cache[id].type = type_flags & 0xff;
   ctx->arx_cache[id].msg.connupdate.opaque = opaque;
   ctx->arx_cache[id].msg.connupdate.rx_bump = rx_bump;
@@ -116,6 +157,23 @@ static inline void arx_cache_add(struct dataplane_context *ctx, uint16_t ctx_id,
   ctx->arx_cache[id].msg.connupdate.flags = type_flags >> 8;
 }
 
+/** Parked arx entries kept free for one rx batch of every app context */
+#define ARX_OVF_RESERVE (FLEXNIC_PL_APPCTX_NUM * BATCH_SIZE)
+
+/** App context has parked arx entries and parking space is running out:
+ * segments of its flows must not create new parked entries (see
+ * arx_ovf_parked). The reserve covers one rx batch for every context that
+ * is not parked yet. */
+static inline int arx_ovf_full(struct dataplane_context *ctx,
+    uint16_t ctx_id)
+{
+  return (ctx->arx_ovf_ctxs & (1ULL << ctx_id)) != 0 &&
+    ctx->arx_ovf_avail < ARX_OVF_RESERVE;
+}
+
+int arx_ovf_parked(struct dataplane_context *ctx, uint16_t ctx_id,
+    uint32_t flow_id);
+
 static inline void actx_kick(struct flextcp_pl_appctx *ctx, uint32_t ts_us)
 {
   if(UNLIKELY(ts_us - ctx->last_ts > POLL_CYCLE)) {
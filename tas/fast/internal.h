@@ -65,10 +65,20 @@ extern volatile unsigned fp_scale_to;
 int qman_thread_init(struct dataplane_context *ctx);
 uint32_t qman_timestamp(uint64_t tsc);
 int qman_poll(struct qman_thread *t, unsigned num, unsigned *q_ids,
-    uint16_t *q_bytes);
+    uint32_t *q_bytes);
 int qman_set(struct qman_thread *t, uint32_t id, uint32_t rate, uint32_t avail,
-    uint16_t max_chunk, uint8_t flags);
+    uint32_t max_chunk, uint8_t flags);
 uint32_t qman_next_ts(struct qman_thread *t, uint32_t cur_ts);
+void qman_set_app(struct qman_thread *t, uint32_t id, uint8_t app);
+
+int timer_wheel_init(struct timer_wheel *w, uint32_t num, int socket,
+    uint32_t ts);
+void timer_wheel_arm(struct timer_wheel *w, uint32_t id, uint32_t deadline);
+void timer_wheel_cancel(struct timer_wheel *w, uint32_t id);
+int timer_wheel_advance(struct timer_wheel *w, uint32_t ts);
+unsigned timer_wheel_expired(struct timer_wheel *w, uint32_t *ids,
+    unsigned num);
+uint32_t timer_wheel_next_ts(struct timer_wheel *w, uint32_t cur_ts);
 
 void *util_create_shmsiszed(const char *name, size_t size, void *addr);
 
@@ -23,7 +23,9 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include <rte_config.h>
 #include <rte_memcpy.h>
@@ -36,6 +38,10 @@
 #include <rte_ip.h>
 #include <rte_version.h>
 #include <rte_spinlock.h>
+#include <rte_gso.h>
+#include <rte_errno.h>
+#include <rte_memory.h>
+#include <rte_dev.h>
 
 #include <utils.h>
 #include <utils_rng.h>
@@ -43,9 +49,13 @@
 #include "internal.h"
 
 #define PERTHREAD_MBUFS 2048
-#define MBUF_SIZE (BUFFER_SIZE + sizeof(struct rte_mbuf) + RTE_PKTMBUF_HEADROOM)
+#define MBUF_SIZE (buffer_size + sizeof(struct rte_mbuf) + RTE_PKTMBUF_HEADROOM)
+/** Ethernet header and CRC on top of the MTU */
+#define FRAME_OVERHEAD 18
 #define RX_DESCRIPTORS 256
 #define TX_DESCRIPTORS 128
+#define GSO_INDIRECT_MBUFS 2048
+#define GSO_SEGS_MAX 64
 
 uint8_t net_port_id = 0;
 static struct rte_eth_conf port_conf = {
@@ -74,6 +84,9 @@ static unsigned num_threads;
 static struct network_rx_thread **net_threads;
 
 static struct rte_eth_dev_info eth_devinfo;
+static uint32_t buffer_size = BUFFER_SIZE;
+static uint64_t tx_offloads = 0;
+static int use_gso = 0;
 #if RTE_VER_YEAR < 19
   struct ether_addr eth_addr;
 #else
@@ -84,7 +97,10 @@ uint16_t rss_reta_size;
 static struct rte_eth_rss_reta_entry64 *rss_reta = NULL;
 static uint16_t *rss_core_buckets = NULL;
 
-static struct rte_mempool *mempool_alloc(void);
+static struct rte_mempool *mempool_alloc(unsigned socket_id);
+static int gso_init(struct network_thread *t);
+static int txzc_init(void);
+static int txzc_thread_init(struct network_thread *t);
 static int reta_setup(void);
 static int reta_mlx5_resize(void);
 static rte_spinlock_t initlock = RTE_SPINLOCK_INITIALIZER;
@@ -135,10 +151,61 @@ int network_init(unsigned n_threads)
     port_conf.rx_adv_conf.rss_conf.rss_hf &= eth_devinfo.flow_type_rss_offloads;
   }
 
+  /* enable jumbo frames if the MTU requires it, and size buffers so
+   * received frames always fit in one mbuf */
+  if (config.ip_mtu + FRAME_OVERHEAD > eth_devinfo.max_rx_pktlen) {
+    fprintf(stderr, "NIC does not support MTU %u (max frame %u)\n",
+        config.ip_mtu, eth_devinfo.max_rx_pktlen);
+    goto error_exit;
+  } else if (config.ip_mtu > 1500) {
+    port_conf.rxmode.offloads |= DEV_RX_OFFLOAD_JUMBO_FRAME;
+    port_conf.rxmode.max_rx_pkt_len = config.ip_mtu + FRAME_OVERHEAD;
+  }
+  buffer_size = MAX(BUFFER_SIZE,
+      (config.ip_mtu + FRAME_OVERHEAD + 1023) & ~1023);
+
+  /* let the NIC verify received checksums where supported, the fast path
+   * verifies them in software otherwise */
+  port_conf.rxmode.offloads |= eth_devinfo.rx_offload_capa &
+    (DEV_RX_OFFLOAD_IPV4_CKSUM | DEV_RX_OFFLOAD_TCP_CKSUM);
+
   /* enable per port checksum offload if requested */
   if (config.fp_xsumoffload)
-    port_conf.txmode.offloads =
-      DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM;
+    tx_offloads = DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM;
+
+  /* enable tcp segmentation offload if requested, fall back to software
+   * segmentation if the NIC does not support it */
+  if (config.fp_tso && !config.fp_xsumoffload) {
+    fprintf(stderr, "Warning: TSO requires checksum offload, disabling "
+        "TSO.\n");
+    config.fp_tso = 0;
+  } else if (config.fp_tso) {
+    tx_offloads |= DEV_TX_OFFLOAD_MULTI_SEGS;
+    if ((eth_devinfo.tx_offload_capa & DEV_TX_OFFLOAD_TCP_TSO) != 0) {
+      tx_offloads |= DEV_TX_OFFLOAD_TCP_TSO;
+    } else {
+      fprintf(stderr, "Warning: NIC does not support TSO, using software "
+          "GSO.\n");
+      use_gso = 1;
+    }
+  }
+
+  /* enable zero-copy transmit if requested, fall back to copying if the
+   * application buffer memory cannot be registered with the NIC */
+  if (config.fp_tx_zerocopy && !config.fp_xsumoffload) {
+    fprintf(stderr, "Warning: zero-copy transmit requires checksum offload, "
+        "disabling zero-copy.\n");
+    config.fp_tx_zerocopy = 0;
+  } else if (config.fp_tx_zerocopy) {
+    if (txzc_init() == 0) {
+      tx_offloads |= DEV_TX_OFFLOAD_MULTI_SEGS;
+    } else {
+      fprintf(stderr, "Warning: registering DMA memory failed, disabling "
+          "zero-copy transmit.\n");
+      config.fp_tx_zerocopy = 0;
+    }
+  }
+  port_conf.txmode.offloads = tx_offloads;
 
   /* disable rx interrupts if requested */
   if (!config.fp_interrupts)
@@ -151,6 +218,14 @@ int network_init(unsigned n_threads)
     goto error_exit;
   }
 
+  /* keep the NIC's default MTU unless configured otherwise */
+  if (config.ip_mtu != 1500 &&
+      rte_eth_dev_set_mtu(net_port_id, config.ip_mtu) != 0)
+  {
+    fprintf(stderr, "rte_eth_dev_set_mtu failed\n");
+    goto error_exit;
+  }
+
 
   /* workaround for mlx5. */
   if (config.fp_autoscale) {
@@ -164,11 +239,8 @@ int network_init(unsigned n_threads)
 #endif
   eth_devinfo.default_rxconf.offloads = 0;
 
-  /* enable per-queue checksum offload if requested */
-  eth_devinfo.default_txconf.offloads = 0;
-  if (config.fp_xsumoffload)
-    eth_devinfo.default_txconf.offloads =
-      DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM;
+  /* enable per-queue checksum and segmentation offload if requested */
+  eth_devinfo.default_txconf.offloads = tx_offloads;
 
   memcpy(&tas_info->mac_address, &eth_addr, 6);
 
@@ -209,7 +281,19 @@ int network_thread_init(struct dataplane_context *ctx)
   int ret;
 
   /* allocate mempool */
-  if ((t->pool = mempool_alloc()) == NULL) {
+  if ((t->pool = mempool_alloc(ctx->socket_id)) == NULL) {
+    goto error_mpool;
+  }
+
+  /* prepare software segmentation if NIC does not do TSO */
+  t->gso_ctx = NULL;
+  if (use_gso && gso_init(t) != 0) {
+    goto error_mpool;
+  }
+
+  /* prepare attaching app transmit buffers to mbufs */
+  t->ext_shinfo = NULL;
+  if (config.fp_tx_zerocopy && txzc_thread_init(t) != 0) {
     goto error_mpool;
   }
 
@@ -217,7 +301,7 @@ int network_thread_init(struct dataplane_context *ctx)
   t->queue_id = ctx->id;
   rte_spinlock_lock(&initlock);
   ret = rte_eth_tx_queue_setup(net_port_id, t->queue_id, TX_DESCRIPTORS,
-          rte_socket_id(), &eth_devinfo.default_txconf);
+          ctx->socket_id, &eth_devinfo.default_txconf);
   rte_spinlock_unlock(&initlock);
   if (ret != 0) {
     fprintf(stderr, "network_thread_init: rte_eth_tx_queue_setup failed\n");
@@ -232,7 +316,7 @@ int network_thread_init(struct dataplane_context *ctx)
   t->queue_id = ctx->id;
   rte_spinlock_lock(&initlock);
   ret = rte_eth_rx_queue_setup(net_port_id, t->queue_id, RX_DESCRIPTORS,
-          rte_socket_id(), &eth_devinfo.default_rxconf, t->pool);
+          ctx->socket_id, &eth_devinfo.default_rxconf, t->pool);
   rte_spinlock_unlock(&initlock);
   if (ret != 0) {
     fprintf(stderr, "network_thread_init: rte_eth_rx_queue_setup failed\n");
@@ -298,7 +382,7 @@ int network_rx_interrupt_ctl(struct network_thread *t, int turnon)
   }
 }
 
-static struct rte_mempool *mempool_alloc(void)
+static struct rte_mempool *mempool_alloc(unsigned socket_id)
 {
   static unsigned pool_id = 0;
   unsigned n;
@@ -307,8 +391,173 @@ static struct rte_mempool *mempool_alloc(void)
   snprintf(name, 32, "mbuf_pool_%u\n", n);
   return rte_mempool_create(name, PERTHREAD_MBUFS, MBUF_SIZE, 32,
           sizeof(struct rte_pktmbuf_pool_private), rte_pktmbuf_pool_init, NULL,
-          rte_pktmbuf_init, NULL, rte_socket_id(), 0);
+          rte_pktmbuf_init, NULL, socket_id, 0);
+
+}
+
+static int gso_init(struct network_thread *t)
+{
+  static unsigned pool_id = 0;
+  unsigned n;
+  char name[32];
+
+  if ((t->gso_ctx = rte_zmalloc("gso ctx", sizeof(*t->gso_ctx), 0)) == NULL) {
+    fprintf(stderr, "gso_init: allocating context failed\n");
+    return -1;
+  }
+
+  /* indirect mbufs only reference payload in the super-segment */
+  n = __sync_fetch_and_add(&pool_id, 1);
+  snprintf(name, 32, "gso_pool_%u", n);
+  t->gso_ctx->indirect_pool = rte_pktmbuf_pool_create(name, GSO_INDIRECT_MBUFS,
+      32, 0, 0, t->pool->socket_id);
+  if (t->gso_ctx->indirect_pool == NULL) {
+    fprintf(stderr, "gso_init: creating indirect pool failed\n");
+    rte_free(t->gso_ctx);
+    t->gso_ctx = NULL;
+    return -1;
+  }
+
+  t->gso_pend_num = 0;
+  if ((t->gso_pend = rte_zmalloc("gso pending",
+          GSO_SEGS_MAX * sizeof(*t->gso_pend), 0)) == NULL)
+  {
+    fprintf(stderr, "gso_init: allocating pending segments failed\n");
+    rte_mempool_free(t->gso_ctx->indirect_pool);
+    rte_free(t->gso_ctx);
+    t->gso_ctx = NULL;
+    return -1;
+  }
+
+  t->gso_ctx->direct_pool = t->pool;
+  t->gso_ctx->gso_types = DEV_TX_OFFLOAD_TCP_TSO;
+  t->gso_ctx->flag = RTE_GSO_FLAG_IPID_FIXED;
+  return 0;
+}
+
+/** Register application buffer memory with DPDK and map it for the NIC, using
+ * virtual addresses as IO addresses. */
+static int txzc_init(void)
+{
+#if RTE_VERSION >= RTE_VERSION_NUM(19, 5, 0, 0)
+  size_t pgsz = (config.fp_hugepages ? RTE_PGSIZE_2M : sysconf(_SC_PAGESIZE));
+
+  if (rte_extmem_register(tas_shm, FLEXNIC_DMA_MEM_SIZE, NULL, 0, pgsz) != 0) {
+    fprintf(stderr, "txzc_init: rte_extmem_register failed\n");
+    return -1;
+  }
+
+  /* not all drivers need an explicit mapping */
+  if (rte_dev_dma_map(eth_devinfo.device, tas_shm, (uintptr_t) tas_shm,
+        FLEXNIC_DMA_MEM_SIZE) != 0 && rte_errno != ENOTSUP)
+  {
+    fprintf(stderr, "txzc_init: rte_dev_dma_map failed\n");
+    rte_extmem_unregister(tas_shm, FLEXNIC_DMA_MEM_SIZE);
+    return -1;
+  }
+
+  return 0;
+#else
+  fprintf(stderr, "txzc_init: external memory requires DPDK 19.05+\n");
+  return -1;
+#endif
+}
+
+/** Buffer memory is owned by the application, nothing to free */
+static void txzc_extbuf_free(void *addr, void *opaque)
+{
+}
+
+static int txzc_thread_init(struct network_thread *t)
+{
+  t->ext_shinfo = rte_zmalloc("ext shinfo", sizeof(*t->ext_shinfo), 0);
+  if (t->ext_shinfo == NULL) {
+    fprintf(stderr, "txzc_thread_init: allocating shared info failed\n");
+    return -1;
+  }
 
+  /* one reference held permanently, so the count never drops to zero */
+  t->ext_shinfo->free_cb = txzc_extbuf_free;
+  t->ext_shinfo->fcb_opaque = NULL;
+  rte_mbuf_ext_refcnt_set(t->ext_shinfo, 1);
+  return 0;
+}
+
+/** Fix up checksums on segment produced by GSO (library leaves them as is) */
+static inline void gso_segment_xsums(struct rte_mbuf *mb)
+{
+  struct pkt_tcp *p = rte_pktmbuf_mtod(mb, struct pkt_tcp *);
+
+  p->ip.chksum = 0;
+  p->tcp.chksum = network_buf_tcpxsums((struct network_buf_handle *) mb,
+      sizeof(p->eth), sizeof(p->ip), &p->ip, p->ip.src, p->ip.dest,
+      IP_PROTO_TCP, f_beui16(p->ip.len) - sizeof(p->ip));
+}
+
+/* send segments left over from an earlier call, 0 once all went out */
+static int gso_send_pending(struct network_thread *t)
+{
+  uint16_t k;
+
+  k = rte_eth_tx_burst(net_port_id, t->queue_id, t->gso_pend,
+      t->gso_pend_num);
+  memmove(t->gso_pend, t->gso_pend + k,
+      (t->gso_pend_num - k) * sizeof(*t->gso_pend));
+  t->gso_pend_num -= k;
+  return (t->gso_pend_num == 0 ? 0 : -1);
+}
+
+int network_send_gso(struct network_thread *t, unsigned num,
+    struct network_buf_handle **bhs)
+{
+  struct rte_mbuf **mbs = (struct rte_mbuf **) bhs;
+  struct rte_mbuf *segs[GSO_SEGS_MAX];
+  unsigned i = 0, j, k;
+  int n;
+
+  /* keep packet order: nothing new goes out before the leftovers */
+  if (t->gso_pend_num > 0 && gso_send_pending(t) != 0)
+    return 0;
+
+  while (i < num) {
+    /* send run of regular packets in one burst */
+    for (j = i; j < num && !(mbs[j]->ol_flags & PKT_TX_TCP_SEG); j++);
+    if (j > i) {
+      k = rte_eth_tx_burst(net_port_id, t->queue_id, mbs + i, j - i);
+      if (k < j - i)
+        return i + k;
+      i = j;
+      continue;
+    }
+
+    /* segment super-segment in software */
+    t->gso_ctx->gso_size = mbs[i]->l2_len + mbs[i]->l3_len + mbs[i]->l4_len +
+      mbs[i]->tso_segsz;
+    if ((n = rte_gso_segment(mbs[i], t->gso_ctx, segs, GSO_SEGS_MAX)) < 0) {
+      /* drop, will be recovered by retransmission */
+      fprintf(stderr, "network_send_gso: rte_gso_segment failed\n");
+      rte_pktmbuf_free(mbs[i]);
+      i++;
+      continue;
+    }
+
+    for (k = 0; k < (unsigned) n; k++) {
+      gso_segment_xsums(segs[k]);
+    }
+
+    /* the original buffer is consumed at this point, so segments cannot be
+     * handed back to the caller, keep those the NIC does not take for the
+     * next flush */
+    k = rte_eth_tx_burst(net_port_id, t->queue_id, segs, n);
+    i++;
+    if (k < (unsigned) n) {
+      memcpy(t->gso_pend, segs + k, (n - k) * sizeof(*segs));
+      t->gso_pend_num = n - k;
+      return i;
+    }
+  }
+
+  return num;
 }
 
 static inline uint16_t core_min(uint16_t num)
@@ -413,6 +662,44 @@ int network_scale_down(uint16_t old, uint16_t new)
   return 0;
 }
 
+int network_move_groups(const uint16_t *groups, uint16_t num, uint16_t core)
+{
+  uint16_t i, g, o_c, outer, inner;
+
+  /* clear mask */
+  for (i = 0; i < rss_reta_size; i += RTE_RETA_GROUP_SIZE) {
+    rss_reta[i / RTE_RETA_GROUP_SIZE].mask = 0;
+  }
+
+  for (i = 0; i < num; i++) {
+    g = groups[i];
+    if (g >= rss_reta_size)
+      continue;
+
+    outer = g / RTE_RETA_GROUP_SIZE;
+    inner = g % RTE_RETA_GROUP_SIZE;
+
+    o_c = rss_reta[outer].reta[inner];
+    if (o_c == core)
+      continue;
+
+    rss_reta[outer].reta[inner] = core;
+    rss_reta[outer].mask |= 1ULL << inner;
+
+    fp_state->flow_group_steering[g] = core;
+
+    rss_core_buckets[o_c]--;
+    rss_core_buckets[core]++;
+  }
+
+  if (rte_eth_dev_rss_reta_update(net_port_id, rss_reta, rss_reta_size) != 0) {
+    fprintf(stderr, "network_move_groups: rte_eth_dev_rss_reta_update failed\n");
+    return -1;
+  }
+
+  return 0;
+}
+
 static int reta_setup()
 {
   uint16_t i, c;
@@ -44,6 +44,9 @@ int network_rx_interrupt_ctl(struct network_thread *t, int turnon);
 
 int network_scale_up(uint16_t old, uint16_t new);
 int network_scale_down(uint16_t old, uint16_t new);
+int network_move_groups(const uint16_t *groups, uint16_t num, uint16_t core);
+int network_send_gso(struct network_thread *t, unsigned num,
+    struct network_buf_handle **bhs);
 
 
 static inline void network_buf_reset(struct network_buf_handle *bh)
@@ -86,6 +89,37 @@ static inline void network_buf_setlen(struct network_buf_handle *bh,
   mb->pkt_len = mb->data_len = len;
 }
 
+/** total packet length across all chained buffers */
+static inline void network_buf_setpktlen(struct network_buf_handle *bh,
+    uint32_t len)
+{
+  ((struct rte_mbuf *) bh)->pkt_len = len;
+}
+
+/** size of the data area of the buffer */
+static inline uint16_t network_buf_size(struct network_buf_handle *bh)
+{
+  return ((struct rte_mbuf *) bh)->buf_len;
+}
+
+static inline struct network_buf_handle *network_buf_next(
+    struct network_buf_handle *bh)
+{
+  return (struct network_buf_handle *) ((struct rte_mbuf *) bh)->next;
+}
+
+/** point buffer at `len` bytes of registered external memory instead of its
+ * own data area, reverts when the buffer is freed */
+static inline void network_buf_extattach(struct network_thread *t,
+    struct network_buf_handle *bh, void *addr, uint16_t len)
+{
+  struct rte_mbuf *mb = (struct rte_mbuf *) bh;
+
+  rte_mbuf_ext_refcnt_update(t->ext_shinfo, 1);
+  rte_pktmbuf_attach_extbuf(mb, addr, (uintptr_t) addr, len, t->ext_shinfo);
+  mb->data_len = len;
+}
+
 
 static inline int network_poll(struct network_thread *t, unsigned num,
     struct network_buf_handle **bhs)
@@ -121,6 +155,9 @@ static inline int network_send(struct network_thread *t, unsigned num,
   }
 #endif
 
+  if (t->gso_ctx != NULL)
+    return network_send_gso(t, num, bhs);
+
   return rte_eth_tx_burst(net_port_id, t->queue_id, mbs, num);
 }
 
@@ -145,6 +182,27 @@ static inline int network_buf_alloc(struct network_thread *t, unsigned num,
   return i;
 }
 
+/** chain up to `num` additional buffers to `bh`, returns number chained */
+static inline unsigned network_buf_chain(struct network_thread *t,
+    struct network_buf_handle *bh, unsigned num)
+{
+  struct rte_mbuf *mb = (struct rte_mbuf *) bh, *last = mb;
+  struct rte_mbuf *segs[num];
+  unsigned i;
+
+  num = network_buf_alloc(t, num, (struct network_buf_handle **) segs);
+  while (last->next != NULL)
+    last = last->next;
+
+  for (i = 0; i < num; i++) {
+    last->next = segs[i];
+    last = segs[i];
+  }
+  mb->nb_segs += num;
+
+  return num;
+}
+
 static inline void network_free(unsigned num, struct network_buf_handle **bufs)
 {
   unsigned i;
@@ -172,9 +230,10 @@ static inline uint16_t network_ip_phdr_xsum(beui32_t ip_src, beui32_t ip_dst,
   return (uint16_t) sum;
 }
 
-static inline uint16_t network_buf_tcpxsums(struct network_buf_handle *bh, uint8_t l2l,
-    uint8_t l3l, void *ip_hdr, beui32_t ip_s, beui32_t ip_d, uint8_t ip_proto,
-    uint16_t l3_paylen)
+/** request ip and tcp checksum offload, the caller has to fill in the pseudo
+ * header checksum */
+static inline void network_buf_xsum_offload(struct network_buf_handle *bh,
+    uint8_t l2l, uint8_t l3l)
 {
   struct rte_mbuf * restrict mb = (struct rte_mbuf *) bh;
   mb->tx_offload = l2l | ((uint32_t) l3l << 7);
@@ -182,10 +241,45 @@ static inline uint16_t network_buf_tcpxsums(struct network_buf_handle *bh, uint8
   mb->l3_len = l3l;
   mb->l4_len = 0;*/
   mb->ol_flags = PKT_TX_IPV4 | PKT_TX_IP_CKSUM | PKT_TX_TCP_CKSUM;
+}
 
+static inline uint16_t network_buf_tcpxsums(struct network_buf_handle *bh, uint8_t l2l,
+    uint8_t l3l, void *ip_hdr, beui32_t ip_s, beui32_t ip_d, uint8_t ip_proto,
+    uint16_t l3_paylen)
+{
+  network_buf_xsum_offload(bh, l2l, l3l);
   return network_ip_phdr_xsum(ip_s, ip_d, ip_proto, l3_paylen);
 }
 
+/** like network_buf_xsum_offload, but also request segmentation into `mss`
+ * sized segments, for TSO the pseudo header checksum excludes the length */
+static inline void network_buf_tso_offload(struct network_buf_handle *bh,
+    uint8_t l2l, uint8_t l3l, uint8_t l4l, uint16_t mss)
+{
+  struct rte_mbuf * restrict mb = (struct rte_mbuf *) bh;
+  mb->tx_offload = l2l | ((uint32_t) l3l << 7) | ((uint32_t) l4l << 16) |
+    ((uint64_t) mss << 24);
+  mb->ol_flags = PKT_TX_IPV4 | PKT_TX_IP_CKSUM | PKT_TX_TCP_CKSUM |
+    PKT_TX_TCP_SEG;
+}
+
+#define NETWORK_RXXSUM_IP 1
+#define NETWORK_RXXSUM_L4 2
+
+/** NIC checksum verification result for received packet: -1 if ip or l4
+ * checksum is bad, otherwise mask of NETWORK_RXXSUM_* verified as good */
+static inline int network_buf_rxxsum(struct network_buf_handle *bh)
+{
+  struct rte_mbuf * restrict mb = (struct rte_mbuf *) bh;
+  uint64_t ip = mb->ol_flags & PKT_RX_IP_CKSUM_MASK;
+  uint64_t l4 = mb->ol_flags & PKT_RX_L4_CKSUM_MASK;
+
+  if (ip == PKT_RX_IP_CKSUM_BAD || l4 == PKT_RX_L4_CKSUM_BAD)
+    return -1;
+  return (ip == PKT_RX_IP_CKSUM_GOOD ? NETWORK_RXXSUM_IP : 0) |
+    (l4 == PKT_RX_L4_CKSUM_GOOD ? NETWORK_RXXSUM_L4 : 0);
+}
+
 static inline int network_buf_flowgroup(struct network_buf_handle *bh,
     uint16_t *fg)
 {
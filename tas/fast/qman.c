@@ -43,6 +43,8 @@
 
 #define FLAG_INSKIPLIST 1
 #define FLAG_INNOLIMITL 2
+#define FLAG_INWHEEL 4
+#define FLAG_INRATEL (FLAG_INSKIPLIST | FLAG_INWHEEL)
 
 /** Skiplist: bits per level */
 #define SKIPLIST_BITS 3
@@ -53,46 +55,68 @@
 #define TIMESTAMP_BITS 32
 #define TIMESTAMP_MASK 0xFFFFFFFF
 
+/** TSC to ns and us conversion factors, 32.32 fixed point */
+static uint64_t tsc_ns_mult;
+static uint64_t tsc_us_mult;
+
 /** Queue state */
 struct queue {
   /** Next pointers for levels in skip list */
   uint32_t next_idxs[QMAN_SKIPLIST_LEVELS];
   /** Time stamp */
   uint32_t next_ts;
-  /** Assigned Rate */
-  uint32_t rate;
+  /** Pacing: time per byte [ns] for the assigned rate, 0 for no limit */
+  float byte_time;
   /** Number of entries in queue */
   uint32_t avail;
-  /** Maximum chunk size when de-queueing */
-  uint16_t max_chunk;
-  /** Flags: FLAG_INSKIPLIST, FLAG_INNOLIMITL */
-  uint16_t flags;
+  /** Maximum chunk size when de-queueing (24 bits to allow TSO chunks) */
+  uint32_t max_chunk : 24;
+  /** Flags: FLAG_INSKIPLIST, FLAG_INNOLIMITL, FLAG_INWHEEL */
+  uint32_t flags : 5;
+  /** Application for per-app fair queueing */
+  uint32_t app : 3;
 } __attribute__((packed));
 STATIC_ASSERT((sizeof(struct queue) == 32), queue_size);
+STATIC_ASSERT((FLEXNIC_PL_APPST_NUM <= 8), queue_app_bits);
 
 
 /** Actually update queue state: must run on queue's home core */
 static inline void set_impl(struct qman_thread *t, uint32_t id, uint32_t rate,
-    uint32_t avail, uint16_t max_chunk, uint8_t flags);
+    uint32_t avail, uint32_t max_chunk, uint8_t flags);
 
 /** Add queue to the no limit list */
 static inline void queue_activate_nolimit(struct qman_thread *t,
     struct queue *q, uint32_t idx);
 static inline unsigned poll_nolimit(struct qman_thread *t, uint32_t cur_ts,
-    unsigned num, unsigned *q_ids, uint16_t *q_bytes);
+    unsigned num, unsigned *q_ids, uint32_t *q_bytes);
 
 /** Add queue to the skip list list */
 static inline void queue_activate_skiplist(struct qman_thread *t,
     struct queue *q, uint32_t idx);
 static inline unsigned poll_skiplist(struct qman_thread *t, uint32_t cur_ts,
-    unsigned num, unsigned *q_ids, uint16_t *q_bytes);
+    unsigned num, unsigned *q_ids, uint32_t *q_bytes);
 static inline uint8_t queue_level(struct qman_thread *t);
 
+/** Add queue to the timing wheel */
+static inline void queue_activate_wheel(struct qman_thread *t,
+    struct queue *q, uint32_t idx);
+static inline unsigned poll_wheel(struct qman_thread *t, uint32_t cur_ts,
+    unsigned num, unsigned *q_ids, uint32_t *q_bytes);
+static inline uint32_t wheel_next_slot(struct qman_thread *t, uint32_t slot);
+
+/** Poll application ready lists with DRR */
+static inline unsigned poll_apps(struct qman_thread *t, uint32_t cur_ts,
+    unsigned num, unsigned *q_ids, uint32_t *q_bytes);
+
+static inline unsigned queue_due(struct qman_thread *t,
+    struct queue *q, uint32_t idx, unsigned *q_id, uint32_t *q_bytes);
+
 static inline void queue_fire(struct qman_thread *t,
-    struct queue *q, uint32_t idx, unsigned *q_id, uint16_t *q_bytes);
+    struct queue *q, uint32_t idx, unsigned *q_id, uint32_t *q_bytes);
 static inline void queue_activate(struct qman_thread *t, struct queue *q,
     uint32_t idx);
 static inline uint32_t timestamp(void);
+static void timestamp_init(void);
 static inline int timestamp_lessthaneq(struct qman_thread *t, uint32_t a,
     uint32_t b);
 static inline int64_t rel_time(uint32_t cur_ts, uint32_t ts_in);
@@ -103,7 +127,8 @@ int qman_thread_init(struct dataplane_context *ctx)
   struct qman_thread *t = &ctx->qman;
   unsigned i;
 
-  if ((t->queues = calloc(1, sizeof(*t->queues) * FLEXNIC_NUM_QMQUEUES))
+  if ((t->queues = rte_zmalloc_socket("qman queues",
+          sizeof(*t->queues) * FLEXNIC_NUM_QMQUEUES, 64, ctx->socket_id))
       == NULL)
   {
     fprintf(stderr, "qman_thread_init: queues malloc failed\n");
@@ -114,24 +139,42 @@ int qman_thread_init(struct dataplane_context *ctx)
     t->head_idx[i] = IDXLIST_INVAL;
   }
   t->nolimit_head_idx = t->nolimit_tail_idx = IDXLIST_INVAL;
+  for (i = 0; i < FLEXNIC_PL_APPST_NUM; i++) {
+    t->apps[i].head_idx = t->apps[i].tail_idx = IDXLIST_INVAL;
+    t->apps[i].tokens = QMAN_APP_BURST;
+  }
   utils_rng_init(&t->rng, RNG_SEED * ctx->id + ctx->id);
 
+  timestamp_init();
   t->ts_virtual = 0;
   t->ts_real = timestamp();
 
+  if (config.fp_qman_wheel != 0) {
+    if ((t->wheel_head = rte_malloc_socket("qman wheel",
+            sizeof(*t->wheel_head) * 2 * QMAN_WHEEL_SLOTS, 64, ctx->socket_id))
+        == NULL ||
+        (t->wheel_tail = rte_malloc_socket("qman wheel",
+            sizeof(*t->wheel_tail) * 2 * QMAN_WHEEL_SLOTS, 64, ctx->socket_id))
+        == NULL)
+    {
+      fprintf(stderr, "qman_thread_init: wheel malloc failed\n");
+      return -1;
+    }
+
+    for (i = 0; i < 2 * QMAN_WHEEL_SLOTS; i++) {
+      t->wheel_head[i] = t->wheel_tail[i] = IDXLIST_INVAL;
+    }
+    t->wheel_shift = __builtin_ctz(config.fp_qman_wheel);
+    t->wheel_pos = t->ts_virtual >> t->wheel_shift;
+    t->wheel_num = t->wheel_l1_num = 0;
+  }
+
   return 0;
 }
 
 uint32_t qman_timestamp(uint64_t cycles)
 {
-  static uint64_t freq = 0;
-
-  if (freq == 0)
-    freq = rte_get_tsc_hz();
-
-  cycles *= 1000000ULL;
-  cycles /= freq;
-  return cycles;
+  return (cycles * tsc_us_mult) >> 32;
 }
 
 uint32_t qman_next_ts(struct qman_thread *t, uint32_t cur_ts)
@@ -145,6 +188,37 @@ uint32_t qman_next_ts(struct qman_thread *t, uint32_t cur_ts)
     return 0;
   }
 
+  if (config.fp_qman_fair) {
+    unsigned i;
+    for (i = 0; i < FLEXNIC_PL_APPST_NUM; i++) {
+      // App ready list has work - immediate timeout
+      if (t->apps[i].head_idx != IDXLIST_INVAL)
+        return 0;
+    }
+  }
+
+  if (config.fp_qman_wheel != 0) {
+    uint32_t cur, slot;
+    int64_t rel;
+
+    if (t->wheel_num == 0)
+      return -1;
+
+    /* next occupied level 0 slot, but no later than the cascade at the end
+     * of the rotation if level 1 holds queues */
+    cur = t->wheel_pos & (QMAN_WHEEL_SLOTS - 1);
+    if ((slot = wheel_next_slot(t, cur)) == QMAN_WHEEL_SLOTS &&
+        t->wheel_l1_num == 0 &&
+        (slot = wheel_next_slot(t, 0)) != QMAN_WHEEL_SLOTS)
+    {
+      slot += QMAN_WHEEL_SLOTS;
+    }
+
+    rel = ((int64_t) (slot - cur) << t->wheel_shift) -
+      rel_time(t->ts_virtual, ret_ts);
+    return (rel <= 0 ? 0 : rel / 1000);
+  }
+
   uint32_t idx = t->head_idx[0];
   if(idx != IDXLIST_INVAL) {
     struct queue *q = &t->queues[idx];
@@ -163,13 +237,32 @@ uint32_t qman_next_ts(struct qman_thread *t, uint32_t cur_ts)
 }
 
 int qman_poll(struct qman_thread *t, unsigned num, unsigned *q_ids,
-    uint16_t *q_bytes)
+    uint32_t *q_bytes)
 {
   unsigned x, y;
   uint32_t ts = timestamp();
 
-  /* poll nolimit list and skiplist alternating the order between */
-  if (t->nolimit_first) {
+  /* with per-app fair queueing due rate-limited queues are moved to their
+   * app's ready list, where no-limit queues also wait */
+  if (config.fp_qman_fair) {
+    if (config.fp_qman_wheel != 0) {
+      poll_wheel(t, ts, num, q_ids, q_bytes);
+    } else {
+      poll_skiplist(t, ts, num, q_ids, q_bytes);
+    }
+    return poll_apps(t, ts, num, q_ids, q_bytes);
+  }
+
+  /* poll nolimit list and rate-limited queues alternating the order between */
+  if (config.fp_qman_wheel != 0) {
+    if (t->nolimit_first) {
+      x = poll_nolimit(t, ts, num, q_ids, q_bytes);
+      y = poll_wheel(t, ts, num - x, q_ids + x, q_bytes + x);
+    } else {
+      x = poll_wheel(t, ts, num, q_ids, q_bytes);
+      y = poll_nolimit(t, ts, num - x, q_ids + x, q_bytes + x);
+    }
+  } else if (t->nolimit_first) {
     x = poll_nolimit(t, ts, num, q_ids, q_bytes);
     y = poll_skiplist(t, ts, num - x, q_ids + x, q_bytes + x);
   } else {
@@ -182,7 +275,7 @@ int qman_poll(struct qman_thread *t, unsigned num, unsigned *q_ids,
 }
 
 int qman_set(struct qman_thread *t, uint32_t id, uint32_t rate, uint32_t avail,
-    uint16_t max_chunk, uint8_t flags)
+    uint32_t max_chunk, uint8_t flags)
 {
 #ifdef FLEXNIC_TRACE_QMAN
   struct flexnic_trace_entry_qman_set evt = {
@@ -206,15 +299,24 @@ int qman_set(struct qman_thread *t, uint32_t id, uint32_t rate, uint32_t avail,
   return 0;
 }
 
+void qman_set_app(struct qman_thread *t, uint32_t id, uint8_t app)
+{
+  assert(id < FLEXNIC_NUM_QMQUEUES && app < FLEXNIC_PL_APPST_NUM);
+
+  /* only changes lists on next activation */
+  t->queues[id].app = app;
+}
+
 /** Actually update queue state: must run on queue's home core */
 static void inline set_impl(struct qman_thread *t, uint32_t idx, uint32_t rate,
-    uint32_t avail, uint16_t max_chunk, uint8_t flags)
+    uint32_t avail, uint32_t max_chunk, uint8_t flags)
 {
   struct queue *q = &t->queues[idx];
   int new_avail = 0;
 
+  /* convert rate [kbps] once here, so firing the queue needs no division */
   if ((flags & QMAN_SET_RATE) != 0) {
-    q->rate = rate;
+    q->byte_time = (rate == 0 ? 0 : 8000000.0f / rate);
   }
 
   if ((flags & QMAN_SET_MAXCHUNK) != 0) {
@@ -229,10 +331,10 @@ static void inline set_impl(struct qman_thread *t, uint32_t idx, uint32_t rate,
     new_avail = 1;
   }
 
-  dprintf("set_impl: t=%p q=%p idx=%u avail=%u rate=%u qflags=%x flags=%x\n", t, q, idx, q->avail, q->rate, q->flags, flags);
+  dprintf("set_impl: t=%p q=%p idx=%u avail=%u byte_time=%f qflags=%x flags=%x\n", t, q, idx, q->avail, q->byte_time, q->flags, flags);
 
   if (new_avail && q->avail > 0
-      && ((q->flags & (FLAG_INSKIPLIST | FLAG_INNOLIMITL)) == 0)) {
+      && ((q->flags & (FLAG_INRATEL | FLAG_INNOLIMITL)) == 0)) {
     queue_activate(t, q, idx);
   }
 }
@@ -246,12 +348,25 @@ static inline void queue_activate_nolimit(struct qman_thread *t,
 {
   struct queue *q_tail;
 
-  assert((q->flags & (FLAG_INSKIPLIST | FLAG_INNOLIMITL)) == 0);
+  assert((q->flags & (FLAG_INRATEL | FLAG_INNOLIMITL)) == 0);
 
-  dprintf("queue_activate_nolimit: t=%p q=%p avail=%u rate=%u flags=%x\n", t, q, q->avail, q->rate, q->flags);
+  dprintf("queue_activate_nolimit: t=%p q=%p avail=%u byte_time=%f flags=%x\n", t, q, q->avail, q->byte_time, q->flags);
 
   q->flags |= FLAG_INNOLIMITL;
   q->next_idxs[0] = IDXLIST_INVAL;
+
+  /* with per-app fair queueing this is the app's ready list */
+  if (config.fp_qman_fair) {
+    struct qman_app *a = &t->apps[q->app];
+    if (a->tail_idx == IDXLIST_INVAL) {
+      a->head_idx = idx;
+    } else {
+      t->queues[a->tail_idx].next_idxs[0] = idx;
+    }
+    a->tail_idx = idx;
+    return;
+  }
+
   if (t->nolimit_tail_idx == IDXLIST_INVAL) {
     t->nolimit_head_idx = t->nolimit_tail_idx = idx;
     return;
@@ -264,7 +379,7 @@ static inline void queue_activate_nolimit(struct qman_thread *t,
 
 /** Poll no-limit queues */
 static inline unsigned poll_nolimit(struct qman_thread *t, uint32_t cur_ts,
-    unsigned num, unsigned *q_ids, uint16_t *q_bytes)
+    unsigned num, unsigned *q_ids, uint32_t *q_bytes)
 {
   unsigned cnt;
   struct queue *q;
@@ -279,7 +394,7 @@ static inline unsigned poll_nolimit(struct qman_thread *t, uint32_t cur_ts,
       t->nolimit_tail_idx = IDXLIST_INVAL;
 
     q->flags &= ~FLAG_INNOLIMITL;
-    dprintf("poll_nolimit: t=%p q=%p idx=%u avail=%u rate=%u flags=%x\n", t, q, idx, q->avail, q->rate, q->flags);
+    dprintf("poll_nolimit: t=%p q=%p idx=%u avail=%u byte_time=%f flags=%x\n", t, q, idx, q->avail, q->byte_time, q->flags);
     if (q->avail > 0) {
       queue_fire(t, q, idx, q_ids + cnt, q_bytes + cnt);
       cnt++;
@@ -295,22 +410,21 @@ static inline unsigned poll_nolimit(struct qman_thread *t, uint32_t cur_ts,
 static inline uint32_t queue_new_ts(struct qman_thread *t, struct queue *q,
     uint32_t bytes)
 {
-  return t->ts_virtual + ((uint64_t) bytes * 8 * 1000000) / q->rate;
+  float d = MIN(bytes * q->byte_time, (float) (1U << 31));
+  uint32_t ns = d;
+
+  /* a full size segment at 100G is only ~120ns, instead of truncating the
+   * fractional ns (and consistently sending too fast) round up with
+   * probability of the fraction, so queues hit their rate on average
+   * without having to keep the remainder in the queue state */
+  ns += (utils_rng_gen32(&t->rng) >> 8) < (uint32_t) ((d - ns) * 16777216.0f);
+  return t->ts_virtual + ns;
 }
 
-/** Add queue to the skip list list */
-static inline void queue_activate_skiplist(struct qman_thread *t,
-    struct queue *q, uint32_t q_idx)
+/** Clamp next_ts of queue about to be activated and return it */
+static inline uint32_t queue_clamp_ts(struct qman_thread *t, struct queue *q)
 {
-  uint8_t level;
-  int8_t l;
-  uint32_t preds[QMAN_SKIPLIST_LEVELS];
-  uint32_t pred, idx, ts, max_ts;
-
-  assert((q->flags & (FLAG_INSKIPLIST | FLAG_INNOLIMITL)) == 0);
-
-  dprintf("queue_activate_skiplist: t=%p q=%p idx=%u avail=%u rate=%u flags=%x ts_virt=%u next_ts=%u\n", t, q, q_idx, q->avail, q->rate, q->flags,
-      t->ts_virtual, q->next_ts);
+  uint32_t ts, max_ts;
 
   /* make sure queue has a reasonable next_ts:
    *  - not in the past
@@ -319,11 +433,29 @@ static inline void queue_activate_skiplist(struct qman_thread *t,
   ts = q->next_ts;
   max_ts = queue_new_ts(t, q, q->max_chunk);
   if (timestamp_lessthaneq(t, ts, t->ts_virtual)) {
-    ts = q->next_ts = t->ts_virtual;
+    ts = t->ts_virtual;
   } else if (!timestamp_lessthaneq(t, ts, max_ts)) {
-    ts = q->next_ts = max_ts;
+    ts = max_ts;
   }
   q->next_ts = ts;
+  return ts;
+}
+
+/** Add queue to the skip list list */
+static inline void queue_activate_skiplist(struct qman_thread *t,
+    struct queue *q, uint32_t q_idx)
+{
+  uint8_t level;
+  int8_t l;
+  uint32_t preds[QMAN_SKIPLIST_LEVELS];
+  uint32_t pred, idx, ts;
+
+  assert((q->flags & (FLAG_INRATEL | FLAG_INNOLIMITL)) == 0);
+
+  dprintf("queue_activate_skiplist: t=%p q=%p idx=%u avail=%u byte_time=%f flags=%x ts_virt=%u next_ts=%u\n", t, q, q_idx, q->avail, q->byte_time, q->flags,
+      t->ts_virtual, q->next_ts);
+
+  ts = queue_clamp_ts(t, q);
 
   /* find predecessors at all levels top-down */
   pred = IDXLIST_INVAL;
@@ -364,7 +496,7 @@ static inline void queue_activate_skiplist(struct qman_thread *t,
 
 /** Poll skiplist queues */
 static inline unsigned poll_skiplist(struct qman_thread *t, uint32_t cur_ts,
-    unsigned num, unsigned *q_ids, uint16_t *q_bytes)
+    unsigned num, unsigned *q_ids, uint32_t *q_bytes)
 {
   unsigned cnt;
   uint32_t idx, max_vts;
@@ -403,11 +535,10 @@ static inline unsigned poll_skiplist(struct qman_thread *t, uint32_t cur_ts,
     /* advance virtual timestamp */
     t->ts_virtual = q->next_ts;
 
-    dprintf("poll_skiplist: t=%p q=%p idx=%u avail=%u rate=%u flags=%x\n", t, q, idx, q->avail, q->rate, q->flags);
+    dprintf("poll_skiplist: t=%p q=%p idx=%u avail=%u byte_time=%f flags=%x\n", t, q, idx, q->avail, q->byte_time, q->flags);
 
     if (q->avail > 0) {
-      queue_fire(t, q, idx, q_ids + cnt, q_bytes + cnt);
-      cnt++;
+      cnt += queue_due(t, q, idx, q_ids + cnt, q_bytes + cnt);
     }
   }
 
@@ -435,9 +566,295 @@ static inline uint8_t queue_level(struct qman_thread *t)
 }
 
 /*****************************************************************************/
+/* Managing timing wheel queues */
+
+/* Two level hierarchical timing wheel: level 0 slots cover one slot width
+ * each, level 1 slots one full rotation of level 0. Queues due beyond the
+ * level 1 horizon are parked in its last slot and re-inserted on cascade. */
+
+/** Append queue to wheel slot list */
+static inline void wheel_append(struct qman_thread *t, uint32_t slot,
+    struct queue *q, uint32_t idx)
+{
+  q->next_idxs[0] = IDXLIST_INVAL;
+  if (t->wheel_tail[slot] == IDXLIST_INVAL) {
+    t->wheel_head[slot] = idx;
+  } else {
+    t->queues[t->wheel_tail[slot]].next_idxs[0] = idx;
+  }
+  t->wheel_tail[slot] = idx;
+}
+
+/** Add queue to the timing wheel */
+static inline void queue_activate_wheel(struct qman_thread *t,
+    struct queue *q, uint32_t idx)
+{
+  uint32_t ts, delta, grp, cur_grp;
+
+  assert((q->flags & (FLAG_INRATEL | FLAG_INNOLIMITL)) == 0);
+
+  dprintf("queue_activate_wheel: t=%p q=%p idx=%u avail=%u byte_time=%f flags=%x ts_virt=%u next_ts=%u\n", t, q, idx, q->avail, q->byte_time, q->flags,
+      t->ts_virtual, q->next_ts);
+
+  ts = queue_clamp_ts(t, q);
+  delta = rel_time(t->ts_virtual, ts) >> t->wheel_shift;
+
+  if (delta < QMAN_WHEEL_SLOTS) {
+    /* level 0 */
+    delta = (t->wheel_pos + delta) & (QMAN_WHEEL_SLOTS - 1);
+    wheel_append(t, delta, q, idx);
+    t->wheel_bmp[delta / 64] |= 1ULL << (delta % 64);
+  } else {
+    /* level 1, the current group's slot is the one being drained */
+    grp = (t->wheel_pos + delta) >> QMAN_WHEEL_BITS;
+    cur_grp = t->wheel_pos >> QMAN_WHEEL_BITS;
+    if (grp - cur_grp >= QMAN_WHEEL_SLOTS)
+      grp = cur_grp + QMAN_WHEEL_SLOTS - 1;
+    wheel_append(t, QMAN_WHEEL_SLOTS + (grp & (QMAN_WHEEL_SLOTS - 1)), q, idx);
+    t->wheel_l1_num++;
+  }
+
+  q->flags |= FLAG_INWHEEL;
+  t->wheel_num++;
+}
+
+/** Move queues in level 1 slot for the current group down to level 0 */
+static inline void wheel_cascade(struct qman_thread *t)
+{
+  uint32_t slot, idx, next;
+  struct queue *q;
+
+  slot = QMAN_WHEEL_SLOTS +
+    ((t->wheel_pos >> QMAN_WHEEL_BITS) & (QMAN_WHEEL_SLOTS - 1));
+  idx = t->wheel_head[slot];
+  t->wheel_head[slot] = t->wheel_tail[slot] = IDXLIST_INVAL;
+
+  for (; idx != IDXLIST_INVAL; idx = next) {
+    q = &t->queues[idx];
+    next = q->next_idxs[0];
+    q->flags &= ~FLAG_INWHEEL;
+    t->wheel_num--;
+    t->wheel_l1_num--;
+    queue_activate_wheel(t, q, idx);
+  }
+}
+
+/** First occupied level 0 slot >= slot, QMAN_WHEEL_SLOTS if none */
+static inline uint32_t wheel_next_slot(struct qman_thread *t, uint32_t slot)
+{
+  uint32_t w = slot / 64;
+  uint64_t m;
+
+  if (slot >= QMAN_WHEEL_SLOTS)
+    return QMAN_WHEEL_SLOTS;
+
+  m = t->wheel_bmp[w] & (~0ULL << (slot % 64));
+  while (m == 0) {
+    if (++w == QMAN_WHEEL_SLOTS / 64)
+      return QMAN_WHEEL_SLOTS;
+    m = t->wheel_bmp[w];
+  }
+  return w * 64 + __builtin_ctzll(m);
+}
+
+/** Advance wheel by up to n slots, stopping at the first occupied slot.
+ * Returns number of slots advanced. */
+static inline uint32_t wheel_advance(struct qman_thread *t, uint32_t n)
+{
+  uint32_t cur, step, left = n;
+
+  /* nothing queued, skip ahead directly */
+  if (t->wheel_num == 0) {
+    t->wheel_pos += n;
+    t->ts_virtual += n << t->wheel_shift;
+    return n;
+  }
+
+  while (left > 0) {
+    /* skip to next occupied slot, but stop at end of rotation to cascade */
+    cur = t->wheel_pos & (QMAN_WHEEL_SLOTS - 1);
+    step = wheel_next_slot(t, cur + 1) - cur;
+    step = MIN(step, left);
+
+    t->wheel_pos += step;
+    t->ts_virtual += step << t->wheel_shift;
+    left -= step;
+
+    if ((t->wheel_pos & (QMAN_WHEEL_SLOTS - 1)) == 0)
+      wheel_cascade(t);
+    if (t->wheel_head[t->wheel_pos & (QMAN_WHEEL_SLOTS - 1)] != IDXLIST_INVAL)
+      break;
+  }
+
+  return n - left;
+}
+
+/** Poll timing wheel queues */
+static inline unsigned poll_wheel(struct qman_thread *t, uint32_t cur_ts,
+    unsigned num, unsigned *q_ids, uint32_t *q_bytes)
+{
+  unsigned cnt;
+  uint32_t idx, slot, max_vts, n;
+  struct queue *q;
+
+  /* maximum virtual time stamp that can be reached */
+  max_vts = t->ts_virtual + (cur_ts - t->ts_real);
+  n = rel_time(t->ts_virtual, max_vts) >> t->wheel_shift;
+
+  for (cnt = 0; cnt < num;) {
+    slot = t->wheel_pos & (QMAN_WHEEL_SLOTS - 1);
+    idx = t->wheel_head[slot];
+
+    /* current slot empty, move on as far as real time allows */
+    if (idx == IDXLIST_INVAL) {
+      if (n == 0)
+        break;
+      n -= wheel_advance(t, n);
+      continue;
+    }
+
+    q = &t->queues[idx];
+    t->wheel_head[slot] = q->next_idxs[0];
+    if (q->next_idxs[0] == IDXLIST_INVAL) {
+      t->wheel_tail[slot] = IDXLIST_INVAL;
+      t->wheel_bmp[slot / 64] &= ~(1ULL << (slot % 64));
+    }
+    assert((q->flags & FLAG_INWHEEL) != 0);
+    q->flags &= ~FLAG_INWHEEL;
+    t->wheel_num--;
+
+    dprintf("poll_wheel: t=%p q=%p idx=%u avail=%u byte_time=%f flags=%x\n", t, q, idx, q->avail, q->byte_time, q->flags);
+
+    if (q->avail > 0) {
+      cnt += queue_due(t, q, idx, q_ids + cnt, q_bytes + cnt);
+    }
+  }
+
+  /* if we ran out of queues before time, carry the part of elapsed real time
+   * not covered by the slot-aligned virtual time over to the next poll */
+  if (cnt < num) {
+    t->ts_real = cur_ts - (max_vts - t->ts_virtual);
+  } else {
+    t->ts_real = cur_ts;
+  }
+  return cnt;
+}
+
+/*****************************************************************************/
+/* Per-application fair queueing */
+
+/** Refill app token buckets for rate limits */
+static inline void apps_refill(struct qman_thread *t, uint32_t cur_ts)
+{
+  struct qman_app *a;
+  uint32_t rate, elapsed;
+  uint64_t add;
+  unsigned i;
+
+  for (i = 0; i < FLEXNIC_PL_APPST_NUM; i++) {
+    a = &t->apps[i];
+    rate = fp_state->appst[i].qm_rate;
+    if (rate == 0) {
+      a->tokens = QMAN_APP_BURST;
+      a->ts = cur_ts;
+      continue;
+    }
+
+    /* bytes = ns * kbps / 8000000, elapsed capped at 1s to avoid overflow,
+     * leave ts alone if not even one byte accrued yet */
+    elapsed = MIN(cur_ts - a->ts, 1000000000U);
+    if ((add = ((uint64_t) elapsed * rate) / 8000000) == 0)
+      continue;
+
+    a->ts = cur_ts;
+    a->tokens = MIN((int64_t) a->tokens + (int64_t) add, QMAN_APP_BURST);
+  }
+}
+
+static inline void app_next(struct qman_thread *t)
+{
+  t->app_cur = (t->app_cur + 1) % FLEXNIC_PL_APPST_NUM;
+  t->app_started = false;
+}
+
+/** Poll application ready lists with DRR */
+static inline unsigned poll_apps(struct qman_thread *t, uint32_t cur_ts,
+    unsigned num, unsigned *q_ids, uint32_t *q_bytes)
+{
+  unsigned cnt = 0, idle = 0;
+  struct qman_app *a;
+  struct flextcp_pl_appst *ast;
+  struct queue *q;
+  uint32_t idx;
+
+  apps_refill(t, cur_ts);
+
+  /* stop once every app was passed over without sending */
+  while (cnt < num && idle < FLEXNIC_PL_APPST_NUM) {
+    a = &t->apps[t->app_cur];
+    ast = &fp_state->appst[t->app_cur];
+
+    /* skip apps without ready queues or over their rate limit */
+    if (a->head_idx == IDXLIST_INVAL || (ast->qm_rate != 0 && a->tokens <= 0))
+    {
+      if (a->head_idx == IDXLIST_INVAL)
+        a->deficit = 0;
+      app_next(t);
+      idle++;
+      continue;
+    }
+
+    /* first time app is served in this round */
+    if (!t->app_started) {
+      a->deficit += QMAN_APP_QUANTUM * (ast->qm_weight != 0 ? ast->qm_weight : 1);
+      t->app_started = true;
+    }
+
+    /* deficit used up (overdrawn by last chunk), on to next app */
+    if (a->deficit <= 0) {
+      app_next(t);
+      continue;
+    }
+
+    idx = a->head_idx;
+    q = &t->queues[idx];
+    a->head_idx = q->next_idxs[0];
+    if (a->head_idx == IDXLIST_INVAL)
+      a->tail_idx = IDXLIST_INVAL;
+    q->flags &= ~FLAG_INNOLIMITL;
+
+    dprintf("poll_apps: t=%p q=%p idx=%u app=%u avail=%u deficit=%d\n", t, q, idx, t->app_cur, q->avail, a->deficit);
+
+    if (q->avail > 0) {
+      queue_fire(t, q, idx, q_ids + cnt, q_bytes + cnt);
+      a->deficit -= q_bytes[cnt];
+      a->tokens -= q_bytes[cnt];
+      cnt++;
+      idle = 0;
+    }
+  }
+
+  return cnt;
+}
+
+/*****************************************************************************/
+
+/** Rate-limited queue is due: fire it, or with per-app fair queueing move it
+ * to its app's ready list. Returns number of queues fired. */
+static inline unsigned queue_due(struct qman_thread *t,
+    struct queue *q, uint32_t idx, unsigned *q_id, uint32_t *q_bytes)
+{
+  if (config.fp_qman_fair) {
+    queue_activate_nolimit(t, q, idx);
+    return 0;
+  }
+
+  queue_fire(t, q, idx, q_id, q_bytes);
+  return 1;
+}
 
 static inline void queue_fire(struct qman_thread *t,
-    struct queue *q, uint32_t idx, unsigned *q_id, uint16_t *q_bytes)
+    struct queue *q, uint32_t idx, unsigned *q_id, uint32_t *q_bytes)
 {
   uint32_t bytes;
 
@@ -446,8 +863,8 @@ static inline void queue_fire(struct qman_thread *t,
   bytes = (q->avail <= q->max_chunk ? q->avail : q->max_chunk);
   q->avail -= bytes;
 
-  dprintf("queue_fire: t=%p q=%p idx=%u gidx=%u bytes=%u avail=%u rate=%u\n", t, q, idx, idx, bytes, q->avail, q->rate);
-  if (q->rate > 0) {
+  dprintf("queue_fire: t=%p q=%p idx=%u gidx=%u bytes=%u avail=%u byte_time=%f\n", t, q, idx, idx, bytes, q->avail, q->byte_time);
+  if (q->byte_time > 0) {
     q->next_ts = queue_new_ts(t, q, bytes);
   }
 
@@ -469,8 +886,10 @@ static inline void queue_fire(struct qman_thread *t,
 static inline void queue_activate(struct qman_thread *t, struct queue *q,
     uint32_t idx)
 {
-  if (q->rate == 0) {
+  if (q->byte_time == 0) {
     queue_activate_nolimit(t, q, idx);
+  } else if (config.fp_qman_wheel != 0) {
+    queue_activate_wheel(t, q, idx);
   } else {
     queue_activate_skiplist(t, q, idx);
   }
@@ -478,15 +897,19 @@ static inline void queue_activate(struct qman_thread *t, struct queue *q,
 
 static inline uint32_t timestamp(void)
 {
-  static uint64_t freq = 0;
-  uint64_t cycles = rte_get_tsc_cycles();
+  return (rte_get_tsc_cycles() * tsc_ns_mult) >> 32;
+}
 
-  if (freq == 0)
-    freq = rte_get_tsc_hz();
+/* Time stamps are converted from the TSC with a 32.32 fixed point multiply
+ * instead of a 64 bit division. Only the low 32 bits of the time stamp are
+ * used, and these only depend on the low 64 bits of the product, so
+ * overflows in the multiplication do not matter. */
+static void timestamp_init(void)
+{
+  uint64_t freq = rte_get_tsc_hz();
 
-  cycles *= 1000000000ULL;
-  cycles /= freq;
-  return cycles;
+  tsc_ns_mult = (1000000000ULL << 32) / freq;
+  tsc_us_mult = (1000000ULL << 32) / freq;
 }
 
 /** Relative timestamp, ignoring wrap-arounds */
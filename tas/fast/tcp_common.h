@@ -228,6 +228,8 @@ static inline uint32_t tcp_txavail(const struct flextcp_pl_flowst *fs,
 struct tcp_opts {
   /** Timestamp option */
   struct tcp_timestamp_opt *ts;
+  /** SACK option */
+  struct tcp_sack_opt *sack;
 };
 
 /**
@@ -249,6 +251,7 @@ static inline int tcp_parse_options(const struct pkt_tcp *p, uint16_t len,
   uint8_t opt_kind, opt_len, opt_avail;
 
   opts->ts = NULL;
+  opts->sack = NULL;
 
   /* whole header not in buf */
   if (TCPH_HDRLEN(&p->tcp) < 5 || opts_len > (len - sizeof(*p))) {
@@ -280,6 +283,18 @@ static inline int tcp_parse_options(const struct pkt_tcp *p, uint16_t len,
         }
 
         opts->ts = (struct tcp_timestamp_opt *) (opt + off);
+      } else if (opt_kind == TCP_OPT_SACK) {
+        if (opt_len > opt_avail ||
+            opt_len < sizeof(struct tcp_sack_opt) +
+            sizeof(struct tcp_sack_block) ||
+            (opt_len - sizeof(struct tcp_sack_opt)) %
+            sizeof(struct tcp_sack_block) != 0)
+        {
+          fprintf(stderr, "parse_options: sack opt_len=%u\n", opt_len);
+          return -1;
+        }
+
+        opts->sack = (struct tcp_sack_opt *) (opt + off);
       }
     }
     off += opt_len;
@@ -0,0 +1,296 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Per-core timer wheel for flow timers
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rte_config.h>
+#include <rte_malloc.h>
+
+#include "internal.h"
+
+/* Two level hierarchical timer wheel like the queue manager's timing wheel:
+ * level 0 slots cover one microsecond each, level 1 slots one full rotation
+ * of level 0. Timers due beyond the level 1 horizon are parked in its last
+ * slot and re-inserted on cascade. Slots and the expired list are circular
+ * doubly linked lists through the next/prev arrays, with one list head entry
+ * each after the timers, so timers can be moved and cancelled in O(1). */
+
+/** Timer not linked into any list */
+#define TIMER_UNLINKED (-1U)
+/** Bitmap index of the expired list (has no bit) */
+#define TIMER_EXPIRED (2 * TIMER_WHEEL_SLOTS)
+
+/** First occupied slot >= slot of one level, TIMER_WHEEL_SLOTS if none */
+static inline uint32_t wheel_next_slot(const uint64_t *bmp, uint32_t slot)
+{
+  uint32_t w = slot / 64;
+  uint64_t m;
+
+  if (slot >= TIMER_WHEEL_SLOTS)
+    return TIMER_WHEEL_SLOTS;
+
+  m = bmp[w] & (~0ULL << (slot % 64));
+  while (m == 0) {
+    if (++w == TIMER_WHEEL_SLOTS / 64)
+      return TIMER_WHEEL_SLOTS;
+    m = bmp[w];
+  }
+  return w * 64 + __builtin_ctzll(m);
+}
+
+/** Append timer to list with head `head` */
+static inline void wheel_append(struct timer_wheel *w, uint32_t head,
+    uint32_t id)
+{
+  uint32_t last = w->prev[head];
+
+  w->next[last] = id;
+  w->prev[id] = last;
+  w->next[id] = head;
+  w->prev[head] = id;
+}
+
+/** Link timer into the slot for its deadline */
+static inline void wheel_insert(struct timer_wheel *w, uint32_t id)
+{
+  uint32_t deadline = w->ts[id], delta, grp, b;
+
+  delta = deadline - w->pos;
+  if ((int32_t) delta <= 0) {
+    b = TIMER_EXPIRED;
+  } else if (delta < TIMER_WHEEL_SLOTS) {
+    /* level 0 */
+    b = deadline & (TIMER_WHEEL_SLOTS - 1);
+    w->bmp[b / 64] |= 1ULL << (b % 64);
+  } else {
+    /* level 1, the current group's slot has already been cascaded */
+    grp = ((w->pos & (TIMER_WHEEL_SLOTS - 1)) + delta) >> TIMER_WHEEL_BITS;
+    if (grp >= TIMER_WHEEL_SLOTS)
+      grp = TIMER_WHEEL_SLOTS - 1;
+    grp += w->pos >> TIMER_WHEEL_BITS;
+    b = TIMER_WHEEL_SLOTS + (grp & (TIMER_WHEEL_SLOTS - 1));
+    w->bmp[b / 64] |= 1ULL << (b % 64);
+  }
+
+  wheel_append(w, w->timers + b, id);
+  w->num++;
+}
+
+/** Unlink timer, clearing the slot's bit if it was the last one */
+static inline void wheel_remove(struct timer_wheel *w, uint32_t id)
+{
+  uint32_t p = w->prev[id], n = w->next[id], b;
+
+  w->next[p] = n;
+  w->prev[n] = p;
+  w->next[id] = TIMER_UNLINKED;
+  w->num--;
+
+  if (p == n && (b = p - w->timers) < TIMER_EXPIRED)
+    w->bmp[b / 64] &= ~(1ULL << (b % 64));
+}
+
+/** Move all timers in slot `b` to the end of the expired list */
+static inline void wheel_expire(struct timer_wheel *w, uint32_t b)
+{
+  uint32_t head = w->timers + b, exp = w->timers + TIMER_EXPIRED;
+  uint32_t first = w->next[head], last = w->prev[head];
+
+  w->bmp[b / 64] &= ~(1ULL << (b % 64));
+
+  w->next[w->prev[exp]] = first;
+  w->prev[first] = w->prev[exp];
+  w->next[last] = exp;
+  w->prev[exp] = last;
+  w->next[head] = w->prev[head] = head;
+}
+
+/** Move timers in level 1 slot for the current group down to level 0 */
+static inline void wheel_cascade(struct timer_wheel *w)
+{
+  uint32_t b, head, id;
+
+  b = TIMER_WHEEL_SLOTS +
+    ((w->pos >> TIMER_WHEEL_BITS) & (TIMER_WHEEL_SLOTS - 1));
+  if ((w->bmp[b / 64] & (1ULL << (b % 64))) == 0)
+    return;
+
+  head = w->timers + b;
+  while ((id = w->next[head]) != head) {
+    wheel_remove(w, id);
+    wheel_insert(w, id);
+  }
+}
+
+int timer_wheel_init(struct timer_wheel *w, uint32_t num, int socket,
+    uint32_t ts)
+{
+  uint32_t i, n = num + TIMER_EXPIRED + 1;
+
+  if (num > UINT32_MAX - TIMER_EXPIRED - 1) {
+    fprintf(stderr, "timer_wheel_init: too many timers (%u)\n", num);
+    return -1;
+  }
+
+  if ((w->next = rte_malloc_socket("timer wheel", sizeof(*w->next) * n, 64,
+          socket)) == NULL ||
+      (w->prev = rte_malloc_socket("timer wheel", sizeof(*w->prev) * n, 64,
+          socket)) == NULL ||
+      (w->ts = rte_malloc_socket("timer wheel", sizeof(*w->ts) * num, 64,
+          socket)) == NULL)
+  {
+    fprintf(stderr, "timer_wheel_init: malloc failed\n");
+    return -1;
+  }
+
+  for (i = 0; i < num; i++) {
+    w->next[i] = TIMER_UNLINKED;
+  }
+  for (; i < n; i++) {
+    w->next[i] = w->prev[i] = i;
+  }
+  memset(w->bmp, 0, sizeof(w->bmp));
+  w->pos = ts;
+  w->num = 0;
+  w->timers = num;
+  return 0;
+}
+
+/** Arm timer to expire at `deadline` at the latest. A timer already armed
+ * for an earlier deadline is left alone, the owner re-arms it on expiry. */
+void timer_wheel_arm(struct timer_wheel *w, uint32_t id, uint32_t deadline)
+{
+  if (w->next[id] != TIMER_UNLINKED) {
+    if ((int32_t) (deadline - w->ts[id]) >= 0)
+      return;
+    wheel_remove(w, id);
+  }
+
+  w->ts[id] = deadline;
+  wheel_insert(w, id);
+}
+
+void timer_wheel_cancel(struct timer_wheel *w, uint32_t id)
+{
+  if (w->next[id] != TIMER_UNLINKED)
+    wheel_remove(w, id);
+}
+
+/** Advance wheel to `ts`, moving due timers to the expired list. Returns 1
+ * if there are expired timers. */
+int timer_wheel_advance(struct timer_wheel *w, uint32_t ts)
+{
+  uint32_t left = ts - w->pos, cur, step, grp, exp;
+  uint64_t *bmp1 = w->bmp + TIMER_WHEEL_SLOTS / 64;
+
+  exp = w->timers + TIMER_EXPIRED;
+  if (w->num == 0 || (int32_t) left <= 0) {
+    if ((int32_t) left > 0)
+      w->pos = ts;
+    return w->next[exp] != exp;
+  }
+
+  while (left > 0) {
+    /* skip to next occupied slot, but stop at end of rotation to cascade */
+    cur = w->pos & (TIMER_WHEEL_SLOTS - 1);
+    step = wheel_next_slot(w->bmp, cur + 1) - cur;
+    if (step > left) {
+      w->pos += left;
+      break;
+    }
+    w->pos += step;
+    left -= step;
+
+    if ((w->pos & (TIMER_WHEEL_SLOTS - 1)) == 0) {
+      wheel_cascade(w);
+
+      /* skip rotations without timers */
+      while (wheel_next_slot(w->bmp, 0) == TIMER_WHEEL_SLOTS) {
+        cur = (w->pos >> TIMER_WHEEL_BITS) & (TIMER_WHEEL_SLOTS - 1);
+        if ((grp = wheel_next_slot(bmp1, cur + 1)) == TIMER_WHEEL_SLOTS &&
+            (grp = wheel_next_slot(bmp1, 0)) == TIMER_WHEEL_SLOTS)
+        {
+          /* only expired timers left */
+          w->pos += left;
+          return w->next[exp] != exp;
+        }
+
+        step = ((grp - cur) & (TIMER_WHEEL_SLOTS - 1)) << TIMER_WHEEL_BITS;
+        if (step > left) {
+          w->pos += left;
+          return w->next[exp] != exp;
+        }
+        w->pos += step;
+        left -= step;
+        wheel_cascade(w);
+      }
+    }
+
+    cur = w->pos & (TIMER_WHEEL_SLOTS - 1);
+    if ((w->bmp[cur / 64] & (1ULL << (cur % 64))) != 0)
+      wheel_expire(w, cur);
+  }
+
+  return w->next[exp] != exp;
+}
+
+/** Take up to `num` timers off the expired list, returns their number */
+unsigned timer_wheel_expired(struct timer_wheel *w, uint32_t *ids,
+    unsigned num)
+{
+  uint32_t exp = w->timers + TIMER_EXPIRED, id;
+  unsigned n;
+
+  for (n = 0; n < num && (id = w->next[exp]) != exp; n++) {
+    wheel_remove(w, id);
+    ids[n] = id;
+  }
+  return n;
+}
+
+/** Time until the wheel has to be advanced next [us], -1U if empty */
+uint32_t timer_wheel_next_ts(struct timer_wheel *w, uint32_t cur_ts)
+{
+  uint32_t exp = w->timers + TIMER_EXPIRED, cur, slot, ts;
+
+  if (w->num == 0)
+    return -1U;
+  if (w->next[exp] != exp)
+    return 0;
+
+  /* next occupied level 0 slot in this rotation, otherwise the cascade at
+   * the end of the rotation */
+  cur = w->pos & (TIMER_WHEEL_SLOTS - 1);
+  if ((slot = wheel_next_slot(w->bmp, cur + 1)) != TIMER_WHEEL_SLOTS)
+    ts = w->pos + (slot - cur);
+  else
+    ts = w->pos + (TIMER_WHEEL_SLOTS - cur);
+
+  return ((int32_t) (ts - cur_ts) > 0 ? ts - cur_ts : 0);
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef XSUM_H_
+#define XSUM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Software internet checksums for NICs without checksum offload.
+ *
+ * Partial sums are 64 bit sums of little endian 32 bit words, vector lanes
+ * zero-extend 32 bit words to 64 bits so no carries are lost. Since
+ * 2^16 = 1 mod 0xffff, only the byte parity of a word's position matters,
+ * so folding the sum to 16 bits yields the checksum in network byte order.
+ * Partial sums of buffers starting at an odd offset into the checksummed
+ * data have to be passed through xsum_swap() before being combined.
+ */
+
+/** Fold 64 bit partial sum to 16 bits (not complemented) */
+static inline uint16_t xsum_fold(uint64_t sum)
+{
+  sum = (sum >> 32) + (sum & 0xffffffff);
+  sum += sum >> 32;
+  sum = (uint32_t) sum;
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum += sum >> 16;
+  return (uint16_t) sum;
+}
+
+/** Adjust partial sum of a buffer starting at an odd offset */
+static inline uint64_t xsum_swap(uint64_t sum)
+{
+  return __builtin_bswap16(xsum_fold(sum));
+}
+
+/* sum `len` bytes from `src`, also copying them to `dst` if `copy` is set
+ * (constant in all callers, so the branches are compiled out) */
+static inline uint64_t xsum_run(void *dst, const void *src, size_t len,
+    uint64_t sum, const int copy)
+{
+  const uint8_t *s = src;
+  uint8_t *d = dst;
+  uint64_t w;
+  uint32_t w32;
+  uint16_t w16;
+
+#if defined(__AVX512F__)
+  __m512i acc512 = _mm512_setzero_si512(), z512 = _mm512_setzero_si512();
+  __m512i v512;
+  for (; len >= 64; len -= 64, s += 64, d += 64) {
+    v512 = _mm512_loadu_si512((const void *) s);
+    if (copy)
+      _mm512_storeu_si512((void *) d, v512);
+    acc512 = _mm512_add_epi64(acc512, _mm512_unpacklo_epi32(v512, z512));
+    acc512 = _mm512_add_epi64(acc512, _mm512_unpackhi_epi32(v512, z512));
+  }
+  sum += _mm512_reduce_add_epi64(acc512);
+#endif
+
+#if defined(__AVX2__)
+  __m256i acc256 = _mm256_setzero_si256(), z256 = _mm256_setzero_si256();
+  __m256i v256;
+  for (; len >= 32; len -= 32, s += 32, d += 32) {
+    v256 = _mm256_loadu_si256((const __m256i *) s);
+    if (copy)
+      _mm256_storeu_si256((__m256i *) d, v256);
+    acc256 = _mm256_add_epi64(acc256, _mm256_unpacklo_epi32(v256, z256));
+    acc256 = _mm256_add_epi64(acc256, _mm256_unpackhi_epi32(v256, z256));
+  }
+  sum += (uint64_t) _mm256_extract_epi64(acc256, 0) +
+    (uint64_t) _mm256_extract_epi64(acc256, 1) +
+    (uint64_t) _mm256_extract_epi64(acc256, 2) +
+    (uint64_t) _mm256_extract_epi64(acc256, 3);
+#endif
+
+#if defined(__SSE2__)
+  __m128i acc128 = _mm_setzero_si128(), z128 = _mm_setzero_si128();
+  __m128i v128;
+  uint64_t lanes[2];
+  for (; len >= 16; len -= 16, s += 16, d += 16) {
+    v128 = _mm_loadu_si128((const __m128i *) s);
+    if (copy)
+      _mm_storeu_si128((__m128i *) d, v128);
+    acc128 = _mm_add_epi64(acc128, _mm_unpacklo_epi32(v128, z128));
+    acc128 = _mm_add_epi64(acc128, _mm_unpackhi_epi32(v128, z128));
+  }
+  _mm_storeu_si128((__m128i *) lanes, acc128);
+  sum += lanes[0] + lanes[1];
+#endif
+
+  /* scalar tail */
+  for (; len >= 8; len -= 8, s += 8, d += 8) {
+    memcpy(&w, s, 8);
+    if (copy)
+      memcpy(d, &w, 8);
+    sum += (w >> 32) + (w & 0xffffffff);
+  }
+  if (len >= 4) {
+    memcpy(&w32, s, 4);
+    if (copy)
+      memcpy(d, &w32, 4);
+    sum += w32;
+    len -= 4, s += 4, d += 4;
+  }
+  if (len >= 2) {
+    memcpy(&w16, s, 2);
+    if (copy)
+      memcpy(d, &w16, 2);
+    sum += w16;
+    len -= 2, s += 2, d += 2;
+  }
+  if (len > 0) {
+    if (copy)
+      *d = *s;
+    sum += *s;
+  }
+
+  return sum;
+}
+
+/** Add `len` bytes at `buf` to partial sum */
+static inline uint64_t xsum_partial(const void *buf, size_t len, uint64_t sum)
+{
+  return xsum_run((void *) buf, buf, len, sum, 0);
+}
+
+/** Copy `len` bytes from `src` to `dst` while adding them to partial sum */
+static inline uint64_t xsum_copy(void *dst, const void *src, size_t len,
+    uint64_t sum)
+{
+  return xsum_run(dst, src, len, sum, 1);
+}
+
+#endif /* ndef XSUM_H_ */
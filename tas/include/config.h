@@ -37,6 +37,8 @@ enum config_cc_algorithm {
   CONFIG_CC_TIMELY,
   /** Constant connection rate */
   CONFIG_CC_CONST_RATE,
+  /** Window-based DCTCP updated per ACK in the fast path */
+  CONFIG_CC_FP_DCTCP,
 };
 
 /** Struct containing the parsed configuration parameters */
@@ -61,10 +63,16 @@ struct configuration {
   uint32_t tcp_handshake_to;
   /** # of retries for dropped handshake packets */
   uint32_t tcp_handshake_retries;
+  /** Negotiate selective acknowledgements */
+  uint32_t tcp_sack;
+  /** Negotiate window scaling */
+  uint32_t tcp_wscale;
   /** IP address for this host */
   uint32_t ip;
   /** IP prefix length for this host */
   uint8_t ip_prefix;
+  /** MTU of the network interface [bytes] */
+  uint32_t ip_mtu;
   /** List of routes */
   struct config_route *routes;
   /** Initial ARP timeout in [us] */
@@ -115,6 +123,37 @@ struct configuration {
   uint32_t fp_interrupts;
   /** FP: tcp checksum offload enabled */
   uint32_t fp_xsumoffload;
+  /** FP: tcp segmentation offload (hardware or software GSO) enabled */
+  uint32_t fp_tso;
+  /** FP: coalesce received in-order segments of a flow in a batch */
+  uint32_t fp_gro;
+  /** FP: transmit payload directly from application buffers */
+  uint32_t fp_tx_zerocopy;
+  /** FP: place received payload with non-temporal (cache bypassing) stores */
+  uint32_t fp_rx_ntstore;
+  /** FP: upper bound for adaptive batch sizes */
+  uint32_t fp_batch_max;
+  /** FP: flows only accessed by owning core, no per-flow locks */
+  uint32_t fp_flow_owner;
+  /** FP: number of flow states */
+  uint32_t fp_flows;
+  /** FP: qman timing wheel slot width in ns (power of two), 0 for skiplist */
+  uint32_t fp_qman_wheel;
+  /** FP: qman schedules weighted fair across applications */
+  uint32_t fp_qman_fair;
+  /** FP: interval for moving flow groups between cores in us, 0 disables */
+  uint32_t fp_rebalance;
+  /** FP: split dma memory per NUMA node, interleave internal memory */
+  uint32_t fp_numa;
+  /** FP: full segments per delayed ack, 0 to ack every segment */
+  uint32_t fp_delack;
+  /** FP: delayed ack timeout in us, 0 to ack at end of rx batch */
+  uint32_t fp_delack_to;
+  /** FP: time-based loss detection (RACK) and tail loss probes */
+  uint32_t fp_rack;
+  /** FP: min. retransmission timeout for fast path retransmission timeouts
+   * and zero window probes [us], 0 to leave timeouts to the slow path */
+  uint32_t fp_rto;
   /** FP: auto scaling enabled */
   uint32_t fp_autoscale;
   /** FP: use huge pages for internal and buffer memory */
@@ -34,18 +34,64 @@
 #include <utils_rng.h>
 #include <stats.h>
 
-#define BATCH_SIZE 16
-#define BUFCACHE_SIZE 128
+/** Max. entries processed by one stage per loop iteration */
+#define BATCH_SIZE 64
+/** Lower bound for adaptive batch limits */
+#define BATCH_MIN 4
+#define BUFCACHE_SIZE 256
 #define TXBUF_SIZE (2 * BATCH_SIZE)
-
+/** Max. entries held back per core while forwarding rings are full, stages
+ * forwarding entries hand out at most TXBUF_SIZE per loop iteration */
+#define FWD_RETRY_NUM TXBUF_SIZE
+/** Max. arx entries parked per core while app rx queues are full */
+#define ARX_OVF_NUM 4096
+/** Buckets for looking up parked arx entries by flow */
+#define ARX_OVF_HT 1024
+/** Max. flow groups moved off a core per rebalancing round */
+#define REBALANCE_MOVES 8
+/** Flow timer wheel: log2 of #slots per level (two levels, 1us slots) */
+#define TIMER_WHEEL_BITS 10
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+
+
+struct rte_gso_ctx;
+struct arx_overflow;
+struct rte_mbuf_ext_shared_info;
 
 struct network_thread {
   struct rte_mempool *pool;
+  /** software segmentation context (NULL unless falling back to GSO) */
+  struct rte_gso_ctx *gso_ctx;
+  /** software segments the NIC did not take yet, sent first on next flush */
+  struct rte_mbuf **gso_pend;
+  uint16_t gso_pend_num;
+  /** shared info for mbufs attached to app transmit buffers (zero-copy) */
+  struct rte_mbuf_ext_shared_info *ext_shinfo;
   uint16_t queue_id;
 };
 
 /** Skiplist: #levels */
 #define QMAN_SKIPLIST_LEVELS 4
+/** Per-app fair queueing: DRR quantum per unit of weight [bytes] */
+#define QMAN_APP_QUANTUM (16 * 1024)
+/** Per-app fair queueing: max. burst for app rate limit [bytes] */
+#define QMAN_APP_BURST (128 * 1024)
+/** Timing wheel: log2 of #slots per level (two levels) */
+#define QMAN_WHEEL_BITS 10
+#define QMAN_WHEEL_SLOTS (1 << QMAN_WHEEL_BITS)
+
+/** Per-application queue manager state (--fp-qman-fair) */
+struct qman_app {
+  /** list of queues ready to send */
+  uint32_t head_idx;
+  uint32_t tail_idx;
+  /** DRR deficit [bytes] */
+  int32_t deficit;
+  /** tokens for rate limit [bytes] */
+  int32_t tokens;
+  /** time stamp of last token refill */
+  uint32_t ts;
+};
 
 struct qman_thread {
   /************************************/
@@ -61,14 +107,68 @@ struct qman_thread {
   uint32_t ts_virtual;
   struct utils_rng rng;
   bool nolimit_first;
+
+  /* timing wheel (--fp-qman-wheel), ts_virtual is kept slot-aligned */
+  /** list heads and tails: level 0 slots followed by level 1 slots */
+  uint32_t *wheel_head;
+  uint32_t *wheel_tail;
+  /** occupied level 0 slots */
+  uint64_t wheel_bmp[QMAN_WHEEL_SLOTS / 64];
+  /** current level 0 slot (absolute, wraps) */
+  uint32_t wheel_pos;
+  /** number of queues in wheel */
+  uint32_t wheel_num;
+  /** number of queues in level 1 */
+  uint32_t wheel_l1_num;
+  /** log2 of slot width in ns */
+  uint8_t wheel_shift;
+
+  /* per-app fair queueing (--fp-qman-fair) */
+  struct qman_app apps[FLEXNIC_PL_APPST_NUM];
+  /** app currently served by DRR */
+  uint8_t app_cur;
+  /** quantum already added for current app */
+  bool app_started;
+};
+
+
+/** Per-core timer wheel for flow timers */
+struct timer_wheel {
+  /** circular doubly linked lists: one entry per timer, followed by the list
+   * heads for level 0 slots, level 1 slots, and expired timers */
+  uint32_t *next;
+  uint32_t *prev;
+  /** deadline per timer [us] */
+  uint32_t *ts;
+  /** occupied slots: level 0 followed by level 1 */
+  uint64_t bmp[2 * TIMER_WHEEL_SLOTS / 64];
+  /** last level 0 slot processed, i.e. time stamp [us] */
+  uint32_t pos;
+  /** number of timers linked */
+  uint32_t num;
+  /** number of timers, index of first list head */
+  uint32_t timers;
 };
 
+/** Adaptive batch limit for one stage of the dataplane loop */
+struct dataplane_batch {
+  /** current limit */
+  uint16_t limit;
+  /** moving average of entries processed (4 fractional bits) */
+  uint16_t avg;
+};
 
 struct dataplane_context {
   struct network_thread net;
   struct qman_thread qman;
   struct rte_ring *qman_fwd_ring;
+  /** entries for full forwarding rings of other cores, with target core */
+  void *fwd_retry[FWD_RETRY_NUM];
+  uint16_t fwd_retry_core[FWD_RETRY_NUM];
+  uint16_t fwd_retry_num;
   uint16_t id;
+  /** NUMA socket of the core, for local allocations */
+  uint16_t socket_id;
   int evfd;
   struct rte_epoll_event ev;
 
@@ -76,8 +176,21 @@ struct dataplane_context {
   /* arx cache */
   struct flextcp_pl_arx arx_cache[BATCH_SIZE];
   uint16_t arx_ctx[BATCH_SIZE];
+  uint32_t arx_flow[BATCH_SIZE];
   uint16_t arx_num;
 
+  /* arx entries parked while app rx queues are full */
+  struct arx_overflow *arx_ovf;
+  /** app contexts with parked entries */
+  uint64_t arx_ovf_ctxs;
+  /** free parked entries */
+  uint32_t arx_ovf_avail;
+
+  /********************************************************/
+  /* delayed ack, loss detection, retransmission and window probe timers of
+   * flows handled on this core */
+  struct timer_wheel timers;
+
   /********************************************************/
   /* send buffer */
   struct network_buf_handle *tx_handles[TXBUF_SIZE];
@@ -86,6 +199,17 @@ struct dataplane_context {
   /********************************************************/
   /* polling queues */
   uint32_t poll_next_ctx;
+  /** app contexts with TX queue entries left from earlier doorbells */
+  uint64_t poll_pending;
+  /** app contexts with RX queue entries not yet freed by the app */
+  uint64_t rxq_outstanding;
+
+  /********************************************************/
+  /* adaptive batch limits for rx, queue manager, app queues, kernel */
+  struct dataplane_batch batch_rx;
+  struct dataplane_batch batch_qm;
+  struct dataplane_batch batch_qs;
+  struct dataplane_batch batch_sp;
 
   /********************************************************/
   /* pre-allocated buffers for polling doorbells and queue manager */
@@ -94,6 +218,8 @@ struct dataplane_context {
   uint16_t bufcache_head;
 
   uint64_t loadmon_cyc_busy;
+  /** packets and segments processed per flow group, for rebalancing */
+  uint32_t *fg_pkts;
 
   uint64_t kernel_drop;
 
@@ -108,6 +234,8 @@ int dataplane_init(void);
 int dataplane_context_init(struct dataplane_context *ctx);
 void dataplane_context_destroy(struct dataplane_context *ctx);
 void dataplane_loop(struct dataplane_context *ctx);
+int dataplane_flow_disable(uint32_t flow_id, uint32_t *tx_seq,
+    uint32_t *rx_seq, int *tx_closed, int *rx_closed, uint32_t ts);
 #ifdef DATAPLANE_STATS
 void dataplane_dump_stats(void);
 #endif
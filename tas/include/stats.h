@@ -74,6 +74,12 @@ struct dataplane_stats
   uint64_t stat_cyc_sp;
   uint64_t stat_cyc_tx;
 
+  /* App queue entries accessed on a remote NUMA node */
+  uint64_t stat_numa_remote;
+
+  /* Received segments dropped due to bad checksums */
+  uint64_t stat_rx_xsum_drop;
+
 #ifdef QUEUE_STATS
   /* Kernel -> Fastpath queue delay statistics */
   uint64_t stat_kin_cycles;
@@ -32,6 +32,12 @@ extern struct configuration config;
 
 extern void *tas_shm;
 extern struct flextcp_pl_mem *fp_state;
+extern struct flextcp_pl_flowst *fp_flowst;
+extern struct flextcp_pl_flowooo *fp_flowooo;
+extern struct flextcp_pl_flowsack *fp_flowsack;
+extern struct flextcp_pl_flowcc *fp_flowcc;
+extern struct flextcp_pl_flowhdr *fp_flowhdr;
+extern struct flextcp_pl_flowhtb *fp_flowht;
 extern struct flexnic_info *tas_info;
 #if RTE_VER_YEAR < 19
   extern struct ether_addr eth_addr;
@@ -40,6 +46,12 @@ extern struct flexnic_info *tas_info;
 #endif
 extern unsigned fp_cores_max;
 
+/** Max. number of NUMA nodes dma memory is split across */
+#define SHM_NUMA_MAX 8
+/** Number of per-node arenas in dma memory (1 without --fp-numa) */
+extern unsigned shm_numa_nodes;
+/** Size of each arena, the last one also gets the remainder */
+extern size_t shm_numa_arena;
 
 int slowpath_main(void);
 
@@ -56,7 +68,7 @@ void *util_create_shmsiszed(const char *name, size_t size, void *addr);
 
 /* should become config options */
 #define FLEXNIC_DMA_MEM_SIZE (1024 * 1024 * 1024)
-#define FLEXNIC_INTERNAL_MEM_SIZE (1024 * 1024 * 32)
-#define FLEXNIC_NUM_QMQUEUES (128 * 1024)
+/* one queue manager queue per flow */
+#define FLEXNIC_NUM_QMQUEUES (config.fp_flows)
 
 #endif /* ndef TAS_H_ */
@@ -29,6 +29,8 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <assert.h>
@@ -43,7 +45,22 @@
 
 void *tas_shm = NULL;
 struct flextcp_pl_mem *fp_state = NULL;
+struct flextcp_pl_flowst *fp_flowst = NULL;
+struct flextcp_pl_flowooo *fp_flowooo = NULL;
+struct flextcp_pl_flowsack *fp_flowsack = NULL;
+struct flextcp_pl_flowcc *fp_flowcc = NULL;
+struct flextcp_pl_flowhdr *fp_flowhdr = NULL;
+struct flextcp_pl_flowhtb *fp_flowht = NULL;
 struct flexnic_info *tas_info = NULL;
+unsigned shm_numa_nodes = 1;
+size_t shm_numa_arena = FLEXNIC_DMA_MEM_SIZE;
+
+/* size of internal memory region, depends on number of flows */
+static size_t fp_state_size;
+
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((uint64_t) (a) - 1))
+/** Internal memory is rounded up to a multiple of the huge page size */
+#define INTERNAL_MEM_ALIGN (2 * 1024 * 1024)
 
 /* destroy shared memory region */
 static void destroy_shm(const char *name, size_t size, void *addr);
@@ -53,10 +70,16 @@ static void *util_create_shmsiszed_huge(const char *name, size_t size,
 /* destroy shared huge page memory region */
 static void destroy_shm_huge(const char *name, size_t size, void *addr)
     __attribute__((used));
+/* lay out per-flow tables behind internal memory header */
+static size_t internal_mem_layout(struct flextcp_pl_mem *m, uint32_t flows);
+/* split dma memory into per-node arenas, interleave internal memory */
+static int numa_place(void);
 
 /* Allocate DMA memory before DPDK grabs all huge pages */
 int shm_preinit(void)
 {
+  struct flextcp_pl_mem layout;
+
   /* create shm for dma memory */
   if (config.fp_hugepages) {
     tas_shm = util_create_shmsiszed_huge(FLEXNIC_NAME_DMA_MEM,
@@ -71,12 +94,13 @@ int shm_preinit(void)
   }
 
   /* create shm for internal memory */
+  fp_state_size = internal_mem_layout(&layout, config.fp_flows);
   if (config.fp_hugepages) {
     fp_state = util_create_shmsiszed_huge(FLEXNIC_NAME_INTERNAL_MEM,
-        FLEXNIC_INTERNAL_MEM_SIZE, NULL);
+        fp_state_size, NULL);
   } else {
     fp_state = util_create_shmsiszed(FLEXNIC_NAME_INTERNAL_MEM,
-        FLEXNIC_INTERNAL_MEM_SIZE, NULL);
+        fp_state_size, NULL);
   }
   if (fp_state == NULL) {
     fprintf(stderr, "mapping flexnic internal memory failed\n");
@@ -84,6 +108,33 @@ int shm_preinit(void)
     return -1;
   }
 
+  if (config.fp_numa && numa_place() != 0) {
+    fprintf(stderr, "placing shared memory on NUMA nodes failed\n");
+    shm_cleanup();
+    return -1;
+  }
+
+  fp_state->flowst_num = layout.flowst_num;
+  fp_state->flowht_num = layout.flowht_num;
+  fp_state->flowst_off = layout.flowst_off;
+  fp_state->flowooo_off = layout.flowooo_off;
+  fp_state->flowsack_off = layout.flowsack_off;
+  fp_state->flowcc_off = layout.flowcc_off;
+  fp_state->flowhdr_off = layout.flowhdr_off;
+  fp_state->flowht_off = layout.flowht_off;
+
+  fp_flowst = FLEXNIC_PL_MEM_TABLE(fp_state, struct flextcp_pl_flowst, flowst);
+#ifdef FLEXNIC_PL_OOO_RECV
+  fp_flowooo = FLEXNIC_PL_MEM_TABLE(fp_state, struct flextcp_pl_flowooo,
+      flowooo);
+#endif
+  fp_flowsack = FLEXNIC_PL_MEM_TABLE(fp_state, struct flextcp_pl_flowsack,
+      flowsack);
+  fp_flowcc = FLEXNIC_PL_MEM_TABLE(fp_state, struct flextcp_pl_flowcc, flowcc);
+  fp_flowhdr = FLEXNIC_PL_MEM_TABLE(fp_state, struct flextcp_pl_flowhdr,
+      flowhdr);
+  fp_flowht = FLEXNIC_PL_MEM_TABLE(fp_state, struct flextcp_pl_flowhtb, flowht);
+
   return 0;
 }
 
@@ -100,7 +151,7 @@ int shm_init(unsigned num)
   }
 
   tas_info->dma_mem_size = FLEXNIC_DMA_MEM_SIZE;
-  tas_info->internal_mem_size = FLEXNIC_INTERNAL_MEM_SIZE;
+  tas_info->internal_mem_size = fp_state_size;
   tas_info->qmq_num = FLEXNIC_NUM_QMQUEUES;
   tas_info->cores_num = num;
   tas_info->mac_address = 0;
@@ -116,11 +167,9 @@ void shm_cleanup(void)
   /* cleanup internal memory region */
   if (fp_state != NULL) {
     if (config.fp_hugepages) {
-      destroy_shm_huge(FLEXNIC_NAME_INTERNAL_MEM, FLEXNIC_INTERNAL_MEM_SIZE,
-          fp_state);
+      destroy_shm_huge(FLEXNIC_NAME_INTERNAL_MEM, fp_state_size, fp_state);
     } else {
-      destroy_shm(FLEXNIC_NAME_INTERNAL_MEM, FLEXNIC_INTERNAL_MEM_SIZE,
-          fp_state);
+      destroy_shm(FLEXNIC_NAME_INTERNAL_MEM, fp_state_size, fp_state);
     }
   }
 
@@ -144,6 +193,95 @@ void shm_set_ready(void)
   tas_info->flags |= FLEXNIC_FLAG_READY;
 }
 
+static size_t internal_mem_layout(struct flextcp_pl_mem *m, uint32_t flows)
+{
+  uint64_t off = ALIGN_UP(sizeof(*m), 64);
+
+  m->flowst_num = flows;
+  m->flowht_num = FLEXNIC_PL_FLOWHT_BUCKETS(flows);
+
+  m->flowst_off = off;
+  off = ALIGN_UP(off + (uint64_t) flows * sizeof(struct flextcp_pl_flowst), 64);
+
+#ifdef FLEXNIC_PL_OOO_RECV
+  m->flowooo_off = off;
+  off = ALIGN_UP(off + (uint64_t) flows * sizeof(struct flextcp_pl_flowooo),
+      64);
+#else
+  m->flowooo_off = 0;
+#endif
+
+  m->flowsack_off = off;
+  off = ALIGN_UP(off + (uint64_t) flows * sizeof(struct flextcp_pl_flowsack),
+      64);
+
+  m->flowcc_off = off;
+  off = ALIGN_UP(off + (uint64_t) flows * sizeof(struct flextcp_pl_flowcc),
+      64);
+
+  m->flowhdr_off = off;
+  off = ALIGN_UP(off + (uint64_t) flows * sizeof(struct flextcp_pl_flowhdr),
+      64);
+
+  m->flowht_off = off;
+  off += (uint64_t) m->flowht_num * sizeof(struct flextcp_pl_flowhtb);
+
+  return ALIGN_UP(off, INTERNAL_MEM_ALIGN);
+}
+
+/* number of NUMA nodes, assumes they are numbered contiguously */
+static unsigned numa_nodes(void)
+{
+  FILE *f;
+  unsigned lo, hi;
+  int n;
+
+  if ((f = fopen("/sys/devices/system/node/online", "r")) == NULL)
+    return 1;
+  n = fscanf(f, "%u-%u", &lo, &hi);
+  fclose(f);
+
+  if (n != 2 || hi < lo)
+    return 1;
+  return MIN(hi + 1, SHM_NUMA_MAX);
+}
+
+/* apply memory policy to range, moving pages already populated */
+static int numa_mbind(void *addr, size_t len, int mode, unsigned long mask)
+{
+  if (syscall(SYS_mbind, addr, len, mode, &mask, sizeof(mask) * 8,
+        MPOL_MF_MOVE) != 0)
+  {
+    fprintf(stderr, "numa_mbind: mbind failed (%s)\n", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+static int numa_place(void)
+{
+  unsigned i;
+  size_t len;
+
+  shm_numa_nodes = numa_nodes();
+  shm_numa_arena = (FLEXNIC_DMA_MEM_SIZE / shm_numa_nodes) &
+    ~((size_t) INTERNAL_MEM_ALIGN - 1);
+
+  for (i = 0; i < shm_numa_nodes; i++) {
+    len = (i == shm_numa_nodes - 1 ?
+        FLEXNIC_DMA_MEM_SIZE - i * shm_numa_arena : shm_numa_arena);
+    if (numa_mbind((uint8_t *) tas_shm + i * shm_numa_arena, len, MPOL_BIND,
+          1UL << i) != 0)
+    {
+      return -1;
+    }
+  }
+
+  /* flow state is accessed by all cores */
+  return numa_mbind(fp_state, fp_state_size, MPOL_INTERLEAVE,
+      (1UL << shm_numa_nodes) - 1);
+}
+
 void *util_create_shmsiszed(const char *name, size_t size, void *addr)
 {
   int fd;
@@ -161,7 +161,8 @@ unsigned appif_poll(void)
       }
 
       if (nicif_appctx_add(app->id, ctx->doorbell->id, rxq_offs,
-            app->req.rxq_len, txq_offs, app->req.txq_len, ctx->evfd) != 0)
+            app->req.rxq_len, txq_offs, app->req.txq_len, ctx->evfd,
+            ctx->numa_node) != 0)
       {
         fprintf(stderr, "appif_poll: registering context failed\n");
         uxsocket_error(app);
@@ -464,7 +465,7 @@ static void uxsocket_receive(struct application *app)
   uintptr_t off_in, off_out, off_rxq, off_txq;
   size_t kin_qsize, kout_qsize, ctx_sz;
   struct epoll_event ev;
-  uint16_t i;
+  uint16_t i, node;
   int evfd = 0;
 
   /* receive data to hopefully complete request */
@@ -518,25 +519,26 @@ static void uxsocket_receive(struct application *app)
   kout_qsize = config.app_kout_len;
 
   /* allocate packet memory for kernel queues */
-  if (packetmem_alloc(kin_qsize, &off_in, &pm_in) != 0) {
+  node = app->req.numa_node;
+  if (packetmem_alloc_node(kin_qsize, node, &off_in, &pm_in) != 0) {
     fprintf(stderr, "uxsocket_receive: packetmem_alloc in failed\n");
     goto error_pktmem_in;
   }
-  if (packetmem_alloc(kout_qsize, &off_out, &pm_out) != 0) {
+  if (packetmem_alloc_node(kout_qsize, node, &off_out, &pm_out) != 0) {
     fprintf(stderr, "uxsocket_receive: packetmem_alloc out failed\n");
     goto error_pktmem_out;
   }
 
   /* allocate packet memory for flexnic queues */
   for (i = 0; i < tas_info->cores_num; i++) {
-    if (packetmem_alloc(app->req.rxq_len, &off_rxq, &ctx->handles[i].rxq)
-        != 0)
+    if (packetmem_alloc_node(app->req.rxq_len, node, &off_rxq,
+          &ctx->handles[i].rxq) != 0)
     {
       fprintf(stderr, "uxsocket_receive: packetmem_alloc rxq failed\n");
       goto error_pktmem;
     }
-    if (packetmem_alloc(app->req.txq_len, &off_txq, &ctx->handles[i].txq)
-        != 0)
+    if (packetmem_alloc_node(app->req.txq_len, node, &off_txq,
+          &ctx->handles[i].txq) != 0)
     {
       fprintf(stderr, "uxsocket_receive: packetmem_alloc txq failed\n");
       packetmem_free(ctx->handles[i].rxq);
@@ -571,6 +573,7 @@ static void uxsocket_receive(struct application *app)
   ctx->kout_pos = 0;
   memset(ctx->kout_base, 0, kout_qsize);
 
+  ctx->numa_node = node;
   ctx->ready = 0;
   assert(evfd != 0);	// XXX: Will be 0 if request was broken up
   ctx->evfd = evfd;
@@ -53,6 +53,7 @@ struct app_context {
 
   int ready, evfd;
   uint32_t last_ts;
+  uint16_t numa_node;
   struct app_context *next;
 
   struct {
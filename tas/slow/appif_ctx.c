@@ -49,6 +49,8 @@ static int kin_accept_conn(struct application *app, struct app_context *ctx,
     volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
 static int kin_req_scale(struct application *app, struct app_context *ctx,
     volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
+static int kin_app_sched(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
 extern struct connection *conn_ht_lookup(uint64_t opaque, uint32_t local_ip,
            uint32_t remote_ip, uint16_t local_port, uint16_t remote_port);
 
@@ -341,6 +343,11 @@ unsigned appif_ctx_poll(struct application *app, struct app_context *ctx)
       STATS_ADD(slowpath_ctx, cyc_kreq_scale, end_req_scale-start);
       break;
 
+    case KERNEL_APPOUT_APP_SCHED:
+      /* app scheduling parameters */
+      kout_inc += kin_app_sched(app, ctx, kin, kout);
+      break;
+
     case KERNEL_APPOUT_LISTEN_CLOSE:
     default:
       fprintf(stderr, "kin_poll: unsupported request type %u\n", kin->type);
@@ -572,3 +579,12 @@ static int kin_req_scale(struct application *app, struct app_context *ctx,
 
   return 0;
 }
+
+static int kin_app_sched(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout)
+{
+  nicif_app_sched(app->id, kin->data.app_sched.weight,
+      kin->data.app_sched.rate);
+
+  return 0;
+}
@@ -57,6 +57,10 @@ static inline void const_rate_init(struct connection *c);
 static inline void const_rate_update(struct connection *c,
     struct nicif_connection_stats *stats, uint32_t diff_ts, uint32_t cur_ts);
 
+static inline void fp_dctcp_init(struct connection *c);
+static inline void fp_dctcp_update(struct connection *c,
+    struct nicif_connection_stats *stats, uint32_t diff_ts, uint32_t cur_ts);
+
 static inline uint32_t window_to_rate(uint32_t window, uint32_t rtt);
 
 static uint32_t last_ts = 0;
@@ -156,6 +160,10 @@ unsigned cc_poll(uint32_t cur_ts)
         const_rate_update(c, &stats, diff_ts, cur_ts);
         break;
 
+      case CONFIG_CC_FP_DCTCP:
+        fp_dctcp_update(c, &stats, diff_ts, cur_ts);
+        break;
+
       default:
         fprintf(stderr, "cc_poll: unknown CC algorithm (%u)\n",
             config.cc_algorithm);
@@ -163,7 +171,9 @@ unsigned cc_poll(uint32_t cur_ts)
         break;
     }
 
-    issue_retransmits(c, &stats, cur_ts);
+    /* with fast path retransmission timeouts only supervise the rate */
+    if (config.fp_rto == 0)
+      issue_retransmits(c, &stats, cur_ts);
     nicif_connection_setrate(c->flow_id, c->cc_rate);
 
     c->cc_last_ts = cur_ts;
@@ -207,6 +217,10 @@ void cc_conn_init(struct connection *conn)
       const_rate_init(conn);
       break;
 
+    case CONFIG_CC_FP_DCTCP:
+      fp_dctcp_init(conn);
+      break;
+
     default:
       fprintf(stderr, "cc_conn_init: unknown CC algorithm (%u)\n",
           config.cc_algorithm);
@@ -617,3 +631,36 @@ static inline void const_rate_update(struct connection *c,
   c->cc_rtt = (stats->rtt != 0 ? stats->rtt : config.tcp_rtt_init);
   c->cc_rexmits = 0;
 }
+
+/******************************************************************************/
+/* Fast path DCTCP: the window is updated per ACK and enforced in the fast
+ * path, here we only derive the pacing rate from it. */
+
+/** Pace at this multiple of the window's rate, so pacing only spreads out
+ * bursts while the window reacts to congestion */
+#define FP_DCTCP_PACING 2
+/** Initial fast path window [segments] (see nicif_connection_add) */
+#define FP_DCTCP_INIT_SEGS 2
+
+static inline void fp_dctcp_init(struct connection *c)
+{
+  /* segment payload as in the fast path, the timestamp option is in every
+   * segment */
+  uint32_t mss = c->mss - ((sizeof(struct tcp_timestamp_opt) + 3) & ~3);
+
+  c->cc_rate = window_to_rate(FP_DCTCP_PACING * FP_DCTCP_INIT_SEGS * mss,
+      config.tcp_rtt_init);
+}
+
+static inline void fp_dctcp_update(struct connection *c,
+    struct nicif_connection_stats *stats, uint32_t diff_ts, uint32_t cur_ts)
+{
+  uint32_t rtt = (stats->rtt != 0 ? stats->rtt : config.tcp_rtt_init);
+  uint32_t win = MIN(stats->cwnd, UINT32_MAX / FP_DCTCP_PACING);
+
+  c->cc_rtt = rtt;
+  c->cc_rate = window_to_rate(FP_DCTCP_PACING * win, rtt);
+  if (c->cc_rate < config.cc_dctcp_min)
+    c->cc_rate = config.cc_dctcp_min;
+  c->cc_rexmits = 0;
+}
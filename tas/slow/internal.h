@@ -101,16 +101,34 @@ unsigned nicif_poll(void);
  * @param txq_base Base addresses of context transmit queue
  * @param txq_len  Length of context transmit queue
  * @param evfd     Event FD used to ping app
+ * @param node     NUMA node the app context is used on
  *
  * @return 0 on success, <0 else
  */
 int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
-    uint32_t rxq_len, uint64_t *txq_base, uint32_t txq_len, int evfd);
+    uint32_t rxq_len, uint64_t *txq_base, uint32_t txq_len, int evfd,
+    uint16_t node);
+
+/**
+ * Set fast path scheduling parameters for application, only used with
+ * --fp-qman-fair.
+ *
+ * @param appid  Application ID
+ * @param weight Weight relative to other applications
+ * @param rate   Rate limit per fast path core [Kbps], 0 for none
+ *
+ * @return 0 on success, <0 else
+ */
+int nicif_app_sched(uint16_t appid, uint16_t weight, uint32_t rate);
 
 /** Flags for connections (used in nicif_connection_add()) */
 enum nicif_connection_flags {
   /** Enable ECN for connection. */
   NICIF_CONN_ECN        = (1 <<  2),
+  /** Enable selective acknowledgements for connection. */
+  NICIF_CONN_SACK       = (1 <<  3),
+  /** Window scaling negotiated for connection. */
+  NICIF_CONN_WSCALE     = (1 <<  4),
 };
 
 /**
@@ -130,6 +148,9 @@ enum nicif_connection_flags {
  * @param local_seq   Next sequence number for transmission
  * @param app_opaque  Opaque value to pass in notificaitions
  * @param flags       See #nicif_connection_flags.
+ * @param rx_wscale   Shift for receive window advertised to remote host
+ * @param tx_wscale   Shift for windows advertised by remote host
+ * @param mss         Negotiated maximum segment size
  * @param rate        Congestion rate to set [Kbps]
  * @param fn_core     FlexNIC emulator core for the connection
  * @param flow_group  Flow group
@@ -141,8 +162,8 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
     uint16_t port_local, uint32_t ip_remote, uint16_t port_remote,
     uint64_t rx_base, uint32_t rx_len, uint64_t tx_base, uint32_t tx_len,
     uint32_t remote_seq, uint32_t local_seq, uint64_t app_opaque,
-    uint32_t flags, uint32_t rate, uint32_t fn_core, uint16_t flow_group,
-    uint32_t *pf_id);
+    uint32_t flags, uint8_t rx_wscale, uint8_t tx_wscale, uint16_t mss,
+    uint32_t rate, uint32_t fn_core, uint16_t flow_group, uint32_t *pf_id);
 
 /**
  * Disable connection fast path (mark as sp'd and remove from hash table).
@@ -192,6 +213,8 @@ struct nicif_connection_stats {
   int txp;
   /** Current rtt estimate */
   uint32_t rtt;
+  /** Congestion window of fast path congestion control [bytes] */
+  uint32_t cwnd;
 };
 
 /**
@@ -279,6 +302,22 @@ int packetmem_init(void);
 int packetmem_alloc(size_t length, uintptr_t *off,
     struct packetmem_handle **handle);
 
+/**
+ * Allocate packet memory, preferably on the specified NUMA node (only differs
+ * from packetmem_alloc() with --fp-numa).
+ *
+ * @param length  Required number of bytes
+ * @param node    Preferred NUMA node
+ * @param off     Pointer to location where offset in DMA region should be
+ *                stored
+ * @param handle  Pointer to location where handle for memory region should be
+ *                stored
+ *
+ * @return 0 on success, <0 else
+ */
+int packetmem_alloc_node(size_t length, uint16_t node, uintptr_t *off,
+    struct packetmem_handle **handle);
+
 /**
  * Free packet memory region.
  *
@@ -476,6 +515,12 @@ struct connection {
     uint32_t local_seq;
     /** Timestamp received with SYN/SYN-ACK packet */
     uint32_t syn_ts;
+    /** Window scale shift for our receive window (0 if not negotiated) */
+    uint8_t rx_wscale;
+    /** Window scale shift for peer's receive window (0 if not negotiated) */
+    uint8_t tx_wscale;
+    /** Maximum segment size (min. of ours and peer's) */
+    uint16_t mss;
   /**@}*/
 
   /**
@@ -35,13 +35,16 @@
 #include <utils_sync.h>
 #include <utils_log.h>
 #include <stats.h>
+#include <fastpath.h>
 #include <slowpath.h>
 #include "internal.h"
 
 #include <rte_config.h>
 #include <rte_hash_crc.h>
 
-#define PKTBUF_SIZE 1536
+/** Kernel packet buffers hold a full frame (at least 1536 bytes) */
+#define PKTBUF_SIZE \
+  ((MAX(1536, config.ip_mtu + sizeof(struct eth_hdr)) + 63) & ~63ULL)
 
 struct nic_buffer {
   uint64_t addr;
@@ -62,14 +65,28 @@ static inline volatile struct flextcp_pl_ktx *ktx_try_alloc(uint32_t core,
     struct nic_buffer **buf, uint32_t *new_tail);
 static inline uint32_t flow_hash(ip_addr_t lip, beui16_t lp,
     ip_addr_t rip, beui16_t rp);
-static inline int flow_slot_alloc(uint32_t h, uint32_t *i, uint32_t *d);
+static inline int flow_slot_alloc(uint32_t h, uint32_t *b, uint32_t *s);
 static inline int flow_slot_clear(uint32_t f_id, ip_addr_t lip, beui16_t lp,
     ip_addr_t rip, beui16_t rp);
-static void flow_id_alloc_init(void);
+static int flow_id_alloc_init(void);
 static int flow_id_alloc(uint32_t *fid);
 static void flow_id_free(uint32_t flow_id);
+static void flow_hdr_init(uint32_t f_id, uint64_t mac_remote, beui32_t lip,
+    beui16_t lp, beui32_t rip, beui16_t rp);
+
+/** Max. buckets visited when looking for a cuckoo displacement path */
+#define FLOW_SLOT_PATH_MAX 256
+
+/** Bucket visited by flow_slot_alloc() */
+struct flow_slot_path {
+  uint32_t bucket;
+  /** index of bucket this was reached from, -1 for candidate buckets */
+  int16_t parent;
+  /** slot in parent bucket whose entry moves here */
+  uint8_t slot;
+};
 
-struct flow_id_item flow_id_items[FLEXNIC_PL_FLOWST_NUM];
+struct flow_id_item *flow_id_items;
 struct flow_id_item *flow_id_freelist;
 
 static uint32_t fn_cores;
@@ -113,7 +130,10 @@ int nicif_init(void)
   }
 
   /* prepare flow_id allocator */
-  flow_id_alloc_init();
+  if (flow_id_alloc_init()) {
+    fprintf(stderr, "nicif_init: flow_id_alloc_init failed\n");
+    return -1;
+  }
 
   if (adminq_init()) {
     fprintf(stderr, "nicif_init: initializing admin queue failed\n");
@@ -149,7 +169,8 @@ unsigned nicif_poll(void)
 
 /** Register application context */
 int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
-    uint32_t rxq_len, uint64_t *txq_base, uint32_t txq_len, int evfd)
+    uint32_t rxq_len, uint64_t *txq_base, uint32_t txq_len, int evfd,
+    uint16_t node)
 {
   struct flextcp_pl_appctx *actx;
   struct flextcp_pl_appst *ast = &fp_state->appst[appid];
@@ -174,6 +195,7 @@ int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
     actx->tx_base = txq_base[i];
     actx->rx_avail = rxq_len;
     actx->evfd = evfd;
+    actx->numa_node = node;
   }
 
   MEM_BARRIER();
@@ -192,19 +214,37 @@ int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
   return 0;
 }
 
+/** Set app scheduling parameters */
+int nicif_app_sched(uint16_t appid, uint16_t weight, uint32_t rate)
+{
+  struct flextcp_pl_appst *ast;
+
+  if (appid >= FLEXNIC_PL_APPST_NUM) {
+    fprintf(stderr, "nicif_app_sched: app id too high (%u, max=%u)\n", appid,
+        FLEXNIC_PL_APPST_NUM);
+    return -1;
+  }
+
+  ast = &fp_state->appst[appid];
+  ast->qm_weight = weight;
+  ast->qm_rate = rate;
+  return 0;
+}
+
 /** Register flow */
 int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
     uint16_t port_local, uint32_t ip_remote, uint16_t port_remote,
     uint64_t rx_base, uint32_t rx_len, uint64_t tx_base, uint32_t tx_len,
     uint32_t remote_seq, uint32_t local_seq, uint64_t app_opaque,
-    uint32_t flags, uint32_t rate, uint32_t fn_core, uint16_t flow_group,
-    uint32_t *pf_id)
+    uint32_t flags, uint8_t rx_wscale, uint8_t tx_wscale, uint16_t mss,
+    uint32_t rate, uint32_t fn_core, uint16_t flow_group, uint32_t *pf_id)
 {
   struct flextcp_pl_flowst *fs;
+  struct flextcp_pl_flowcc *cc;
   beui32_t lip = t_beui32(ip_local), rip = t_beui32(ip_remote);
   beui16_t lp = t_beui16(port_local), rp = t_beui16(port_remote);
-  uint32_t i, d, f_id, hash;
-  struct flextcp_pl_flowhte *hte = fp_state->flowht;
+  uint32_t b, s, f_id, hash;
+  struct flextcp_pl_flowhtb *htb;
 
   /* allocate flow id */
   if (flow_id_alloc(&f_id) != 0) {
@@ -214,19 +254,22 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
 
   /* calculate hash and find empty slot */
   hash = flow_hash(lip, lp, rip, rp);
-  if (flow_slot_alloc(hash, &i, &d) != 0) {
+  if (flow_slot_alloc(hash, &b, &s) != 0) {
     flow_id_free(f_id);
     fprintf(stderr, "nicif_connection_add: allocating slot failed\n");
     return -1;
   }
-  assert(i < FLEXNIC_PL_FLOWHT_ENTRIES);
-  assert(d < FLEXNIC_PL_FLOWHT_NBSZ);
+  assert(b < fp_state->flowht_num);
+  assert(s < FLEXNIC_PL_FLOWHT_BSZ);
 
   if ((flags & NICIF_CONN_ECN) == NICIF_CONN_ECN) {
     rx_base |= FLEXNIC_PL_FLOWST_ECN;
   }
+  if ((flags & NICIF_CONN_SACK) == NICIF_CONN_SACK) {
+    rx_base |= FLEXNIC_PL_FLOWST_SACK;
+  }
 
-  fs = &fp_state->flowst[f_id];
+  fs = &fp_flowst[f_id];
   fs->opaque = app_opaque;
   fs->rx_base_sp = rx_base;
   fs->tx_base = tx_base;
@@ -248,6 +291,15 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
   fs->rx_next_pos = 0;
   fs->rx_next_seq = remote_seq;
   fs->rx_remote_avail = rx_len; /* XXX */
+  fs->rx_wscale = rx_wscale;
+  fs->tx_wscale = tx_wscale;
+  /* data segments always carry the (padded) timestamp option */
+  fs->tx_mss = mss - ((sizeof(struct tcp_timestamp_opt) + 3) & ~3);
+#ifdef FLEXNIC_PL_OOO_RECV
+  fs->rx_ooo_len = 0;
+#endif
+  fp_flowsack[f_id].len[0] = 0;
+  flow_hdr_init(f_id, mac_remote, lip, lp, rip, rp);
 
   fs->tx_sent = 0;
   fs->tx_next_pos = 0;
@@ -257,12 +309,24 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
   fs->tx_rate = rate;
   fs->rtt_est = 0;
 
+  /* fast path congestion control starts in slow start with two segments,
+   * cc.c seeds the pacing rate from the same window */
+  cc = &fp_flowcc[f_id];
+  cc->cwnd = 2 * fs->tx_mss;
+  cc->ssthresh = tx_len;
+  cc->ca_bytes = 0;
+  cc->alpha = 0;
+  cc->win_end = local_seq;
+  cc->win_ackb = 0;
+  cc->win_ecnb = 0;
+  cc->cwr_seq = local_seq;
+
   /* write to empty entry first */
+  htb = &fp_flowht[b];
   MEM_BARRIER();
-  hte[i].flow_hash = hash;
+  htb->flow_hash[s] = hash;
   MEM_BARRIER();
-  hte[i].flow_id = FLEXNIC_PL_FLOWHTE_VALID |
-      (d << FLEXNIC_PL_FLOWHTE_POSSHIFT) | f_id;
+  htb->flow_id[s] = FLEXNIC_PL_FLOWHTE_VALID | f_id;
 
   *pf_id = f_id;
   return 0;
@@ -272,7 +336,15 @@ int nicif_connection_disable(uint32_t f_id, uint32_t *tx_seq, uint32_t *rx_seq,
     int *tx_closed, int *rx_closed)
 {
   //STATS_TS(nic_if_conn_disable_start);
-  struct flextcp_pl_flowst *fs = &fp_state->flowst[f_id];
+  struct flextcp_pl_flowst *fs = &fp_flowst[f_id];
+
+  /* fast path does not take flow locks, let the owning core do it */
+  if (config.fp_flow_owner) {
+    if (dataplane_flow_disable(f_id, tx_seq, rx_seq, tx_closed, rx_closed,
+          util_timeout_time_us()) != 0)
+      return -1;
+    goto clear;
+  }
 
   STATS_TS(start);
   util_spin_lock(&fs->lock);
@@ -289,6 +361,7 @@ int nicif_connection_disable(uint32_t f_id, uint32_t *tx_seq, uint32_t *rx_seq,
 
   util_spin_unlock(&fs->lock);
 
+clear:
  
   STATS_TS(flow_slot_clear_start); 
   flow_slot_clear(f_id, fs->local_ip, fs->local_port, fs->remote_ip,
@@ -309,7 +382,7 @@ void nicif_connection_free(uint32_t f_id)
 /** Move flow to new db */
 int nicif_connection_move(uint32_t dst_db, uint32_t f_id)
 {
-  fp_state->flowst[f_id].db_id = dst_db;
+  fp_flowst[f_id].db_id = dst_db;
   return 0;
 }
 
@@ -319,18 +392,19 @@ int nicif_connection_stats(uint32_t f_id,
 {
   struct flextcp_pl_flowst *fs;
 
-  if (f_id >= FLEXNIC_PL_FLOWST_NUM) {
+  if (f_id >= fp_state->flowst_num) {
     fprintf(stderr, "nicif_connection_stats: bad flow id\n");
     return -1;
   }
 
-  fs = &fp_state->flowst[f_id];
+  fs = &fp_flowst[f_id];
   p_stats->c_drops = fs->cnt_tx_drops;
   p_stats->c_acks = fs->cnt_rx_acks;
   p_stats->c_ackb = fs->cnt_rx_ack_bytes;
   p_stats->c_ecnb = fs->cnt_rx_ecn_bytes;
   p_stats->txp = fs->tx_sent != 0;
   p_stats->rtt = fs->rtt_est;
+  p_stats->cwnd = fp_flowcc[f_id].cwnd;
 
   return 0;
 }
@@ -347,12 +421,12 @@ int nicif_connection_setrate(uint32_t f_id, uint32_t rate)
 {
   struct flextcp_pl_flowst *fs;
 
-  if (f_id >= FLEXNIC_PL_FLOWST_NUM) {
+  if (f_id >= fp_state->flowst_num) {
     fprintf(stderr, "nicif_connection_stats: bad flow id\n");
     return -1;
   }
 
-  fs = &fp_state->flowst[f_id];
+  fs = &fp_flowst[f_id];
   fs->tx_rate = rate;
 
   return 0;
@@ -624,6 +698,60 @@ static inline volatile struct flextcp_pl_ktx *ktx_try_alloc(uint32_t core,
   return ktx;
 }
 
+STATIC_ASSERT(sizeof(struct pkt_tcp) + sizeof(struct tcp_timestamp_opt) ==
+    sizeof(struct flextcp_pl_flowhdr), flowhdr_size);
+
+/* 16 bit ones complement sum of buffer, not complemented */
+static uint16_t hdr_xsum(const void *buf, size_t len, uint32_t sum)
+{
+  const uint8_t *b = buf;
+  uint16_t w;
+  size_t i;
+
+  for (i = 0; i + 1 < len; i += 2) {
+    memcpy(&w, b + i, 2);
+    sum += w;
+  }
+  while ((sum >> 16) != 0)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return sum;
+}
+
+/** Build transmit header template for flow (see struct flextcp_pl_flowhdr) */
+static void flow_hdr_init(uint32_t f_id, uint64_t mac_remote, beui32_t lip,
+    beui16_t lp, beui32_t rip, beui16_t rp)
+{
+  struct pkt_tcp *p = (struct pkt_tcp *) fp_flowhdr[f_id].hdr;
+  struct tcp_timestamp_opt *opt = (struct tcp_timestamp_opt *) (p + 1);
+  uint16_t ip_sum, tcp_sum;
+
+  memset(p, 0, sizeof(fp_flowhdr[f_id].hdr));
+  memcpy(&p->eth.dest, &mac_remote, ETH_ADDR_LEN);
+  memcpy(&p->eth.src, &eth_addr, ETH_ADDR_LEN);
+  p->eth.type = t_beui16(ETH_TYPE_IP);
+
+  IPH_VHL_SET(&p->ip, 4, 5);
+  p->ip.id = t_beui16(3);
+  p->ip.ttl = 0xff;
+  p->ip.proto = IP_PROTO_TCP;
+  p->ip.src = lip;
+  p->ip.dest = rip;
+
+  p->tcp.src = lp;
+  p->tcp.dest = rp;
+  opt->kind = TCP_OPT_TIMESTAMP;
+  opt->length = sizeof(*opt);
+
+  /* partial checksums, filled in last so they are not summed themselves */
+  ip_sum = hdr_xsum(&p->ip, sizeof(p->ip), 0);
+  tcp_sum = hdr_xsum(&p->ip.src, 2 * sizeof(p->ip.src), IP_PROTO_TCP << 8);
+  if (!config.fp_xsumoffload) {
+    tcp_sum = hdr_xsum(&p->tcp, sizeof(p->tcp) + sizeof(*opt), tcp_sum);
+  }
+  p->ip.chksum = ip_sum;
+  p->tcp.chksum = tcp_sum;
+}
+
 static inline uint32_t flow_hash(ip_addr_t lip, beui16_t lp,
     ip_addr_t rip, beui16_t rp)
 {
@@ -638,115 +766,124 @@ static inline uint32_t flow_hash(ip_addr_t lip, beui16_t lp,
   return rte_hash_crc(&hk, sizeof(hk), 0);
 }
 
-static inline int flow_slot_alloc(uint32_t h, uint32_t *pi, uint32_t *pd)
+/* index of a free slot in bucket, or -1 if full */
+static inline int flow_slot_free(struct flextcp_pl_flowhtb *htb)
 {
-  uint32_t j, i, l, k, d;
-  struct flextcp_pl_flowhte *hte = fp_state->flowht;
-
-  /* find slot */
-  j = h % FLEXNIC_PL_FLOWHT_ENTRIES;
-  l = (j + FLEXNIC_PL_FLOWHT_NBSZ) % FLEXNIC_PL_FLOWHT_ENTRIES;
-
-  /* look for empty slot */
-  d = 0;
-  for (i = j; i != l; i = (i + 1) % FLEXNIC_PL_FLOWHT_ENTRIES) {
-    if ((hte[i].flow_id & FLEXNIC_PL_FLOWHTE_VALID) == 0) {
-      *pi = i;
-      *pd = d;
-      return 0;
-    }
-    d++;
+  int i;
+
+  for (i = 0; i < FLEXNIC_PL_FLOWHT_BSZ; i++) {
+    if ((htb->flow_id[i] & FLEXNIC_PL_FLOWHTE_VALID) == 0)
+      return i;
   }
+  return -1;
+}
 
-  /* no free slot, try to clear up on */
-  k = (l + 4 * FLEXNIC_PL_FLOWHT_NBSZ) % FLEXNIC_PL_FLOWHT_ENTRIES;
-  /* looking for candidate empty slot to move back */
-  for (; i != k; i = (i + 1) % FLEXNIC_PL_FLOWHT_ENTRIES) {
-    if ((hte[i].flow_id & FLEXNIC_PL_FLOWHTE_VALID) == 0) {
+/* Find slot for hash `h` in one of its two candidate buckets. If both are
+ * full, search breadth-first for a chain of entries that can each move to
+ * their alternate bucket, ending in one with a free slot. */
+static inline int flow_slot_alloc(uint32_t h, uint32_t *pb, uint32_t *ps)
+{
+  struct flow_slot_path q[FLOW_SLOT_PATH_MAX];
+  struct flextcp_pl_flowhtb *ht = fp_flowht, *src, *dst;
+  uint32_t head = 0, tail = 0, b, alt, eh, nb = fp_state->flowht_num;
+  int n = -1, p, s = -1, i;
+
+  q[tail].bucket = FLEXNIC_PL_FLOWHT_B1(h, nb);
+  q[tail++].parent = -1;
+  if (FLEXNIC_PL_FLOWHT_B2(h, nb) != q[0].bucket) {
+    q[tail].bucket = FLEXNIC_PL_FLOWHT_B2(h, nb);
+    q[tail++].parent = -1;
+  }
+
+  while (head < tail) {
+    n = head++;
+    b = q[n].bucket;
+    if ((s = flow_slot_free(&ht[b])) >= 0)
       break;
+
+    /* bucket full: try moving each of its entries to their other bucket */
+    for (i = 0; i < FLEXNIC_PL_FLOWHT_BSZ && tail < FLOW_SLOT_PATH_MAX; i++) {
+      eh = ht[b].flow_hash[i];
+      alt = FLEXNIC_PL_FLOWHT_B1(eh, nb);
+      if (alt == b)
+        alt = FLEXNIC_PL_FLOWHT_B2(eh, nb);
+      if (alt == b)
+        continue;
+
+      /* don't revisit buckets already on this path */
+      for (p = n; p >= 0 && q[p].bucket != alt; p = q[p].parent);
+      if (p >= 0)
+        continue;
+
+      q[tail].bucket = alt;
+      q[tail].parent = n;
+      q[tail++].slot = i;
     }
   }
 
-  /* abort if no candidate slot found */
-  if (i == k) {
+  if (s < 0) {
     fprintf(stderr, "flow_slot_alloc: no empty slot found\n");
     return -1;
   }
 
-  /* move candidate backwards until in range for this insertion */
-  /* j < l -> (i < j || i >= l) */
-  /* j > l -> (i >= l && i < j) */
-  while ((j > l || (i < j || i >= l)) && (j < l || (i >= l && i < j))) {
-    k = i;
+  /* move entries along path, starting at the free slot, so every entry
+   * stays visible in one of its buckets to concurrent lookups */
+  while (q[n].parent >= 0) {
+    p = q[n].parent;
+    src = &ht[q[p].bucket];
+    dst = &ht[q[n].bucket];
+    i = q[n].slot;
 
-    /* look for element to swap */
-    i = (k - FLEXNIC_PL_FLOWHT_NBSZ) % FLEXNIC_PL_FLOWHT_ENTRIES;
-    for (; i != k; i = (i + 1) % FLEXNIC_PL_FLOWHT_ENTRIES) {
-      assert((hte[i].flow_id & FLEXNIC_PL_FLOWHTE_VALID) != 0);
-
-      /* calculate how much further this element can be moved */
-      d = (hte[i].flow_id >> FLEXNIC_PL_FLOWHTE_POSSHIFT) &
-          (FLEXNIC_PL_FLOWHT_NBSZ - 1);
-      d = FLEXNIC_PL_FLOWHT_NBSZ - 1 - d;
-
-      /* check whether element can be moved */
-      if ((k - i) % FLEXNIC_PL_FLOWHT_ENTRIES <= d) {
-        break;
-      }
-    }
-
-    /* abort if none of the elements can be moved */
-    if (i == k) {
-      fprintf(stderr, "flow_slot_alloc: no element could be moved\n");
-      return -1;
-    }
-
-    /* move element up */
-    assert((hte[k].flow_id & FLEXNIC_PL_FLOWHTE_VALID) == 0);
-    d = (hte[i].flow_id >> FLEXNIC_PL_FLOWHTE_POSSHIFT) &
-        (FLEXNIC_PL_FLOWHT_NBSZ - 1);
+    /* a lookup scanning the destination before and the source after the
+     * move misses the entry, tell it to retry */
+    fp_state->flowht_seq++;
+    MEM_BARRIER();
 
     /* write to empty entry first */
-    hte[k].flow_hash = hte[i].flow_hash;
+    dst->flow_hash[s] = src->flow_hash[i];
     MEM_BARRIER();
-    hte[k].flow_id = FLEXNIC_PL_FLOWHTE_VALID |
-        (d << FLEXNIC_PL_FLOWHTE_POSSHIFT) |
-        (((1 << FLEXNIC_PL_FLOWHTE_POSSHIFT) - 1) & hte[i].flow_id);
+    dst->flow_id[s] = src->flow_id[i];
     MEM_BARRIER();
 
     /* empty original position */
-    hte[i].flow_id = 0;
+    src->flow_id[i] = 0;
     MEM_BARRIER();
+    fp_state->flowht_seq++;
+
+    s = i;
+    n = p;
   }
 
-  *pi = i;
-  *pd = (i - j) % FLEXNIC_PL_FLOWHT_ENTRIES;
+  *pb = q[n].bucket;
+  *ps = s;
   return 0;
 }
 
 static inline int flow_slot_clear(uint32_t f_id, ip_addr_t lip, beui16_t lp,
     ip_addr_t rip, beui16_t rp)
 {
-  uint32_t h, k, j, ffid, eh;
-  struct flextcp_pl_flowhte *e;
+  uint32_t h, b, j, k, ffid, eh, nb = fp_state->flowht_num;
+  struct flextcp_pl_flowhtb *htb;
 
   h = flow_hash(lip, lp, rip, rp);
 
-  for (j = 0; j < FLEXNIC_PL_FLOWHT_NBSZ; j++) {
-    k = (h + j) % FLEXNIC_PL_FLOWHT_ENTRIES;
-    e = &fp_state->flowht[k];
+  for (j = 0; j < 2; j++) {
+    b = (j == 0 ? FLEXNIC_PL_FLOWHT_B1(h, nb) : FLEXNIC_PL_FLOWHT_B2(h, nb));
+    htb = &fp_flowht[b];
 
-    ffid = e->flow_id;
-    MEM_BARRIER();
-    eh = e->flow_hash;
+    for (k = 0; k < FLEXNIC_PL_FLOWHT_BSZ; k++) {
+      ffid = htb->flow_id[k];
+      MEM_BARRIER();
+      eh = htb->flow_hash[k];
 
-    if ((ffid & FLEXNIC_PL_FLOWHTE_VALID) == 0 || eh != h) {
-      continue;
-    }
+      if ((ffid & FLEXNIC_PL_FLOWHTE_VALID) == 0 || eh != h) {
+        continue;
+      }
 
-    if ((ffid & ((1 << FLEXNIC_PL_FLOWHTE_POSSHIFT) - 1)) == f_id) {
-      e->flow_id &= ~FLEXNIC_PL_FLOWHTE_VALID;
-      return 0;
+      if ((ffid & FLEXNIC_PL_FLOWHTE_IDMASK) == f_id) {
+        htb->flow_id[k] &= ~FLEXNIC_PL_FLOWHTE_VALID;
+        return 0;
+      }
     }
   }
 
@@ -754,11 +891,18 @@ static inline int flow_slot_clear(uint32_t f_id, ip_addr_t lip, beui16_t lp,
   return -1;
 }
 
-static void flow_id_alloc_init(void)
+static int flow_id_alloc_init(void)
 {
   size_t i;
   struct flow_id_item *it, *prev = NULL;
-  for (i = 0; i < FLEXNIC_PL_FLOWST_NUM; i++) {
+
+  flow_id_items = calloc(fp_state->flowst_num, sizeof(*flow_id_items));
+  if (flow_id_items == NULL) {
+    fprintf(stderr, "flow_id_alloc_init: calloc failed\n");
+    return -1;
+  }
+
+  for (i = 0; i < fp_state->flowst_num; i++) {
     it = &flow_id_items[i];
     it->flow_id = i;
     it->next = NULL;
@@ -770,6 +914,8 @@ static void flow_id_alloc_init(void)
     }
     prev = it;
   }
+
+  return 0;
 }
 
 static int flow_id_alloc(uint32_t *fid)
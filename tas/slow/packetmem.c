@@ -37,35 +37,69 @@ struct packetmem_handle {
 
 static inline struct packetmem_handle *ph_alloc(void);
 static inline void ph_free(struct packetmem_handle *ph);
-static inline void merge_items(struct packetmem_handle *ph_prev);
+static inline void merge_items(struct packetmem_handle **freelist,
+    struct packetmem_handle *ph_prev);
+static int freelist_alloc(struct packetmem_handle **freelist, size_t length,
+    uintptr_t *off, struct packetmem_handle **handle);
 
-static struct packetmem_handle *freelist;
+/** One free list per NUMA arena in dma memory */
+static struct packetmem_handle *freelists[SHM_NUMA_MAX];
 
 int packetmem_init(void)
 {
   struct packetmem_handle *ph;
+  unsigned i;
 
-  if ((ph = ph_alloc()) == NULL) {
-    fprintf(stderr, "packetmem_init: ph_alloc failed\n");
-    return -1;
-  }
+  for (i = 0; i < shm_numa_nodes; i++) {
+    if ((ph = ph_alloc()) == NULL) {
+      fprintf(stderr, "packetmem_init: ph_alloc failed\n");
+      return -1;
+    }
 
-  ph->base = 0;
-  ph->len = tas_info->dma_mem_size;
-  ph->next = NULL;
-  freelist = ph;
+    ph->base = i * shm_numa_arena;
+    ph->len = (i == shm_numa_nodes - 1 ?
+        tas_info->dma_mem_size - ph->base : shm_numa_arena);
+    ph->next = NULL;
+    freelists[i] = ph;
+  }
 
   return 0;
 }
 
 int packetmem_alloc(size_t length, uintptr_t *off,
     struct packetmem_handle **handle)
+{
+  return packetmem_alloc_node(length, 0, off, handle);
+}
+
+int packetmem_alloc_node(size_t length, uint16_t node, uintptr_t *off,
+    struct packetmem_handle **handle)
+{
+  unsigned i;
+
+  if (node >= shm_numa_nodes)
+    node = 0;
+
+  /* fall back to other nodes if the preferred one is full */
+  for (i = 0; i < shm_numa_nodes; i++) {
+    if (freelist_alloc(&freelists[(node + i) % shm_numa_nodes], length, off,
+          handle) == 0)
+    {
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+static int freelist_alloc(struct packetmem_handle **freelist, size_t length,
+    uintptr_t *off, struct packetmem_handle **handle)
 {
   struct packetmem_handle *ph, *ph_prev, *ph_new;
 
   /* look for first fit */
   ph_prev = NULL;
-  ph = freelist;
+  ph = *freelist;
   while (ph != NULL && ph->len < length) {
     ph_prev = ph;
     ph = ph->next;
@@ -81,7 +115,7 @@ int packetmem_alloc(size_t length, uintptr_t *off,
 
     /* pointer to previous next pointer for removal */
     if (ph_prev == NULL) {
-      freelist = ph->next;
+      *freelist = ph->next;
     } else {
       ph_prev->next = ph->next;
     }
@@ -113,10 +147,16 @@ int packetmem_alloc(size_t length, uintptr_t *off,
 void packetmem_free(struct packetmem_handle *handle)
 {
   struct packetmem_handle *ph, *ph_prev;
+  struct packetmem_handle **freelist;
+  unsigned i;
+
+  /* return to free list of arena the handle was allocated from */
+  i = MIN(handle->base / shm_numa_arena, shm_numa_nodes - 1);
+  freelist = &freelists[i];
 
   /* look for first successor */
   ph_prev = NULL;
-  ph = freelist;
+  ph = *freelist;
   while (ph != NULL && ph->next != NULL && ph->next->base < handle->base) {
     ph_prev = ph;
     ph = ph->next;
@@ -124,21 +164,22 @@ void packetmem_free(struct packetmem_handle *handle)
 
   /* add to list */
   if (ph_prev == NULL) {
-    handle->next = freelist;
-    freelist = handle;
+    handle->next = *freelist;
+    *freelist = handle;
   } else {
     handle->next = ph_prev->next;
     ph_prev->next = handle;
   }
 
   /* merge items if necessary */
-  merge_items(ph_prev);
+  merge_items(freelist, ph_prev);
 }
 
 /** Merge handles around newly inserted item (pointer to predecessor or NULL
  * passed).
  */
-static inline void merge_items(struct packetmem_handle *ph_prev)
+static inline void merge_items(struct packetmem_handle **freelist,
+    struct packetmem_handle *ph_prev)
 {
   struct packetmem_handle *ph, *ph_next;
 
@@ -153,7 +194,7 @@ static inline void merge_items(struct packetmem_handle *ph_prev)
       ph = ph_prev;
     }
   } else {
-    ph = freelist;
+    ph = *freelist;
   }
 
   /* try to merge with successor if there is one */
@@ -38,8 +38,14 @@
 #include <utils_rng.h>
 #include <slowpath.h>
 #include "internal.h"
-
-#define TCP_MSS 1460
+#include "appif.h"
+
+/** MSS we advertise: interface MTU minus IP and TCP headers */
+#define TCP_MSS (config.ip_mtu - sizeof(struct ip_hdr) - sizeof(struct tcp_hdr))
+/** MSS assumed if the peer does not send an MSS option (RFC 1122) */
+#define TCP_MSS_DEFAULT 536
+/** Lower bound for MSS advertised by peer */
+#define TCP_MSS_MIN 88
 #define TCP_HTSIZE 4096
 
 #define PORT_MAX ((1u << 16) - 1)
@@ -72,12 +78,14 @@ struct backlog_slot {
 struct tcp_opts {
   struct tcp_mss_opt *mss;
   struct tcp_timestamp_opt *ts;
+  struct tcp_sack_perm_opt *sack_perm;
+  struct tcp_wscale_opt *wscale;
 };
 
 static int conn_arp_done(struct connection *conn);
 static void conn_packet(struct connection *c, const struct pkt_tcp *p,
     const struct tcp_opts *opts, uint32_t fn_core, uint16_t flow_group);
-static inline struct connection *conn_alloc(void);
+static inline struct connection *conn_alloc(uint16_t node);
 static inline void conn_free(struct connection *conn);
 static void conn_register(struct connection *conn);
 static void conn_unregister(struct connection *conn);
@@ -102,6 +110,11 @@ static inline int send_reset(const struct pkt_tcp *p,
     const struct tcp_opts *opts);
 static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
     struct tcp_opts *opts);
+static inline uint8_t conn_wscale_offer(const struct connection *c);
+static inline void conn_wscale_negotiate(struct connection *c,
+    const struct tcp_opts *opts);
+static inline void conn_mss_negotiate(struct connection *c,
+    const struct tcp_opts *opts);
 
 static uintptr_t ports[PORT_MAX + 1];
 static uint16_t port_eph_hint = PORT_FIRST_EPH;
@@ -161,7 +174,7 @@ int tcp_open(struct app_context *ctx, uint64_t opaque, uint32_t remote_ip,
   uint64_t ts = util_rdtsc();
 
   /* allocate connection struct */
-  if ((conn = conn_alloc()) == NULL) {
+  if ((conn = conn_alloc(ctx->numa_node)) == NULL) {
     fprintf(stderr, "tcp_open: malloc failed\n");
     return -1;
   }
@@ -338,7 +351,7 @@ int tcp_accept(struct app_context *ctx, uint64_t opaque,
 
   STATS_TS(start);
   /* allocate listener struct */
-  if ((conn = conn_alloc()) == NULL) {
+  if ((conn = conn_alloc(ctx->numa_node)) == NULL) {
     fprintf(stderr, "tcp_accept: conn_alloc failed\n");
     return -1;
   }
@@ -586,6 +599,14 @@ static int conn_syn_sent_packet(struct connection *c, const struct pkt_tcp *p,
     c->flags |= NICIF_CONN_ECN;
   }
 
+  /* enable SACK if SYN-ACK confirms */
+  if (config.tcp_sack && opts->sack_perm != NULL) {
+    c->flags |= NICIF_CONN_SACK;
+  }
+
+  conn_wscale_negotiate(c, opts);
+  conn_mss_negotiate(c, opts);
+
   cc_conn_init(c);
 
   c->comp.q = &conn_async_q;
@@ -595,8 +616,9 @@ static int conn_syn_sent_packet(struct connection *c, const struct pkt_tcp *p,
   if (nicif_connection_add(c->db_id, c->remote_mac, c->local_ip, c->local_port,
         c->remote_ip, c->remote_port, c->rx_buf - (uint8_t *) tas_shm,
         c->rx_len, c->tx_buf - (uint8_t *) tas_shm, c->tx_len,
-        c->remote_seq, c->local_seq, c->opaque, c->flags, c->cc_rate,
-        c->fn_core, c->flow_group, &c->flow_id)
+        c->remote_seq, c->local_seq, c->opaque, c->flags, c->rx_wscale,
+        c->tx_wscale, c->mss, c->cc_rate, c->fn_core, c->flow_group,
+        &c->flow_id)
       != 0)
   {
     fprintf(stderr, "conn_syn_sent_packet: nicif_connection_add failed\n");
@@ -655,7 +677,7 @@ static inline uint16_t port_alloc(void)
   return 0;
 }
 
-static inline struct connection *conn_alloc(void)
+static inline struct connection *conn_alloc(uint16_t node)
 {
   struct connection *conn;
   uintptr_t off_rx, off_tx;
@@ -665,13 +687,18 @@ static inline struct connection *conn_alloc(void)
     return NULL;
   }
 
-  if (packetmem_alloc(config.tcp_rxbuf_len, &off_rx, &conn->rx_handle) != 0) {
+  /* place buffers on the app's NUMA node */
+  if (packetmem_alloc_node(config.tcp_rxbuf_len, node, &off_rx,
+        &conn->rx_handle) != 0)
+  {
     fprintf(stderr, "conn_alloc: packetmem_alloc rx failed\n");
     free(conn);
     return NULL;
   }
 
-  if (packetmem_alloc(config.tcp_txbuf_len, &off_tx, &conn->tx_handle) != 0) {
+  if (packetmem_alloc_node(config.tcp_txbuf_len, node, &off_tx,
+        &conn->tx_handle) != 0)
+  {
     fprintf(stderr, "conn_alloc: packetmem_alloc tx failed\n");
     packetmem_free(conn->rx_handle);
     free(conn);
@@ -682,6 +709,8 @@ static inline struct connection *conn_alloc(void)
   conn->rx_len = config.tcp_rxbuf_len;
   conn->tx_buf = (uint8_t *) tas_shm + off_tx;
   conn->tx_len = config.tcp_txbuf_len;
+  conn->rx_wscale = conn->tx_wscale = 0;
+  conn->mss = TCP_MSS_DEFAULT;
   conn->to_armed = 0;
 
   return conn;
@@ -958,6 +987,14 @@ static void listener_accept(struct listener *l)
     c->flags |= NICIF_CONN_ECN;
   }
 
+  /* check if SACK is offered */
+  if (config.tcp_sack && opts.sack_perm != NULL) {
+    c->flags |= NICIF_CONN_SACK;
+  }
+
+  conn_wscale_negotiate(c, &opts);
+  conn_mss_negotiate(c, &opts);
+
   cc_conn_init(c);
 
   c->status = CONN_REG_SYNACK;
@@ -969,8 +1006,9 @@ static void listener_accept(struct listener *l)
   if (nicif_connection_add(c->db_id, c->remote_mac, c->local_ip, c->local_port,
         c->remote_ip, c->remote_port, c->rx_buf - (uint8_t *) tas_shm,
         c->rx_len, c->tx_buf - (uint8_t *) tas_shm, c->tx_len,
-        c->remote_seq, c->local_seq + 1, c->opaque, c->flags, c->cc_rate,
-        c->fn_core, c->flow_group, &c->flow_id)
+        c->remote_seq, c->local_seq + 1, c->opaque, c->flags, c->rx_wscale,
+        c->tx_wscale, c->mss, c->cc_rate, c->fn_core, c->flow_group,
+        &c->flow_id)
       != 0)
   {
     fprintf(stderr, "listener_packet: nicif_connection_add failed\n");
@@ -994,15 +1032,17 @@ out:
 
 static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
     uint16_t remote_port, uint16_t local_port, uint32_t local_seq,
-    uint32_t remote_seq, uint16_t flags, int ts_opt, uint32_t ts_echo,
-    uint16_t mss_opt)
+    uint32_t remote_seq, uint16_t flags, uint16_t wnd, int ts_opt,
+    uint32_t ts_echo, uint16_t mss_opt, int sack_opt, int wscale_opt)
 {
   uint32_t new_tail;
   struct pkt_tcp *p;
   struct tcp_mss_opt *opt_mss;
   struct tcp_timestamp_opt *opt_ts;
+  struct tcp_sack_perm_opt *opt_sack;
+  struct tcp_wscale_opt *opt_wscale;
   uint8_t optlen;
-  uint16_t len, off_ts, off_mss;
+  uint16_t len, off_ts, off_mss, off_sack, off_wscale;
 
   /* calculate header length depending on options */
   optlen = 0;
@@ -1010,6 +1050,10 @@ static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
   optlen += (mss_opt ? sizeof(*opt_mss) : 0);
   off_ts = optlen;
   optlen += (ts_opt ? sizeof(*opt_ts) : 0);
+  off_sack = optlen;
+  optlen += (sack_opt ? sizeof(*opt_sack) : 0);
+  off_wscale = optlen;
+  optlen += (wscale_opt >= 0 ? sizeof(*opt_wscale) : 0);
   optlen = (optlen + 3) & ~3;
   len = sizeof(*p) + optlen;
 
@@ -1042,9 +1086,10 @@ static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
   p->tcp.seqno = t_beui32(local_seq);
   p->tcp.ackno = t_beui32(remote_seq);
   TCPH_HDRLEN_FLAGS_SET(&p->tcp, 5 + optlen / 4, flags);
-  p->tcp.wnd = t_beui16(11680); /* TODO */
+  p->tcp.wnd = t_beui16(wnd);
   p->tcp.chksum = 0;
   p->tcp.urgp = t_beui16(0);
+  memset(p + 1, 0, optlen);
 
   /* if requested: add mss option */
   if (mss_opt) {
@@ -1057,13 +1102,27 @@ static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
   /* if requested: add timestamp option */
   if (ts_opt) {
     opt_ts = (struct tcp_timestamp_opt *) ((uint8_t *) (p + 1) + off_ts);
-    memset(opt_ts, 0, optlen);
     opt_ts->kind = TCP_OPT_TIMESTAMP;
     opt_ts->length = sizeof(*opt_ts);
     opt_ts->ts_val = t_beui32(0);
     opt_ts->ts_ecr = t_beui32(ts_echo);
   }
 
+  /* if requested: add sack permitted option */
+  if (sack_opt) {
+    opt_sack = (struct tcp_sack_perm_opt *) ((uint8_t *) (p + 1) + off_sack);
+    opt_sack->kind = TCP_OPT_SACK_PERM;
+    opt_sack->length = sizeof(*opt_sack);
+  }
+
+  /* if requested: add window scale option */
+  if (wscale_opt >= 0) {
+    opt_wscale = (struct tcp_wscale_opt *) ((uint8_t *) (p + 1) + off_wscale);
+    opt_wscale->kind = TCP_OPT_WSCALE;
+    opt_wscale->length = sizeof(*opt_wscale);
+    opt_wscale->shift = wscale_opt;
+  }
+
   /* calculate header checksums */
   p->ip.chksum = rte_ipv4_cksum((void *) &p->ip);
   p->tcp.chksum = rte_ipv4_udptcp_cksum((void *) &p->ip, (void *) &p->tcp);
@@ -1076,9 +1135,29 @@ static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
 static inline int send_control(const struct connection *conn, uint16_t flags,
     int ts_opt, uint32_t ts_echo, uint16_t mss_opt)
 {
+  int sack_opt = 0, wscale_opt = -1;
+  uint16_t wnd;
+
+  /* offer SACK and window scaling on SYN, confirm on SYN-ACK only if the
+   * peer offered it. The window in SYNs is never scaled. */
+  if ((flags & TCP_SYN) == TCP_SYN) {
+    if ((flags & TCP_ACK) == TCP_ACK) {
+      sack_opt = (conn->flags & NICIF_CONN_SACK) == NICIF_CONN_SACK;
+      if ((conn->flags & NICIF_CONN_WSCALE) == NICIF_CONN_WSCALE)
+        wscale_opt = conn->rx_wscale;
+    } else {
+      sack_opt = config.tcp_sack;
+      if (config.tcp_wscale)
+        wscale_opt = conn_wscale_offer(conn);
+    }
+    wnd = 11680; /* TODO */
+  } else {
+    wnd = MIN(0xffff, conn->rx_len >> conn->rx_wscale);
+  }
+
   return send_control_raw(conn->remote_mac, conn->remote_ip, conn->remote_port,
-      conn->local_port, conn->local_seq, conn->remote_seq, flags, ts_opt,
-      ts_echo, mss_opt);
+      conn->local_port, conn->local_seq, conn->remote_seq, flags, wnd, ts_opt,
+      ts_echo, mss_opt, sack_opt, wscale_opt);
 }
 
 static inline int send_reset(const struct pkt_tcp *p,
@@ -1096,7 +1175,7 @@ static inline int send_reset(const struct pkt_tcp *p,
   memcpy(&remote_mac, &p->eth.src, ETH_ADDR_LEN);
   return send_control_raw(remote_mac, f_beui32(p->ip.src), f_beui16(p->tcp.src),
       f_beui16(p->tcp.dest), f_beui32(p->tcp.ackno), f_beui32(p->tcp.seqno) + 1,
-      TCP_RST | TCP_ACK, ts_opt, ts_val, 0);
+      TCP_RST | TCP_ACK, 0, ts_opt, ts_val, 0, 0, -1);
 }
 
 static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
@@ -1109,6 +1188,8 @@ static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
 
   opts->ts = NULL;
   opts->mss = NULL;
+  opts->sack_perm = NULL;
+  opts->wscale = NULL;
 
   /* whole header not in buf */
   if (TCPH_HDRLEN(&p->tcp) < 5 || opts_len > (len - sizeof(*p))) {
@@ -1145,6 +1226,24 @@ static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
         }
 
         opts->ts = (struct tcp_timestamp_opt *) (opt + off);
+      } else if (opt_kind == TCP_OPT_SACK_PERM) {
+        if (opt_len != sizeof(struct tcp_sack_perm_opt)) {
+          fprintf(stderr, "parse_options: sack permitted option size wrong "
+              "(expect %zu got %u)\n", sizeof(struct tcp_sack_perm_opt),
+              opt_len);
+          return -1;
+        }
+
+        opts->sack_perm = (struct tcp_sack_perm_opt *) (opt + off);
+      } else if (opt_kind == TCP_OPT_WSCALE) {
+        if (opt_len != sizeof(struct tcp_wscale_opt)) {
+          fprintf(stderr, "parse_options: window scale option size wrong "
+              "(expect %zu got %u)\n", sizeof(struct tcp_wscale_opt),
+              opt_len);
+          return -1;
+        }
+
+        opts->wscale = (struct tcp_wscale_opt *) (opt + off);
       }
     }
     off += opt_len;
@@ -1153,6 +1252,44 @@ static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
   return 0;
 }
 
+/* window scale shift we offer: smallest shift that lets the advertised
+ * window cover the whole receive buffer */
+static inline uint8_t conn_wscale_offer(const struct connection *c)
+{
+  uint8_t shift = 0;
+
+  while (shift < TCP_WSCALE_MAX && (c->rx_len >> shift) > 0xffff)
+    shift++;
+  return shift;
+}
+
+/* enable window scaling if enabled locally and offered/confirmed by peer in
+ * SYN/SYN-ACK */
+static inline void conn_wscale_negotiate(struct connection *c,
+    const struct tcp_opts *opts)
+{
+  if (!config.tcp_wscale || opts->wscale == NULL) {
+    c->rx_wscale = c->tx_wscale = 0;
+    return;
+  }
+
+  c->flags |= NICIF_CONN_WSCALE;
+  c->rx_wscale = conn_wscale_offer(c);
+  c->tx_wscale = MIN(opts->wscale->shift, TCP_WSCALE_MAX);
+}
+
+/* segment size for connection: smaller of our MSS and the one offered by the
+ * peer in SYN/SYN-ACK */
+static inline void conn_mss_negotiate(struct connection *c,
+    const struct tcp_opts *opts)
+{
+  uint16_t mss = TCP_MSS_DEFAULT;
+
+  if (opts->mss != NULL)
+    mss = MAX(f_beui16(opts->mss->mss), TCP_MSS_MIN);
+  c->mss = MIN(mss, TCP_MSS);
+}
+
 struct connection *conn_ht_lookup(uint64_t opaque, uint32_t local_ip,
            uint32_t remote_ip, uint16_t local_port, uint16_t remote_port)
 {
@@ -294,7 +294,9 @@ int flexnic_driver_internal(void **int_mem_start)
 
 int flexnic_driver_connect(struct flexnic_info **p_info, void **p_mem_start)
 {
-  *p_info = NULL;
+  static uint8_t info[FLEXNIC_INFO_BYTES] __attribute__((aligned(64)));
+
+  *p_info = (struct flexnic_info *) info;
   /* hack: set mem start to 0 so we can just use pointers as offsets */
   *p_mem_start = (void *) 0;
   return 0;
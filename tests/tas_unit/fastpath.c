@@ -31,8 +31,21 @@ macaddr_t eth_addr;
 
 void *tas_shm = (void *) 0;
 
+#define TEST_FLOWS 16
+
 struct flextcp_pl_mem state_base;
 struct flextcp_pl_mem *fp_state = &state_base;
+struct flextcp_pl_flowst flowst_base[TEST_FLOWS];
+struct flextcp_pl_flowst *fp_flowst = flowst_base;
+struct flextcp_pl_flowooo flowooo_base[TEST_FLOWS];
+struct flextcp_pl_flowooo *fp_flowooo = flowooo_base;
+struct flextcp_pl_flowsack flowsack_base[TEST_FLOWS];
+struct flextcp_pl_flowsack *fp_flowsack = flowsack_base;
+struct flextcp_pl_flowcc flowcc_base[TEST_FLOWS];
+struct flextcp_pl_flowcc *fp_flowcc = flowcc_base;
+struct flextcp_pl_flowhdr flowhdr_base[TEST_FLOWS];
+struct flextcp_pl_flowhdr *fp_flowhdr = flowhdr_base;
+struct flextcp_pl_flowhtb *fp_flowht = NULL;
 
 struct dataplane_context **ctxs = NULL;
 struct configuration config;
@@ -42,12 +55,12 @@ struct qman_set_op {
   uint32_t id;
   uint32_t rate;
   uint32_t avail;
-  uint16_t max_chunk;
+  uint32_t max_chunk;
   uint8_t flags;
 } qm_set_op = { .got_op = 0 };
 
 int qman_set(struct qman_thread *t, uint32_t id, uint32_t rate, uint32_t avail,
-    uint16_t max_chunk, uint8_t flags)
+    uint32_t max_chunk, uint8_t flags)
 {
   qm_set_op.got_op = 1;
   qm_set_op.id = id;
@@ -59,6 +72,16 @@ int qman_set(struct qman_thread *t, uint32_t id, uint32_t rate, uint32_t avail,
   return 0;
 }
 
+void qman_set_app(struct qman_thread *t, uint32_t id, uint8_t app)
+{
+}
+
+int arx_ovf_parked(struct dataplane_context *ctx, uint16_t ctx_id,
+    uint32_t flow_id)
+{
+  return 0;
+}
+
 void util_flexnic_kick(struct flextcp_pl_appctx *ctx, uint32_t ts_us)
 {
   printf("util_flexnic_kick\n");
@@ -67,7 +90,7 @@ void util_flexnic_kick(struct flextcp_pl_appctx *ctx, uint32_t ts_us)
 /* initialize basic flow state */
 static void flow_init(uint32_t fid, uint32_t rxlen, uint32_t txlen, uint64_t opaque)
 {
-  struct flextcp_pl_flowst *fs = &state_base.flowst[fid];
+  struct flextcp_pl_flowst *fs = &fp_flowst[fid];
   void *rxbuf = mmap(NULL, rxlen, PROT_READ | PROT_WRITE,
       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
   void *txbuf = mmap(NULL, rxlen, PROT_READ | PROT_WRITE,
@@ -84,6 +107,7 @@ static void flow_init(uint32_t fid, uint32_t rxlen, uint32_t txlen, uint64_t opa
   fs->remote_port = t_beui16(TEST_PORT);
   fs->rx_avail = rxlen;
   fs->rx_remote_avail = rxlen;
+  fs->tx_mss = 1448;
   fs->tx_rate = 10000;
   fs->rtt_est = 18;
 }
@@ -101,7 +125,7 @@ static struct rte_mbuf *mbuf_alloc(void)
 void test_txbump_small(void *arg)
 {
   int ret;
-  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst *fs = &fp_flowst[0];
   struct dataplane_context ctx;
   memset(&ctx, 0, sizeof(ctx));
 
@@ -124,7 +148,7 @@ void test_txbump_small(void *arg)
 void test_txbump_full(void *arg)
 {
   int ret;
-  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst *fs = &fp_flowst[0];
   struct dataplane_context ctx;
   memset(&ctx, 0, sizeof(ctx));
 
@@ -144,10 +168,32 @@ void test_txbump_full(void *arg)
       (QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_ADD_AVAIL));
 }
 
+/* With TSO enabled the queue manager should hand out multi-MSS chunks */
+void test_txbump_tso(void *arg)
+{
+  int ret;
+  struct flextcp_pl_flowst *fs = &fp_flowst[0];
+  struct dataplane_context ctx;
+  memset(&ctx, 0, sizeof(ctx));
+
+  flow_init(0, 1024, 1024, 123456);
+  config.fp_tso = 1;
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  ret = fast_flows_bump(&ctx, 0, 0, 0, 1024, 0, (struct network_buf_handle *) tmb, 0);
+  test_assert("unused tx buffer", ret == -1);
+  test_assert("updated tx avail", fs->tx_avail == 1024);
+  test_assert("qman set sent", qm_set_op.got_op);
+  test_assert("qman set avail correct", qm_set_op.avail == 1024);
+  test_assert("qman set max chunk correct", qm_set_op.max_chunk > 1448 &&
+      qm_set_op.max_chunk % 1448 == 0 && qm_set_op.max_chunk <= UINT16_MAX);
+}
+
 void test_txbump_toolong(void *arg)
 {
   int ret;
-  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst *fs = &fp_flowst[0];
   struct dataplane_context ctx;
   memset(&ctx, 0, sizeof(ctx));
 
@@ -164,7 +210,7 @@ void test_txbump_toolong(void *arg)
 void test_rxbump_toolong(void *arg)
 {
   int ret;
-  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst *fs = &fp_flowst[0];
   struct dataplane_context ctx;
   memset(&ctx, 0, sizeof(ctx));
 
@@ -187,7 +233,7 @@ void test_rxbump_toolong(void *arg)
 void test_rxbump_fc_reopen_notx(void *arg)
 {
   int ret;
-  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst *fs = &fp_flowst[0];
   struct dataplane_context ctx;
   memset(&ctx, 0, sizeof(ctx));
 
@@ -213,7 +259,7 @@ void test_rxbump_fc_reopen_notx(void *arg)
 void test_rxbump_fc_reopen_tx(void *arg)
 {
   int ret;
-  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst *fs = &fp_flowst[0];
   struct dataplane_context ctx;
   memset(&ctx, 0, sizeof(ctx));
 
@@ -237,7 +283,7 @@ void test_rxbump_fc_reopen_tx(void *arg)
 void test_rxbump_fc_reopen_deadlock(void *arg)
 {
   int ret;
-  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst *fs = &fp_flowst[0];
   struct dataplane_context ctx;
   memset(&ctx, 0, sizeof(ctx));
 
@@ -258,9 +304,111 @@ void test_rxbump_fc_reopen_deadlock(void *arg)
   /* TODO: check ack packet */
 }
 
+#define TEST_IVS 4
+
+void test_seq_ivs_merge(void *arg)
+{
+  uint32_t starts[TEST_IVS] = { 110, 130, 150 };
+  uint32_t lens[TEST_IVS] = { 5, 5, 5 };
+
+  /* overlaps first two, leaves the third alone */
+  test_assert("add", seq_ivs_add(starts, lens, TEST_IVS, 100, 113, 20) == 0);
+  test_assert("merged start", starts[0] == 110);
+  test_assert("merged len", lens[0] == 25);
+  test_assert("next moved", starts[1] == 150 && lens[1] == 5);
+  test_assert("terminated", lens[2] == 0);
+
+  /* contained in existing interval */
+  test_assert("add inside", seq_ivs_add(starts, lens, TEST_IVS, 100, 112, 3)
+      == 0);
+  test_assert("unchanged", starts[0] == 110 && lens[0] == 25 && lens[2] == 0);
+}
+
+void test_seq_ivs_adjacent(void *arg)
+{
+  uint32_t starts[TEST_IVS] = { 110, 130 };
+  uint32_t lens[TEST_IVS] = { 5, 5 };
+
+  /* touching end of first interval */
+  test_assert("add after", seq_ivs_add(starts, lens, TEST_IVS, 100, 115, 5)
+      == 0);
+  test_assert("merged after", starts[0] == 110 && lens[0] == 10);
+  test_assert("second kept", starts[1] == 130 && lens[1] == 5);
+
+  /* touching start of first interval */
+  test_assert("add before", seq_ivs_add(starts, lens, TEST_IVS, 100, 105, 5)
+      == 0);
+  test_assert("merged before", starts[0] == 105 && lens[0] == 15);
+
+  /* filling the gap joins both */
+  test_assert("add gap", seq_ivs_add(starts, lens, TEST_IVS, 100, 120, 10)
+      == 0);
+  test_assert("joined", starts[0] == 105 && lens[0] == 30 && lens[1] == 0);
+}
+
+void test_seq_ivs_overflow(void *arg)
+{
+  uint32_t starts[TEST_IVS] = { 110, 120, 130, 140 };
+  uint32_t lens[TEST_IVS] = { 5, 5, 5, 5 };
+
+  /* full set, new interval is furthest from base */
+  test_assert("add beyond", seq_ivs_add(starts, lens, TEST_IVS, 100, 150, 5)
+      == -1);
+  test_assert("last kept", starts[3] == 140 && lens[3] == 5);
+
+  /* closer interval pushes out the last one */
+  test_assert("add between", seq_ivs_add(starts, lens, TEST_IVS, 100, 116, 2)
+      == 0);
+  test_assert("inserted", starts[1] == 116 && lens[1] == 2);
+  test_assert("shifted", starts[2] == 120 && starts[3] == 130);
+  test_assert("last dropped", lens[3] == 5 && starts[3] != 140);
+}
+
+void test_seq_ivs_wrap(void *arg)
+{
+  uint32_t base = UINT32_MAX - 15;
+  uint32_t starts[TEST_IVS] = { UINT32_MAX - 7, 20 };
+  uint32_t lens[TEST_IVS] = { 16, 4 };
+
+  /* adjacent to interval wrapping around zero */
+  test_assert("add", seq_ivs_add(starts, lens, TEST_IVS, base, 8, 4) == 0);
+  test_assert("merged", starts[0] == UINT32_MAX - 7 && lens[0] == 20);
+  test_assert("second kept", starts[1] == 20 && lens[1] == 4);
+
+  /* before base in 32-bit order, after it in sequence space */
+  test_assert("add low", seq_ivs_add(starts, lens, TEST_IVS, base,
+        UINT32_MAX - 12, 2) == 0);
+  test_assert("sorted first", starts[0] == UINT32_MAX - 12 && lens[0] == 2);
+  test_assert("sorted second", starts[1] == UINT32_MAX - 7);
+
+  /* trim across zero */
+  seq_ivs_trim(starts, lens, TEST_IVS, 2);
+  test_assert("trimmed", starts[0] == 2 && lens[0] == 10);
+  test_assert("after trim", starts[1] == 20 && lens[1] == 4 && lens[2] == 0);
+}
+
+void test_seq_ivs_trim(void *arg)
+{
+  uint32_t starts[TEST_IVS] = { 110, 120, 130 };
+  uint32_t lens[TEST_IVS] = { 5, 5, 5 };
+
+  seq_ivs_trim(starts, lens, TEST_IVS, 100);
+  test_assert("before all", starts[0] == 110 && lens[2] == 5);
+
+  seq_ivs_trim(starts, lens, TEST_IVS, 112);
+  test_assert("partial", starts[0] == 112 && lens[0] == 3);
+
+  seq_ivs_trim(starts, lens, TEST_IVS, 125);
+  test_assert("dropped covered", starts[0] == 130 && lens[0] == 5);
+  test_assert("terminated", lens[1] == 0);
+
+  seq_ivs_trim(starts, lens, TEST_IVS, 135);
+  test_assert("empty", lens[0] == 0);
+}
+
 void test_retransmit(void *arg)
 {
-  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst *fs = &fp_flowst[0];
   struct dataplane_context ctx;
   memset(&ctx, 0, sizeof(ctx));
 
@@ -271,7 +419,7 @@ void test_retransmit(void *arg)
   fs->tx_next_seq = 129;
   fs->rx_remote_avail -= 128;
 
-  fast_flows_retransmit(&ctx, 0);
+  fast_flows_retransmit(&ctx, 0, 0);
   test_assert("tx sent is zero", fs->tx_sent == 0);
   test_assert("tx avail increased", fs->tx_avail == 128 + 256);
   test_assert("tx next pos reset", fs->tx_next_pos == 0);
@@ -287,11 +435,95 @@ void test_retransmit(void *arg)
       (QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_ADD_AVAIL));
 }
 
+void test_timer_wheel_arm(void *arg)
+{
+  struct timer_wheel w;
+  uint32_t ids[4];
+
+  test_assert("init", timer_wheel_init(&w, 8, 0, 0) == 0);
+
+  timer_wheel_arm(&w, 1, 100);
+  timer_wheel_arm(&w, 1, 200);
+  test_assert("later re-arm ignored", timer_wheel_next_ts(&w, 0) == 100);
+  timer_wheel_arm(&w, 1, 50);
+  test_assert("earlier re-arm moves", timer_wheel_next_ts(&w, 0) == 50);
+
+  timer_wheel_arm(&w, 2, 30);
+  timer_wheel_cancel(&w, 2);
+  timer_wheel_cancel(&w, 3);
+  test_assert("cancelled not due", timer_wheel_advance(&w, 49) == 0);
+  test_assert("due", timer_wheel_advance(&w, 50) == 1);
+  test_assert("one expired", timer_wheel_expired(&w, ids, 4) == 1);
+  test_assert("expired id", ids[0] == 1);
+  test_assert("empty", timer_wheel_next_ts(&w, 50) == -1U);
+
+  /* deadline in the past expires right away */
+  timer_wheel_arm(&w, 4, 10);
+  test_assert("past due", timer_wheel_next_ts(&w, 50) == 0);
+  test_assert("past expired", timer_wheel_expired(&w, ids, 4) == 1 &&
+      ids[0] == 4);
+}
+
+void test_timer_wheel_cascade(void *arg)
+{
+  struct timer_wheel w;
+  uint32_t ids[4], far = 1U << 25;
+
+  test_assert("init", timer_wheel_init(&w, 8, 0, 0) == 0);
+
+  /* level 1, and beyond the level 1 horizon */
+  timer_wheel_arm(&w, 0, 5000);
+  timer_wheel_arm(&w, 1, far);
+  timer_wheel_arm(&w, 2, 3 * TIMER_WHEEL_SLOTS + 7);
+
+  test_assert("not due", timer_wheel_advance(&w, 3 * TIMER_WHEEL_SLOTS + 6)
+      == 0);
+  test_assert("cascaded due", timer_wheel_advance(&w,
+        3 * TIMER_WHEEL_SLOTS + 7) == 1);
+  test_assert("cascaded expired", timer_wheel_expired(&w, ids, 4) == 1 &&
+      ids[0] == 2);
+
+  test_assert("level 1 not due", timer_wheel_advance(&w, 4999) == 0);
+  test_assert("level 1 due", timer_wheel_advance(&w, 5000) == 1);
+  test_assert("level 1 expired", timer_wheel_expired(&w, ids, 4) == 1 &&
+      ids[0] == 0);
+
+  test_assert("parked not due", timer_wheel_advance(&w, far - 1) == 0);
+  test_assert("parked due", timer_wheel_advance(&w, far) == 1);
+  test_assert("parked expired", timer_wheel_expired(&w, ids, 4) == 1 &&
+      ids[0] == 1);
+}
+
+void test_timer_wheel_next_ts(void *arg)
+{
+  struct timer_wheel w;
+
+  test_assert("init", timer_wheel_init(&w, 8, 0, 100) == 0);
+  test_assert("empty", timer_wheel_next_ts(&w, 100) == -1U);
+
+  timer_wheel_arm(&w, 0, 110);
+  test_assert("level 0", timer_wheel_next_ts(&w, 100) == 10);
+  test_assert("late caller", timer_wheel_next_ts(&w, 120) == 0);
+  timer_wheel_cancel(&w, 0);
+
+  /* slot in the next rotation: wake up at the end of this one */
+  timer_wheel_arm(&w, 0, TIMER_WHEEL_SLOTS + 50);
+  test_assert("wrapped level 0", timer_wheel_next_ts(&w, 100) ==
+      TIMER_WHEEL_SLOTS - 100);
+  timer_wheel_cancel(&w, 0);
+
+  /* only level 1 timers: wake up for the cascade at end of rotation */
+  timer_wheel_arm(&w, 1, 100 + 5 * TIMER_WHEEL_SLOTS);
+  test_assert("level 1", timer_wheel_next_ts(&w, 100) ==
+      TIMER_WHEEL_SLOTS - 100);
+}
+
 int main(int argc, char *argv[])
 {
   int ret = 0;
 
   memset(&state_base, 0, sizeof(state_base));
+  state_base.flowst_num = TEST_FLOWS;
 
   if (test_subcase("tx bump small", test_txbump_small, NULL))
     ret = 1;
@@ -299,6 +531,9 @@ int main(int argc, char *argv[])
   if (test_subcase("tx bump full", test_txbump_full, NULL))
     ret = 1;
 
+  if (test_subcase("tx bump tso", test_txbump_tso, NULL))
+    ret = 1;
+
   if (test_subcase("tx bump too long", test_txbump_toolong, NULL))
     ret = 1;
 
@@ -315,8 +550,32 @@ int main(int argc, char *argv[])
         test_rxbump_fc_reopen_deadlock, NULL))
     ret = 1;
 
+  if (test_subcase("seq intervals merge", test_seq_ivs_merge, NULL))
+    ret = 1;
+
+  if (test_subcase("seq intervals adjacent", test_seq_ivs_adjacent, NULL))
+    ret = 1;
+
+  if (test_subcase("seq intervals overflow", test_seq_ivs_overflow, NULL))
+    ret = 1;
+
+  if (test_subcase("seq intervals wraparound", test_seq_ivs_wrap, NULL))
+    ret = 1;
+
+  if (test_subcase("seq intervals trim", test_seq_ivs_trim, NULL))
+    ret = 1;
+
   if (test_subcase("retransmit", test_retransmit, NULL))
     ret = 1;
 
+  if (test_subcase("timer wheel arm", test_timer_wheel_arm, NULL))
+    ret = 1;
+
+  if (test_subcase("timer wheel cascade", test_timer_wheel_cascade, NULL))
+    ret = 1;
+
+  if (test_subcase("timer wheel next ts", test_timer_wheel_next_ts, NULL))
+    ret = 1;
+
   return ret;
 }
@@ -105,12 +105,12 @@ static int dump_flow(uint32_t flow_id)
   struct flextcp_pl_flowst *fs;
   uint64_t mac = 0;
 
-  if (flow_id >= FLEXNIC_PL_FLOWST_NUM) {
+  if (flow_id >= plm->flowst_num) {
     fprintf(stderr, "dump_appctx: invalid doorbell id %u\n", flow_id);
     return -1;
   }
 
-  fs = &plm->flowst[flow_id];
+  fs = &FLEXNIC_PL_MEM_TABLE(plm, struct flextcp_pl_flowst, flowst)[flow_id];
 
   /* skip flows without receive and transmit buffers */
   if (fs->rx_len == 0 && fs->tx_len == 0) {
@@ -195,7 +195,7 @@ int main(int argc, char *argv[])
   for (i = 0; i < FLEXNIC_PL_APPCTX_NUM; i++) {
     dump_appctx(i);
   }
-  for (i = 0; i < FLEXNIC_PL_FLOWST_NUM; i++) {
+  for (i = 0; i < plm->flowst_num; i++) {
     dump_flow(i);
   }
 